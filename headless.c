@@ -0,0 +1,217 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "vt2000.h"
+#include "backend.h"
+
+#define ScreenWidth 800
+#define ScreenHeight 480
+
+#define FPSDef 100
+#define ReadSize 65536
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-f font.ttf] [-s WIDTHxHEIGHT] [-o snapshot.ppm|.png] [-i idle_ms] [-m buffers] [file ...]\n"
+                    "feeds the files (or stdin) to the terminal, rendering a frame every 1/%d s of wall time\n"
+                    "-m renders into 2 or 3 shared memory buffers, a child process takes the frames the way a\n"
+                    "   compositor would, copying their damage, and writes the snapshot from its copy\n",
+            name, FPSDef);
+}
+
+// the consumer process of -m, mirrors every frame's damage into a framebuffer of its own
+static int consume(int fd, const char *snapshot) {
+    VTShmView *view;
+    VTBackend *mirror;
+    VTRect rects[BACKEND_MAX_RECTS];
+    const uint32_t *pixels;
+    uint32_t *dst;
+    uint64_t frames, copied;
+    int width, height, stride, dst_stride, count, i, y;
+
+    if (!(view = backend_shm_attach(fd, &width, &height)) || !(mirror = backend_headless_new(width, height))) {
+        fprintf(stderr, "consumer: can not attach\n");
+        return 1;
+    }
+    while ((count = backend_shm_next(view, -1, &pixels, &stride, rects)) >= 0) {
+        dst = mirror->acquire(mirror, &dst_stride);
+        for (i = 0; i < count; ++i) {
+            for (y = rects[i].y; y < rects[i].y + rects[i].height; ++y) {
+                memcpy(dst + (size_t) y * dst_stride + rects[i].x, pixels + (size_t) y * stride + rects[i].x,
+                       rects[i].width * sizeof(uint32_t));
+            }
+            mirror->pixels += (uint64_t) rects[i].width * rects[i].height;
+        }
+        mirror->frames++;
+        // copied out, the producer may draw into it again
+        backend_shm_release(view);
+    }
+    backend_stats(mirror, &frames, &copied);
+    fprintf(stderr, "consumer: %llu frames, %llu pixels copied\n", (unsigned long long) frames,
+            (unsigned long long) copied);
+    if (snapshot && backend_headless_snapshot(mirror, snapshot) < 0) {
+        fprintf(stderr, "can not write %s\n", snapshot);
+    }
+    backend_destroy(mirror);
+    backend_shm_detach(view);
+    return 0;
+}
+
+static void *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    void *bytes;
+    long length;
+
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bytes = length > 0 ? malloc(length) : NULL;
+    if (!bytes || fread(bytes, 1, length, f) != (size_t) length) {
+        free(bytes);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *size = length;
+    return bytes;
+}
+
+// feed one input, a frame whenever the frame interval has passed
+static uint64_t feed(FILE *f, VTBackend *backend, uint64_t *next_frame) {
+    static char buffer[ReadSize];
+    uint64_t total = 0;
+    size_t n;
+
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        VT_Write(buffer, n);
+        total += n;
+        if (backend_clock_ns() >= *next_frame) {
+            backend_frame(backend);
+            *next_frame = backend_clock_ns() + 1000000000u / FPSDef;
+        }
+    }
+    return total;
+}
+
+int main(int argc, char **argv) {
+    const char *font_path = NULL, *snapshot = NULL;
+    int width = ScreenWidth, height = ScreenHeight, idle_ms = 0, buffers = 0, peer = -1;
+    pid_t consumer = -1;
+    uint64_t bytes = 0, start, elapsed, next_frame, frames, pixels, busy_frames;
+    void *font = NULL;
+    size_t font_size = 0;
+    VTBackend *backend;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "f:s:o:i:m:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                font_path = optarg;
+                break;
+            case 's':
+                if (sscanf(optarg, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'o':
+                snapshot = optarg;
+                break;
+            case 'i':
+                idle_ms = atoi(optarg);
+                break;
+            case 'm':
+                buffers = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    backend = buffers ? backend_shm_new(width, height, buffers, &peer) : backend_headless_new(width, height);
+    if (!backend) {
+        fprintf(stderr, "can not create the backend\n");
+        return 1;
+    }
+    // fork before VT_SetFont starts any threads
+    if (buffers) {
+        if ((consumer = fork()) == 0) {
+            backend_destroy(backend);
+            return consume(peer, snapshot);
+        }
+        close(peer);
+        if (consumer < 0) {
+            fprintf(stderr, "can not start the consumer\n");
+            return 1;
+        }
+    }
+    if (VT_Init(width, height) < 0) {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    if (font_path) {
+        if (!(font = read_file(font_path, &font_size)) || VT_SetFont(font, font_size) < 0) {
+            fprintf(stderr, "can not load font %s\n", font_path);
+            return 1;
+        }
+    }
+
+    start = backend_clock_ns();
+    next_frame = start;
+    if (optind >= argc) {
+        bytes += feed(stdin, backend, &next_frame);
+    }
+    for (i = optind; i < argc; ++i) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "can not open %s\n", argv[i]);
+            continue;
+        }
+        bytes += feed(f, backend, &next_frame);
+        fclose(f);
+    }
+    // the last frame must get through, wait for the consumer to free a buffer
+    while (backend_frame(backend) < 0) {
+        backend_sleep_ms(1);
+    }
+    elapsed = backend_clock_ns() - start;
+    backend_stats(backend, &busy_frames, &pixels);
+
+    fprintf(stderr, "%llu bytes in %.3f s, %.1f MB/s, %llu frames, %llu pixels presented\n",
+            (unsigned long long) bytes, elapsed / 1e9, elapsed ? bytes * 1e3 / elapsed : 0.0,
+            (unsigned long long) busy_frames, (unsigned long long) pixels);
+
+    // an idle terminal at the frame rate, should present nothing and cost next to nothing
+    if (idle_ms > 0) {
+        uint64_t idle_start = backend_clock_ns(), idle_pixels, busy = 0;
+        for (i = 0; i < idle_ms * FPSDef / 1000; ++i) {
+            uint64_t t = backend_clock_ns();
+            backend_frame(backend);
+            busy += backend_clock_ns() - t;
+            backend_sleep_ms(1000 / FPSDef);
+        }
+        backend_stats(backend, &frames, &idle_pixels);
+        fprintf(stderr, "idle: %llu frames in %.3f s, %.0f ns per frame, %llu pixels presented\n",
+                (unsigned long long) (frames - busy_frames), (backend_clock_ns() - idle_start) / 1e9,
+                frames > busy_frames ? (double) busy / (frames - busy_frames) : 0.0,
+                (unsigned long long) (idle_pixels - pixels));
+    }
+
+    if (!buffers && snapshot && backend_headless_snapshot(backend, snapshot) < 0) {
+        fprintf(stderr, "can not write %s\n", snapshot);
+    }
+    // closing the socket ends the consumer
+    backend_destroy(backend);
+    if (consumer > 0) {
+        waitpid(consumer, NULL, 0);
+    }
+    VT_Shutdown();
+    free(font);
+    return 0;
+}
@@ -0,0 +1,319 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "schrift.h"
+
+#define DumpMagic 0x42544653u
+#define MaxSizes 16
+// kerning is compared over every pair of this range
+#define KernFirst 0x20
+#define KernLast 0x7e
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-r first-last] [-s size,size,...] [-n repeat] [-o] [-m] [-d dump | -c dump] font.ttf\n"
+                    "renders every codepoint of the range at every size and times it\n"
+                    "-o / -m   enable the outline / metrics cache\n"
+                    "-d        write the metrics, kerning and coverage of the run to dump\n"
+                    "-c        compare them with a dump written by another build, e.g. the SCHRIFT_FLOAT one,\n"
+                    "          exits 1 when metrics or kerning differ\n",
+            name);
+}
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * the dump and the comparison walk the same sequence of records,
+ * a record written with -d is checked against the same record read back with -c
+ */
+typedef struct {
+    FILE *dump;
+    FILE *compare;
+    int broken;
+    uint64_t metrics_differ;
+    uint64_t kerning_differ;
+    uint64_t pixels;
+    uint64_t pixels_differ;
+    int max_difference;
+} Checker;
+
+static int check(Checker *checker, const void *data, size_t size, uint64_t *differ) {
+    uint8_t expected[256];
+
+    if (checker->dump && fwrite(data, 1, size, checker->dump) != size) {
+        checker->broken = 1;
+    }
+    if (!checker->compare || checker->broken) {
+        return 0;
+    }
+    if (size > sizeof(expected) || fread(expected, 1, size, checker->compare) != size) {
+        checker->broken = 1;
+        return 0;
+    }
+    if (memcmp(expected, data, size)) {
+        (*differ)++;
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    uint32_t codepoint;
+    int32_t width;
+    int32_t height;
+    SFT_GMetrics metrics;
+} GlyphRecord;
+
+// a glyph with other metrics or another image size counts as a metrics difference, its pixels are skipped
+static void check_glyph(Checker *checker, const GlyphRecord *record, const uint8_t *pixels) {
+    uint8_t expected[4096];
+    size_t size = (size_t) record->width * record->height, done, n, i;
+    GlyphRecord previous;
+
+    checker->pixels += size;
+    if (checker->dump && (fwrite(record, sizeof(*record), 1, checker->dump) != 1
+                          || fwrite(pixels, 1, size, checker->dump) != size)) {
+        checker->broken = 1;
+    }
+    if (!checker->compare || checker->broken) {
+        return;
+    }
+    if (fread(&previous, sizeof(previous), 1, checker->compare) != 1 || previous.codepoint != record->codepoint) {
+        checker->broken = 1;
+        return;
+    }
+    if (memcmp(&previous, record, sizeof(previous))) {
+        checker->metrics_differ++;
+        if (previous.width != record->width || previous.height != record->height) {
+            fseek(checker->compare, (long) previous.width * previous.height, SEEK_CUR);
+            return;
+        }
+    }
+    for (done = 0; checker->compare && !checker->broken && done < size; done += n) {
+        n = size - done < sizeof(expected) ? size - done : sizeof(expected);
+        if (fread(expected, 1, n, checker->compare) != n) {
+            checker->broken = 1;
+            return;
+        }
+        for (i = 0; i < n; ++i) {
+            int difference = abs((int) expected[i] - (int) pixels[done + i]);
+            if (difference) {
+                checker->pixels_differ++;
+                if (difference > checker->max_difference) {
+                    checker->max_difference = difference;
+                }
+            }
+        }
+    }
+}
+
+static int parse_sizes(const char *text, double *sizes) {
+    int count = 0;
+    char *end;
+
+    while (*text && count < MaxSizes) {
+        sizes[count] = strtod(text, &end);
+        if (end == text || sizes[count] <= 0) {
+            return 0;
+        }
+        count++;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return *text ? 0 : count;
+}
+
+int main(int argc, char **argv) {
+    double sizes[MaxSizes] = {12, 17, 33, 96, 200};
+    int size_count = 5, repeat = 1, outline_cache = 0, metrics_cache = 0;
+    unsigned long first = 0x20, last = 0x24f;
+    const char *dump_path = NULL, *compare_path = NULL;
+    Checker checker;
+    SFT_Font *font;
+    SFT_Arena *arena;
+    SFT sft;
+    uint8_t *pixels = NULL;
+    size_t capacity = 0;
+    uint64_t start, elapsed, glyphs = 0, coverage = 0;
+    int opt, s, r, result = 0;
+    unsigned long c, d;
+
+    while ((opt = getopt(argc, argv, "r:s:n:omd:c:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                if (sscanf(optarg, "%lx-%lx", &first, &last) != 2 || first > last) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 's':
+                if (!(size_count = parse_sizes(optarg, sizes))) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'n':
+                repeat = atoi(optarg) > 0 ? atoi(optarg) : 1;
+                break;
+            case 'o':
+                outline_cache = 1;
+                break;
+            case 'm':
+                metrics_cache = 1;
+                break;
+            case 'd':
+                dump_path = optarg;
+                break;
+            case 'c':
+                compare_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1 || (dump_path && compare_path)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!(font = sft_loadfile(argv[optind]))) {
+        fprintf(stderr, "can not load font %s\n", argv[optind]);
+        return 1;
+    }
+    if ((outline_cache && sft_cacheoutlines(font) < 0) || (metrics_cache && sft_cachemetrics(font) < 0)
+        || !(arena = sft_arena_new())) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    memset(&checker, 0, sizeof(checker));
+    if (dump_path && !(checker.dump = fopen(dump_path, "wb"))) {
+        fprintf(stderr, "can not write %s\n", dump_path);
+        return 1;
+    }
+    if (compare_path && !(checker.compare = fopen(compare_path, "rb"))) {
+        fprintf(stderr, "can not read %s\n", compare_path);
+        return 1;
+    }
+    {
+        // a dump of another font, range or other sizes can not be compared
+        uint32_t header[5 + MaxSizes];
+        struct stat st;
+        uint64_t ignored = 0;
+        memset(header, 0, sizeof(header));
+        header[0] = DumpMagic;
+        header[1] = (uint32_t) first;
+        header[2] = (uint32_t) last;
+        header[3] = (uint32_t) size_count;
+        header[4] = stat(argv[optind], &st) == 0 ? (uint32_t) st.st_size : 0;
+        for (s = 0; s < size_count; ++s) {
+            header[5 + s] = (uint32_t) (sizes[s] * 64);
+        }
+        if (check(&checker, header, sizeof(header), &ignored)) {
+            fprintf(stderr, "%s was written for another font, range or other sizes\n", compare_path);
+            return 1;
+        }
+    }
+
+    memset(&sft, 0, sizeof(sft));
+    sft.font = font;
+    sft.flags = SFT_DOWNWARD_Y;
+    start = clock_ns();
+    for (r = 0; r < repeat; ++r) {
+        for (s = 0; s < size_count; ++s) {
+            sft.xScale = sizes[s];
+            sft.yScale = sizes[s];
+            for (c = first; c <= last; ++c) {
+                SFT_Glyph glyph;
+                GlyphRecord record;
+                SFT_Image image;
+                size_t bytes;
+
+                // zeroed, padding included, records are compared as bytes
+                memset(&record, 0, sizeof(record));
+                if (sft_lookup(&sft, (SFT_UChar) c, &glyph) < 0 || sft_gmetrics(&sft, glyph, &record.metrics) < 0) {
+                    continue;
+                }
+                image.width = (record.metrics.minWidth + 3) & ~3;
+                image.height = record.metrics.minHeight;
+                bytes = (size_t) image.width * image.height;
+                if (bytes > capacity) {
+                    free(pixels);
+                    if (!(pixels = malloc(bytes))) {
+                        fprintf(stderr, "out of memory\n");
+                        return 1;
+                    }
+                    capacity = bytes;
+                }
+                memset(pixels, 0, bytes);
+                image.pixels = pixels;
+                if (sft_render_arena(&sft, glyph, image, arena) < 0) {
+                    fprintf(stderr, "can not render U+%04lX at %g px\n", c, sizes[s]);
+                    continue;
+                }
+                glyphs++;
+                coverage += bytes;
+                // only the first pass is checked, the others are for timing
+                if (r == 0 && (checker.dump || checker.compare)) {
+                    record.codepoint = (uint32_t) c;
+                    record.width = image.width;
+                    record.height = image.height;
+                    check_glyph(&checker, &record, pixels);
+                }
+            }
+        }
+    }
+    elapsed = clock_ns() - start;
+
+    // kerning at the first size, through the single pair entry point
+    sft.xScale = sizes[0];
+    sft.yScale = sizes[0];
+    for (c = KernFirst; (checker.dump || checker.compare) && c <= KernLast; ++c) {
+        for (d = KernFirst; d <= KernLast; ++d) {
+            SFT_Glyph left, right;
+            SFT_Kerning kerning;
+            memset(&kerning, 0, sizeof(kerning));
+            if (sft_lookup(&sft, (SFT_UChar) c, &left) == 0 && sft_lookup(&sft, (SFT_UChar) d, &right) == 0) {
+                sft_kerning(&sft, left, right, &kerning);
+            }
+            check(&checker, &kerning, sizeof(kerning), &checker.kerning_differ);
+        }
+    }
+
+    printf("schrift %s, %llu glyphs, %llu pixels in %.3f s, %.0f ns per glyph\n", sft_version(),
+           (unsigned long long) glyphs, (unsigned long long) coverage, elapsed / 1e9,
+           glyphs ? (double) elapsed / glyphs : 0.0);
+    if (checker.compare) {
+        uint8_t extra;
+        if (!checker.broken && fread(&extra, 1, 1, checker.compare) == 1) {
+            checker.broken = 1;
+        }
+        if (checker.broken) {
+            fprintf(stderr, "%s does not match this run, different font or cut short\n", compare_path);
+            result = 1;
+        } else {
+            printf("metrics differ %llu, kerning differs %llu, pixels differ %llu of %llu, max difference %d\n",
+                   (unsigned long long) checker.metrics_differ, (unsigned long long) checker.kerning_differ,
+                   (unsigned long long) checker.pixels_differ, (unsigned long long) checker.pixels,
+                   checker.max_difference);
+            result = checker.metrics_differ || checker.kerning_differ;
+        }
+        fclose(checker.compare);
+    }
+    if (checker.dump && (fclose(checker.dump) != 0 || checker.broken)) {
+        fprintf(stderr, "can not write %s\n", dump_path);
+        result = 1;
+    }
+
+    free(pixels);
+    sft_arena_free(arena);
+    sft_freefont(font);
+    return result;
+}
@@ -0,0 +1,155 @@
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN 1
+# include <windows.h>
+#else
+# if defined(__linux__)
+#  define _GNU_SOURCE
+# else
+#  define _POSIX_C_SOURCE 200809L
+# endif
+# include <pthread.h>
+# include <sched.h>
+# include <time.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "vt2000.h"
+#include "backend.h"
+
+struct VTThread {
+    void (*run)(void *arg);
+    void *arg;
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+int backend_frame(VTBackend *backend)
+{
+    VTRect rects[BACKEND_MAX_RECTS];
+    uint32_t *pixels;
+    int stride, count, i;
+
+    pixels = backend->acquire(backend, &stride);
+    if (!pixels) {
+        return -1;
+    }
+    count = VT_Update(pixels, stride, rects, BACKEND_MAX_RECTS);
+    backend->present(backend, rects, count);
+    backend->frames++;
+    for (i = 0; i < count; ++i) {
+        backend->pixels += (uint64_t) rects[i].width * rects[i].height;
+    }
+    return count;
+}
+
+void backend_destroy(VTBackend *backend)
+{
+    if (backend) {
+        backend->destroy(backend);
+    }
+}
+
+void backend_stats(VTBackend *backend, uint64_t *frames, uint64_t *pixels)
+{
+    *frames = backend->frames;
+    *pixels = backend->pixels;
+}
+
+uint64_t backend_clock_ns(void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (!frequency.QuadPart) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t) (counter.QuadPart / frequency.QuadPart) * 1000000000u
+           + (uint64_t) (counter.QuadPart % frequency.QuadPart) * 1000000000u / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+void backend_sleep_ms(int ms)
+{
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long) (ms % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+void backend_thread_lower_priority(void)
+{
+#if defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(SCHED_IDLE)
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI thread_main(LPVOID param)
+{
+    VTThread *thread = (VTThread *) param;
+    thread->run(thread->arg);
+    return 0;
+}
+#else
+static void *thread_main(void *param)
+{
+    VTThread *thread = (VTThread *) param;
+    thread->run(thread->arg);
+    return NULL;
+}
+#endif
+
+VTThread *backend_thread_start(void (*run)(void *arg), void *arg)
+{
+    VTThread *thread = (VTThread *) VT_malloc(sizeof(VTThread));
+    if (!thread) {
+        return NULL;
+    }
+    thread->run = run;
+    thread->arg = arg;
+#if defined(_WIN32)
+    if (!(thread->handle = CreateThread(NULL, 0, thread_main, thread, 0, NULL))) {
+        VT_free(thread);
+        return NULL;
+    }
+#else
+    if (pthread_create(&thread->handle, NULL, thread_main, thread)) {
+        VT_free(thread);
+        return NULL;
+    }
+#endif
+    return thread;
+}
+
+void backend_thread_join(VTThread *thread)
+{
+    if (!thread) {
+        return;
+    }
+#if defined(_WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    VT_free(thread);
+}
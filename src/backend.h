@@ -0,0 +1,95 @@
+/**
+ * display backends and the platform services a frontend needs
+ * a backend hands out the framebuffer VT_Update draws into and presents its damaged rectangles,
+ * clock, sleep and threads hide the Win32 / POSIX differences
+ */
+
+#ifndef VT2000_BACKEND_H
+#define VT2000_BACKEND_H
+
+#include <stdint.h>
+#include "vt2000.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// damaged rectangles collected per frame, more are merged by VT_Update
+#define BACKEND_MAX_RECTS 64
+
+    typedef struct VTBackend VTBackend;
+    typedef struct VTThread VTThread;
+
+    /**
+     * a backend implementation embeds this as its first member
+     * acquire returns the 0xAARRGGBB framebuffer of the next frame, width * height pixels in rows of
+     * *stride pixels, holding the last presented frame so only damage needs drawing
+     * present hands the frame over, only the pixels inside rects changed since the last one
+     * acquire may return NULL while no buffer is free, the damage then waits for the next frame
+     */
+    struct VTBackend {
+        int width;
+        int height;
+        // counted by backend_frame, frames drawn and the pixels their damage covered
+        uint64_t frames;
+        uint64_t pixels;
+        uint32_t *(*acquire)(VTBackend *backend, int *stride);
+        void (*present)(VTBackend *backend, const VTRect *rects, int count);
+        void (*destroy)(VTBackend *backend);
+    };
+
+    /**
+     * VT_Update into a frame of the backend and present it
+     * returns the number of damaged rectangles, 0 for a frame that left the screen as it was,
+     * -1 when the backend had no buffer free, the damage is still pending then
+     */
+    int backend_frame(VTBackend *backend);
+    void backend_destroy(VTBackend *backend);
+    void backend_stats(VTBackend *backend, uint64_t *frames, uint64_t *pixels);
+
+    /**
+     * the headless backend, a framebuffer in memory and nothing on screen
+     * for benchmarks, profiling and tests on machines without a display
+     */
+    VTBackend *backend_headless_new(int width, int height);
+    // write the framebuffer as binary PPM, or PNG when path ends in .png
+    int backend_headless_snapshot(VTBackend *backend, const char *path);
+
+#if !defined(_WIN32)
+    typedef struct VTShmView VTShmView;
+
+    /**
+     * the shared memory backend for a display in another process
+     * 2 or 3 frames live in one sealed memfd (unlinked POSIX shm where there is none), every presented
+     * frame is announced with its damage over a socketpair, so the consumer reads or copies nothing
+     * but the changed pixels, the consumer hands a frame back once it is done with it
+     * *peer receives the consumer's end of the socket, pass it on to the consumer process
+     */
+    VTBackend *backend_shm_new(int width, int height, int buffers, int *peer);
+
+    // the consumer side, maps the frames of the producer on the other end of fd, fd is taken over
+    VTShmView *backend_shm_attach(int fd, int *width, int *height);
+    /**
+     * wait up to timeout_ms (-1 forever) for the next frame, the previous one is released first
+     * rects has room for BACKEND_MAX_RECTS, the pixels inside them changed since the previous frame
+     * returns the number of rectangles, 0 on timeout, -1 once the producer is gone
+     */
+    int backend_shm_next(VTShmView *view, int timeout_ms, const uint32_t **pixels, int *stride, VTRect *rects);
+    // done with the current frame before the next one arrives, e.g. after copying its damage
+    void backend_shm_release(VTShmView *view);
+    void backend_shm_detach(VTShmView *view);
+#endif
+
+    // monotonic time in nanoseconds
+    uint64_t backend_clock_ns(void);
+    void backend_sleep_ms(int ms);
+    VTThread *backend_thread_start(void (*run)(void *arg), void *arg);
+    // the calling thread only runs when nothing else wants the CPU, where the platform allows it
+    void backend_thread_lower_priority(void);
+    // wait for the thread to return and release it
+    void backend_thread_join(VTThread *thread);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //VT2000_BACKEND_H
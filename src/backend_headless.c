@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vt2000.h"
+#include "backend.h"
+
+// PNG IDAT data goes out as stored deflate blocks of at most this many bytes
+#define PNG_STORED_BLOCK 65535
+
+typedef struct {
+    VTBackend base;
+    uint32_t *pixels;
+} HeadlessBackend;
+
+static uint32_t *headless_acquire(VTBackend *backend, int *stride)
+{
+    *stride = backend->width;
+    return ((HeadlessBackend *) backend)->pixels;
+}
+
+// nothing to show, the pixels stay where they were drawn
+static void headless_present(VTBackend *backend, const VTRect *rects, int count)
+{
+    (void) backend;
+    (void) rects;
+    (void) count;
+}
+
+static void headless_destroy(VTBackend *backend)
+{
+    VT_free(((HeadlessBackend *) backend)->pixels);
+    VT_free(backend);
+}
+
+VTBackend *backend_headless_new(int width, int height)
+{
+    HeadlessBackend *headless;
+
+    if (width <= 0 || height <= 0) {
+        return NULL;
+    }
+    if (!(headless = (HeadlessBackend *) VT_malloc(sizeof(HeadlessBackend)))) {
+        return NULL;
+    }
+    memset(headless, 0, sizeof(HeadlessBackend));
+    if (!(headless->pixels = (uint32_t *) VT_malloc((size_t) width * height * sizeof(uint32_t)))) {
+        VT_free(headless);
+        return NULL;
+    }
+    memset(headless->pixels, 0, (size_t) width * height * sizeof(uint32_t));
+    headless->base.width = width;
+    headless->base.height = height;
+    headless->base.acquire = headless_acquire;
+    headless->base.present = headless_present;
+    headless->base.destroy = headless_destroy;
+    return &headless->base;
+}
+
+// one row as packed RGB
+static void row_rgb(const uint32_t *src, uint8_t *dst, int width)
+{
+    int x;
+    for (x = 0; x < width; ++x) {
+        uint32_t pixel = src[x];
+        dst[3 * x] = (uint8_t) (pixel >> 16);
+        dst[3 * x + 1] = (uint8_t) (pixel >> 8);
+        dst[3 * x + 2] = (uint8_t) pixel;
+    }
+}
+
+static int write_ppm(FILE *f, const uint32_t *pixels, int width, int height)
+{
+    uint8_t *row = (uint8_t *) VT_malloc((size_t) width * 3);
+    int y, ok;
+
+    if (!row) {
+        return -1;
+    }
+    ok = fprintf(f, "P6\n%d %d\n255\n", width, height) > 0;
+    for (y = 0; ok && y < height; ++y) {
+        row_rgb(pixels + (size_t) y * width, row, width);
+        ok = fwrite(row, 3, width, f) == (size_t) width;
+    }
+    VT_free(row);
+    return ok ? 0 : -1;
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size)
+{
+    static uint32_t table[256];
+    size_t i;
+
+    if (!table[1]) {
+        uint32_t n, k, c;
+        for (n = 0; n < 256; ++n) {
+            c = n;
+            for (k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_be32(uint8_t *dst, uint32_t value)
+{
+    dst[0] = (uint8_t) (value >> 24);
+    dst[1] = (uint8_t) (value >> 16);
+    dst[2] = (uint8_t) (value >> 8);
+    dst[3] = (uint8_t) value;
+}
+
+static int write_chunk(FILE *f, const char *type, const uint8_t *data, size_t size)
+{
+    uint8_t header[8];
+    uint8_t trailer[4];
+    uint32_t crc;
+
+    put_be32(header, (uint32_t) size);
+    memcpy(header + 4, type, 4);
+    crc = crc32_update(0, header + 4, 4);
+    crc = crc32_update(crc, data, size);
+    put_be32(trailer, crc);
+    if (fwrite(header, 1, 8, f) != 8 || (size && fwrite(data, 1, size, f) != size)
+        || fwrite(trailer, 1, 4, f) != 4) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 8-bit RGB PNG, the image data is a zlib stream of stored (uncompressed) deflate blocks,
+ * a snapshot is for looking at, not for keeping small
+ */
+static int write_png(FILE *f, const uint32_t *pixels, int width, int height)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    size_t row_size = (size_t) width * 3 + 1;
+    size_t raw_size = row_size * height;
+    size_t blocks = (raw_size + PNG_STORED_BLOCK - 1) / PNG_STORED_BLOCK;
+    size_t idat_size = 2 + raw_size + 5 * blocks + 4;
+    uint8_t *raw = (uint8_t *) VT_malloc(raw_size);
+    uint8_t *idat = (uint8_t *) VT_malloc(idat_size);
+    uint8_t ihdr[13];
+    uint32_t a = 1, b = 0;
+    size_t i, done, out;
+    int y, result = -1;
+
+    if (!raw || !idat) {
+        goto end;
+    }
+    for (y = 0; y < height; ++y) {
+        // filter type 0, the row as is
+        raw[row_size * y] = 0;
+        row_rgb(pixels + (size_t) y * width, raw + row_size * y + 1, width);
+    }
+
+    // zlib header: deflate, 32K window, no preset dictionary, fastest
+    idat[0] = 0x78;
+    idat[1] = 0x01;
+    out = 2;
+    for (done = 0; done < raw_size; done += PNG_STORED_BLOCK) {
+        size_t size = raw_size - done < PNG_STORED_BLOCK ? raw_size - done : PNG_STORED_BLOCK;
+        idat[out] = (uint8_t) (done + size == raw_size);
+        idat[out + 1] = (uint8_t) size;
+        idat[out + 2] = (uint8_t) (size >> 8);
+        idat[out + 3] = (uint8_t) ~size;
+        idat[out + 4] = (uint8_t) (~size >> 8);
+        memcpy(idat + out + 5, raw + done, size);
+        out += 5 + size;
+    }
+    // Adler-32 of the raw data, reduced often enough not to overflow
+    for (done = 0; done < raw_size; done += 5552) {
+        size_t end = raw_size - done < 5552 ? raw_size : done + 5552;
+        for (i = done; i < end; ++i) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    put_be32(idat + out, b << 16 | a);
+
+    put_be32(ihdr, (uint32_t) width);
+    put_be32(ihdr + 4, (uint32_t) height);
+    // 8 bits per channel, RGB, deflate, adaptive filtering, no interlace
+    ihdr[8] = 8;
+    ihdr[9] = 2;
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    if (fwrite(signature, 1, 8, f) == 8 && write_chunk(f, "IHDR", ihdr, 13) == 0
+        && write_chunk(f, "IDAT", idat, idat_size) == 0 && write_chunk(f, "IEND", NULL, 0) == 0) {
+        result = 0;
+    }
+
+end:
+    VT_free(raw);
+    VT_free(idat);
+    return result;
+}
+
+int backend_headless_snapshot(VTBackend *backend, const char *path)
+{
+    HeadlessBackend *headless = (HeadlessBackend *) backend;
+    size_t length = strlen(path);
+    FILE *f;
+    int result;
+
+    if (!(f = fopen(path, "wb"))) {
+        return -1;
+    }
+    if (length >= 4 && strcmp(path + length - 4, ".png") == 0) {
+        result = write_png(f, headless->pixels, backend->width, backend->height);
+    } else {
+        result = write_ppm(f, headless->pixels, backend->width, backend->height);
+    }
+    if (fclose(f) != 0) {
+        result = -1;
+    }
+    return result;
+}
@@ -0,0 +1,471 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "vt2000.h"
+#include "backend.h"
+
+#define SHM_MAGIC 0x30325456u
+#define SHM_MAX_BUFFERS 3
+// a buffer starts on a page of its own
+#define SHM_ALIGN 4096
+// rectangles a buffer may fall behind the newest frame by before they are merged into one
+#define SHM_STALE_RECTS 64
+
+/**
+ * the wire protocol, SOCK_SEQPACKET keeps the messages apart
+ * producer -> consumer: ShmHello once, the memfd attached, then a ShmFrame per presented frame
+ * consumer -> producer: ShmRelease when it no longer reads a buffer
+ * both ends run on the same machine, the structs go over as they are
+ */
+typedef struct {
+    uint32_t magic;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    int32_t buffers;
+    uint64_t size;
+    uint64_t offsets[SHM_MAX_BUFFERS];
+} ShmHello;
+
+typedef struct {
+    uint32_t buffer;
+    uint32_t count;
+    uint64_t sequence;
+    VTRect rects[BACKEND_MAX_RECTS];
+} ShmFrame;
+
+typedef struct {
+    uint32_t buffer;
+} ShmRelease;
+
+typedef struct {
+    uint32_t *pixels;
+    // the consumer has been told about it and not handed it back yet
+    int busy;
+    // damage presented since this buffer last held the newest frame
+    VTRect stale[SHM_STALE_RECTS];
+    int stale_count;
+} ShmBuffer;
+
+typedef struct {
+    VTBackend base;
+    int socket;
+    int stride;
+    uint8_t *memory;
+    size_t size;
+    int count;
+    ShmBuffer buffers[SHM_MAX_BUFFERS];
+    // buffer holding the newest presented frame, -1 before the first one
+    int front;
+    // buffer handed out by the last acquire
+    int back;
+    uint64_t sequence;
+} ShmBackend;
+
+struct VTShmView {
+    int socket;
+    int width;
+    int height;
+    int stride;
+    uint8_t *memory;
+    size_t size;
+    int buffers;
+    uint64_t offsets[SHM_MAX_BUFFERS];
+    // buffer of the current frame, -1 once it is released
+    int current;
+};
+
+static void rect_union(VTRect *a, const VTRect *b)
+{
+    int right = a->x + a->width > b->x + b->width ? a->x + a->width : b->x + b->width;
+    int bottom = a->y + a->height > b->y + b->height ? a->y + a->height : b->y + b->height;
+    a->x = a->x < b->x ? a->x : b->x;
+    a->y = a->y < b->y ? a->y : b->y;
+    a->width = right - a->x;
+    a->height = bottom - a->y;
+}
+
+static void copy_rect(uint32_t *dst, const uint32_t *src, int stride, const VTRect *rect)
+{
+    size_t offset = (size_t) rect->y * stride + rect->x;
+    int y;
+    for (y = 0; y < rect->height; ++y, offset += stride) {
+        memcpy(dst + offset, src + offset, rect->width * sizeof(uint32_t));
+    }
+}
+
+/**
+ * anonymous shared memory of size bytes, a memfd sealed against resizing where there is one,
+ * so the consumer can not be tricked into touching pages past the end
+ */
+static int create_memory(size_t size)
+{
+    int fd;
+#if defined(MFD_ALLOW_SEALING)
+    fd = memfd_create("vt2000-framebuffer", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd >= 0) {
+        if (ftruncate(fd, (off_t) size) < 0) {
+            close(fd);
+            return -1;
+        }
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+        return fd;
+    }
+#endif
+    {
+        char name[64];
+        int attempt;
+        for (attempt = 0, fd = -1; fd < 0 && attempt < 16; ++attempt) {
+            snprintf(name, sizeof(name), "/vt2000-%ld-%lx", (long) getpid(),
+                     (unsigned long) backend_clock_ns() + attempt);
+            fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        }
+        if (fd < 0) {
+            return -1;
+        }
+        shm_unlink(name);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    if (ftruncate(fd, (off_t) size) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_hello(int socket, int memory, const ShmHello *hello)
+{
+    union {
+        struct cmsghdr header;
+        char data[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov;
+    struct msghdr message;
+    struct cmsghdr *cmsg;
+
+    memset(&control, 0, sizeof(control));
+    memset(&message, 0, sizeof(message));
+    iov.iov_base = (void *) hello;
+    iov.iov_len = sizeof(ShmHello);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data;
+    message.msg_controllen = sizeof(control.data);
+    cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &memory, sizeof(int));
+    return sendmsg(socket, &message, MSG_NOSIGNAL) == (ssize_t) sizeof(ShmHello) ? 0 : -1;
+}
+
+// hand back the buffers the consumer is done with, never blocks
+static void shm_collect(ShmBackend *shm)
+{
+    ShmRelease release;
+    while (recv(shm->socket, &release, sizeof(release), MSG_DONTWAIT) == (ssize_t) sizeof(release)) {
+        if (release.buffer < (uint32_t) shm->count) {
+            shm->buffers[release.buffer].busy = 0;
+        }
+    }
+}
+
+/**
+ * the front buffer when the consumer already let go of it, it needs no catching up,
+ * otherwise a free one, brought up to the newest frame by copying the damage it missed,
+ * NULL when the consumer holds them all
+ */
+static uint32_t *shm_acquire(VTBackend *backend, int *stride)
+{
+    ShmBackend *shm = (ShmBackend *) backend;
+    ShmBuffer *buffer;
+    int i, pick = -1;
+
+    shm_collect(shm);
+    if (shm->front >= 0 && !shm->buffers[shm->front].busy) {
+        pick = shm->front;
+    } else {
+        for (i = 0; i < shm->count && pick < 0; ++i) {
+            if (!shm->buffers[i].busy) {
+                pick = i;
+            }
+        }
+    }
+    if (pick < 0) {
+        return NULL;
+    }
+
+    buffer = &shm->buffers[pick];
+    for (i = 0; i < buffer->stale_count; ++i) {
+        copy_rect(buffer->pixels, shm->buffers[shm->front].pixels, shm->stride, &buffer->stale[i]);
+    }
+    buffer->stale_count = 0;
+    shm->back = pick;
+    *stride = shm->stride;
+    return buffer->pixels;
+}
+
+static void shm_present(VTBackend *backend, const VTRect *rects, int count)
+{
+    ShmBackend *shm = (ShmBackend *) backend;
+    ShmFrame frame;
+    int i, j;
+
+    // an unchanged frame, the buffer still equals the front and stays free
+    if (count <= 0 || shm->back < 0) {
+        return;
+    }
+    frame.count = (uint32_t) (count < BACKEND_MAX_RECTS ? count : BACKEND_MAX_RECTS);
+    memcpy(frame.rects, rects, frame.count * sizeof(VTRect));
+    for (i = BACKEND_MAX_RECTS; i < count; ++i) {
+        rect_union(&frame.rects[BACKEND_MAX_RECTS - 1], &rects[i]);
+    }
+
+    // every other buffer now misses this damage
+    for (i = 0; i < shm->count; ++i) {
+        ShmBuffer *buffer = &shm->buffers[i];
+        if (i == shm->back) {
+            continue;
+        }
+        for (j = 0; j < count; ++j) {
+            if (buffer->stale_count < SHM_STALE_RECTS) {
+                buffer->stale[buffer->stale_count++] = rects[j];
+            } else {
+                rect_union(&buffer->stale[SHM_STALE_RECTS - 1], &rects[j]);
+            }
+        }
+    }
+
+    frame.buffer = (uint32_t) shm->back;
+    frame.sequence = ++shm->sequence;
+    shm->front = shm->back;
+    shm->back = -1;
+    // a consumer that went away can not hold buffers, keep drawing as if it took the frame
+    if (send(shm->socket, &frame, offsetof(ShmFrame, rects) + frame.count * sizeof(VTRect), MSG_NOSIGNAL) > 0) {
+        shm->buffers[shm->front].busy = 1;
+    }
+}
+
+static void shm_destroy(VTBackend *backend)
+{
+    ShmBackend *shm = (ShmBackend *) backend;
+    munmap(shm->memory, shm->size);
+    close(shm->socket);
+    VT_free(shm);
+}
+
+VTBackend *backend_shm_new(int width, int height, int buffers, int *peer)
+{
+    ShmBackend *shm;
+    ShmHello hello;
+    size_t frame_size;
+    int sockets[2], memory, i;
+
+    if (width <= 0 || height <= 0 || buffers < 2 || buffers > SHM_MAX_BUFFERS) {
+        return NULL;
+    }
+    if (!(shm = (ShmBackend *) VT_malloc(sizeof(ShmBackend)))) {
+        return NULL;
+    }
+    memset(shm, 0, sizeof(ShmBackend));
+    shm->stride = width;
+    shm->count = buffers;
+    shm->front = -1;
+    shm->back = -1;
+    frame_size = ((size_t) width * height * sizeof(uint32_t) + SHM_ALIGN - 1) & ~(size_t) (SHM_ALIGN - 1);
+    shm->size = frame_size * buffers;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) < 0) {
+        VT_free(shm);
+        return NULL;
+    }
+    if ((memory = create_memory(shm->size)) < 0) {
+        goto fail;
+    }
+    shm->memory = (uint8_t *) mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+    if (shm->memory == MAP_FAILED) {
+        shm->memory = NULL;
+        close(memory);
+        goto fail;
+    }
+
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = SHM_MAGIC;
+    hello.width = width;
+    hello.height = height;
+    hello.stride = width;
+    hello.buffers = buffers;
+    hello.size = shm->size;
+    for (i = 0; i < buffers; ++i) {
+        hello.offsets[i] = frame_size * i;
+        shm->buffers[i].pixels = (uint32_t *) (shm->memory + hello.offsets[i]);
+    }
+    // the socket buffers the message and the descriptor until the consumer reads them
+    if (send_hello(sockets[0], memory, &hello) < 0) {
+        close(memory);
+        goto fail;
+    }
+    close(memory);
+
+    shm->socket = sockets[0];
+    shm->base.width = width;
+    shm->base.height = height;
+    shm->base.acquire = shm_acquire;
+    shm->base.present = shm_present;
+    shm->base.destroy = shm_destroy;
+    *peer = sockets[1];
+    return &shm->base;
+
+fail:
+    if (shm->memory) {
+        munmap(shm->memory, shm->size);
+    }
+    close(sockets[0]);
+    close(sockets[1]);
+    VT_free(shm);
+    return NULL;
+}
+
+VTShmView *backend_shm_attach(int fd, int *width, int *height)
+{
+    union {
+        struct cmsghdr header;
+        char data[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov;
+    struct msghdr message;
+    struct cmsghdr *cmsg;
+    struct stat st;
+    ShmHello hello;
+    VTShmView *view;
+    int memory = -1, i;
+    size_t frame_size;
+
+    memset(&message, 0, sizeof(message));
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data;
+    message.msg_controllen = sizeof(control.data);
+    if (recvmsg(fd, &message, MSG_CMSG_CLOEXEC) != (ssize_t) sizeof(hello)) {
+        close(fd);
+        return NULL;
+    }
+    for (cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(&memory, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    // trust nothing the other process says about the memory before checking it
+    frame_size = (size_t) hello.stride * hello.height * sizeof(uint32_t);
+    if (memory < 0 || hello.magic != SHM_MAGIC || hello.width <= 0 || hello.height <= 0
+        || hello.stride < hello.width || hello.buffers < 1 || hello.buffers > SHM_MAX_BUFFERS
+        || fstat(memory, &st) < 0 || (uint64_t) st.st_size < hello.size) {
+        goto fail;
+    }
+    for (i = 0; i < hello.buffers; ++i) {
+        if (hello.offsets[i] > hello.size || hello.size - hello.offsets[i] < frame_size) {
+            goto fail;
+        }
+    }
+    if (!(view = (VTShmView *) VT_malloc(sizeof(VTShmView)))) {
+        goto fail;
+    }
+    memset(view, 0, sizeof(VTShmView));
+    view->memory = (uint8_t *) mmap(NULL, hello.size, PROT_READ, MAP_SHARED, memory, 0);
+    if (view->memory == MAP_FAILED) {
+        VT_free(view);
+        goto fail;
+    }
+    close(memory);
+    view->socket = fd;
+    view->width = hello.width;
+    view->height = hello.height;
+    view->stride = hello.stride;
+    view->size = hello.size;
+    view->buffers = hello.buffers;
+    memcpy(view->offsets, hello.offsets, sizeof(view->offsets));
+    view->current = -1;
+    *width = hello.width;
+    *height = hello.height;
+    return view;
+
+fail:
+    if (memory >= 0) {
+        close(memory);
+    }
+    close(fd);
+    return NULL;
+}
+
+void backend_shm_release(VTShmView *view)
+{
+    ShmRelease release;
+    if (view->current < 0) {
+        return;
+    }
+    release.buffer = (uint32_t) view->current;
+    send(view->socket, &release, sizeof(release), MSG_NOSIGNAL);
+    view->current = -1;
+}
+
+int backend_shm_next(VTShmView *view, int timeout_ms, const uint32_t **pixels, int *stride, VTRect *rects)
+{
+    struct pollfd pfd;
+    ShmFrame frame;
+    ssize_t size;
+    int result, i, count = 0;
+
+    backend_shm_release(view);
+    pfd.fd = view->socket;
+    pfd.events = POLLIN;
+    do {
+        result = poll(&pfd, 1, timeout_ms);
+    } while (result < 0 && errno == EINTR);
+    if (result <= 0) {
+        return result;
+    }
+    size = recv(view->socket, &frame, sizeof(frame), 0);
+    if (size < (ssize_t) offsetof(ShmFrame, rects) || frame.buffer >= (uint32_t) view->buffers
+        || frame.count > BACKEND_MAX_RECTS
+        || (size_t) size != offsetof(ShmFrame, rects) + frame.count * sizeof(VTRect)) {
+        return -1;
+    }
+    view->current = (int) frame.buffer;
+    *pixels = (const uint32_t *) (view->memory + view->offsets[frame.buffer]);
+    *stride = view->stride;
+    // clipped to the frame, a rectangle never reaches past the mapping
+    for (i = 0; i < (int) frame.count; ++i) {
+        VTRect rect = frame.rects[i];
+        if (rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0
+            || rect.x >= view->width || rect.y >= view->height) {
+            continue;
+        }
+        rect.width = rect.width < view->width - rect.x ? rect.width : view->width - rect.x;
+        rect.height = rect.height < view->height - rect.y ? rect.height : view->height - rect.y;
+        rects[count++] = rect;
+    }
+    return count;
+}
+
+void backend_shm_detach(VTShmView *view)
+{
+    if (!view) {
+        return;
+    }
+    munmap(view->memory, view->size);
+    close(view->socket);
+    VT_free(view);
+}
@@ -0,0 +1,115 @@
+/**
+ * big-endian decoding of font data
+ * single loads from unaligned pointers, and bulk decoders that byte swap whole arrays
+ * (cmap segment arrays, loca, hmtx) with SSE2 when available
+ * header only, shared by font.c and schrift.c
+ */
+
+#ifndef VT2000_BEDECODE_H
+#define VT2000_BEDECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BE_DECODE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#define BE_BSWAP16(x) _byteswap_ushort(x)
+#define BE_BSWAP32(x) _byteswap_ulong(x)
+#elif defined(__GNUC__)
+#define BE_BSWAP16(x) __builtin_bswap16(x)
+#define BE_BSWAP32(x) __builtin_bswap32(x)
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define BE_NATIVE 1
+#endif
+
+static inline uint16_t be_load16(const uint8_t *src)
+{
+#if defined(BE_NATIVE) || defined(BE_BSWAP16)
+    uint16_t value;
+    memcpy(&value, src, sizeof(value));
+#ifdef BE_NATIVE
+    return value;
+#else
+    return BE_BSWAP16(value);
+#endif
+#else
+    return (uint16_t) (src[0] << 8 | src[1]);
+#endif
+}
+
+static inline uint32_t be_load32(const uint8_t *src)
+{
+#if defined(BE_NATIVE) || defined(BE_BSWAP32)
+    uint32_t value;
+    memcpy(&value, src, sizeof(value));
+#ifdef BE_NATIVE
+    return value;
+#else
+    return BE_BSWAP32(value);
+#endif
+#else
+    return (uint32_t) src[0] << 24 | (uint32_t) src[1] << 16 | (uint32_t) src[2] << 8 | src[3];
+#endif
+}
+
+// dst[i] = the i-th big-endian uint16 of src, src needs no alignment
+static inline void be_decode16(uint16_t *dst, const uint8_t *src, size_t count)
+{
+    size_t i = 0;
+#ifdef BE_DECODE_SSE2
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + 2 * i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *) (dst + i), v);
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = be_load16(src + 2 * i);
+    }
+}
+
+// dst[i] = the i-th big-endian uint32 of src, src needs no alignment
+static inline void be_decode32(uint32_t *dst, const uint8_t *src, size_t count)
+{
+    size_t i = 0;
+#ifdef BE_DECODE_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + 4 * i));
+        // swap the bytes of each half, then the halves of each word
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i *) (dst + i), v);
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = be_load32(src + 4 * i);
+    }
+}
+
+// dst[i] = first + i, wrapping at 16 bits like cmap idDelta arithmetic
+static inline void be_fill_seq16(uint16_t *dst, uint16_t first, size_t count)
+{
+    size_t i = 0;
+#ifdef BE_DECODE_SSE2
+    __m128i seq = _mm_add_epi16(_mm_set1_epi16((short) first), _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7));
+    const __m128i step = _mm_set1_epi16(8);
+    for (; i + 8 <= count; i += 8) {
+        _mm_storeu_si128((__m128i *) (dst + i), seq);
+        seq = _mm_add_epi16(seq, step);
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = (uint16_t) (first + i);
+    }
+}
+
+#endif //VT2000_BEDECODE_H
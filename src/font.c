@@ -1,18 +1,50 @@
+#if defined(_WIN32)
+# define WIN32_LEAN_AND_MEAN 1
+# include <windows.h>
+#else
+# define _POSIX_C_SOURCE 200809L
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include "vt2000.h"
 #include "font.h"
+#include "bedecode.h"
+
+#define FONT_DEFAULT_SIZE 16
 
-#define UCS_PLANE_RANGE 65536
+#define UCS_CODEPOINT_MAX 0x10FFFF
+#define UCS_PAGE_SHIFT 8
+#define UCS_PAGE_SIZE (1 << UCS_PAGE_SHIFT)
+#define UCS_PAGE_MASK (UCS_PAGE_SIZE - 1)
+// 17 planes * 256 pages
+#define UCS_PAGE_COUNT ((UCS_CODEPOINT_MAX + 1) >> UCS_PAGE_SHIFT)
 
+/**
+ * code point -> glyph index, two level
+ * page_map[codepoint >> 8] selects a 256 entries page, slot 0 is a shared empty page,
+ * so unmapped ranges cost 2 bytes per page instead of a whole page
+ */
 typedef struct {
-    uint16_t plane1[UCS_PLANE_RANGE];
+    uint16_t page_map[UCS_PAGE_COUNT];
+    uint16_t (*pages)[UCS_PAGE_SIZE];
+    uint16_t num_pages;
+    uint16_t cap_pages;
 } TTFontTableGLYFIndex;
 
 typedef struct {
     uint16_t indexToLocFormat;
     uint16_t numGlyphs;
+    uint16_t unitsPerEm;
+    uint16_t numLongHmtx;
+    uint16_t numKernPairs;
+    // first pair of the horizontal format 0 kern subtable
+    uint32_t kernPairs;
 } TTFontTableInfo;
 
 typedef struct {
@@ -24,14 +56,71 @@ typedef struct {
     TTFontTable cmap;
     TTFontTable glyf;
     TTFontTable head;
+    TTFontTable hhea;
     TTFontTable hmtx;
+    TTFontTable kern;
     TTFontTable loca;
     TTFontTable maxp;
 } TTFontTables;
 
+/**
+ * edge crossing of a pixel center row, for the mono rasterizer
+ * x in 24.8, winding +1 for edges going down, -1 going up
+ */
+typedef struct {
+    int32_t x;
+    int32_t row;
+    int32_t winding;
+} TTFontCrossing;
+
+/**
+ * reusable glyph decode and raster scratch, only grows
+ * points are (x, y) pairs in 24.8 fixed pixel coordinates, y down
+ * accum holds signed area deltas, full coverage is FONT_RASTER_ONE
+ * in mono mode the edges only record crossings, row_crossings is (x << 1 | winding > 0) grouped by row
+ */
+struct TTFontGLYFContext {
+    int32_t *points;
+    uint8_t *flags;
+    uint16_t *end_pts;
+    int32_t *accum;
+    TTFontCrossing *crossings;
+    int32_t *row_crossings;
+    uint32_t *row_starts;
+    uint32_t cap_points;
+    uint32_t cap_flags;
+    uint32_t cap_contours;
+    uint32_t cap_accum;
+    uint32_t cap_crossings;
+    uint32_t cap_row_crossings;
+    uint32_t cap_row_starts;
+    uint32_t num_crossings;
+    int32_t width;
+    int32_t height;
+    int mono;
+    // set when the mono rasterizer could not grow crossings
+    int failed;
+};
+
+/**
+ * affine transform, x' = a * x + c * y + e, y' = b * x + d * y + f
+ * a b c d in 16.16, e f in output units
+ */
 typedef struct {
+    int64_t a, b, c, d;
+    int64_t e, f;
+} TTFontTransform;
 
-} TTFontGLYFContext;
+/**
+ * mapped index cache file, glyf_index.pages points into it
+ */
+typedef struct {
+    void *memory;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE mapping;
+#endif
+} TTFontCacheMapping;
 
 struct TTFont{
     uint16_t font_size;
@@ -41,12 +130,157 @@ struct TTFont{
     TTFontTableGLYFIndex glyf_index;
     TTFontTableInfo info;
     TTFontGLYFContext glyf_context;
+    TTFontCacheMapping cache;
+};
+
+/**
+ * ordered fallback chain, every code point resolved once at build time to the first face mapping it
+ * pages hold (face << 16) | glyph, same two level layout as TTFontTableGLYFIndex
+ */
+struct TTFontSet {
+    TTFont *faces[FONT_SET_MAX_FACES];
+    uint16_t num_faces;
+    uint16_t num_pages;
+    uint16_t page_map[UCS_PAGE_COUNT];
+    uint32_t (*pages)[UCS_PAGE_SIZE];
 };
 
+/**
+ * index cache file layout, native byte order
+ * | TTFontCacheHeader | TTFontCacheData | pages[num_pages][UCS_PAGE_SIZE] |
+ * checksum covers everything after the header.
+ * only fonts that passed validation are stored, a hit skips parsing and validation
+ * bump FONT_CACHE_VERSION whenever TTFontTables, TTFontTableInfo or the index layout change
+ */
+#define FONT_CACHE_MAGIC 0x43465456 // "VTFC"
+#define FONT_CACHE_VERSION 4
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t font_hash;
+    uint64_t font_size;
+    uint64_t checksum;
+    uint64_t payload_size;
+} TTFontCacheHeader;
+
+typedef struct {
+    TTFontTables tables;
+    TTFontTableInfo info;
+    uint32_t num_pages;
+    uint16_t page_map[UCS_PAGE_COUNT];
+} TTFontCacheData;
+
 static int cmap_format0(TTFont *font, uint32_t offset);
 static int cmap_format4(TTFont *font, uint32_t offset);
 static int cmap_format6(TTFont *font, uint32_t offset);
 static int cmap_format12(TTFont *font, uint32_t offset);
+static int cmap_validate(const TTFont *font, uint32_t offset, uint16_t format);
+static int tables_validate(const TTFont *font);
+static int glyf_validate(const TTFont *font);
+static int glyph_metrics(TTFont *font, uint16_t glyph, uint16_t size, TTFontGlyphMetrics *metrics);
+static int glyph_render(TTFont *font, TTFontGLYFContext *ctx, uint16_t glyph, uint16_t size, uint8_t *pixels, int stride);
+static int glyph_render_mono(TTFont *font, TTFontGLYFContext *ctx, uint16_t glyph, uint16_t size, uint8_t *bits, int stride);
+static void glyf_context_free(TTFontGLYFContext *ctx);
+
+static inline uint16_t glyf_index_get(const TTFontTableGLYFIndex *index, uint32_t codepoint)
+{
+    if (codepoint > UCS_CODEPOINT_MAX) {
+        return 0;
+    }
+    return index->pages[index->page_map[codepoint >> UCS_PAGE_SHIFT]][codepoint & UCS_PAGE_MASK];
+}
+
+static int glyf_index_init(TTFontTableGLYFIndex *index)
+{
+    memset(index->page_map, 0, sizeof(index->page_map));
+    index->cap_pages = 16;
+    if (!(index->pages = VT_malloc(sizeof(*index->pages) * index->cap_pages))) {
+        return -1;
+    }
+    // slot 0, the empty page
+    memset(index->pages[0], 0, sizeof(*index->pages));
+    index->num_pages = 1;
+    return 0;
+}
+
+static void glyf_index_free(TTFontTableGLYFIndex *index)
+{
+    // cap_pages 0 means pages borrowed from the mapped cache file
+    if (index->cap_pages) {
+        VT_free(index->pages);
+    }
+    index->pages = NULL;
+    index->num_pages = 0;
+    index->cap_pages = 0;
+}
+
+static int glyf_index_set(TTFontTableGLYFIndex *index, uint32_t codepoint, uint16_t glyph)
+{
+    void *mem;
+    uint16_t slot;
+    uint32_t page = codepoint >> UCS_PAGE_SHIFT;
+    if (codepoint > UCS_CODEPOINT_MAX || glyph == 0) {
+        return 0;
+    }
+    if (!(slot = index->page_map[page])) {
+        if (index->num_pages >= index->cap_pages) {
+            // at most UCS_PAGE_COUNT + 1 slots, always fits in uint16_t
+            if (!(mem = VT_realloc(index->pages, sizeof(*index->pages) * index->cap_pages * 2))) {
+                return -1;
+            }
+            index->pages = mem;
+            index->cap_pages *= 2;
+        }
+        slot = index->num_pages++;
+        memset(index->pages[slot], 0, sizeof(*index->pages));
+        index->page_map[page] = slot;
+    }
+    index->pages[slot][codepoint & UCS_PAGE_MASK] = glyph;
+    return 0;
+}
+
+/**
+ * glyf_index_set over count code points mapped to consecutive glyphs (wrapping at 16 bits),
+ * filled a page slice at a time
+ */
+static int glyf_index_set_range(TTFontTableGLYFIndex *index, uint32_t codepoint, uint32_t count, uint16_t glyph)
+{
+    uint32_t n;
+    uint16_t slot;
+    if (codepoint > UCS_CODEPOINT_MAX) {
+        return 0;
+    }
+    if (count > UCS_CODEPOINT_MAX + 1 - codepoint) {
+        count = UCS_CODEPOINT_MAX + 1 - codepoint;
+    }
+    while (count) {
+        // glyph 0 is never stored, skip the entry where the ids wrap around
+        if (!glyph) {
+            codepoint++;
+            glyph++;
+            count--;
+            continue;
+        }
+        n = UCS_PAGE_SIZE - (codepoint & UCS_PAGE_MASK);
+        if (n > count) {
+            n = count;
+        }
+        if (n > 0x10000U - glyph) {
+            n = 0x10000U - glyph;
+        }
+        // allocates the page if needed
+        if (glyf_index_set(index, codepoint, glyph) < 0) {
+            return -1;
+        }
+        slot = index->page_map[codepoint >> UCS_PAGE_SHIFT];
+        be_fill_seq16(index->pages[slot] + (codepoint & UCS_PAGE_MASK), glyph, n);
+        codepoint += n;
+        glyph = (uint16_t) (glyph + n);
+        count -= n;
+    }
+    return 0;
+}
 
 static inline uint8_t get_uint8(const TTFont* font, uint32_t offset)
 {
@@ -55,9 +289,7 @@ static inline uint8_t get_uint8(const TTFont* font, uint32_t offset)
 
 static inline uint16_t get_uint16(const TTFont* font, uint32_t offset)
 {
-    const uint8_t *rebase = font->ttf_bytes + offset;
-    uint16_t b1 = rebase[0], b0 = rebase[1];
-    return (uint16_t) (b1 << 8 | b0);
+    return be_load16(font->ttf_bytes + offset);
 }
 
 static inline int16_t get_int16(const TTFont* font, uint32_t offset)
@@ -67,9 +299,7 @@ static inline int16_t get_int16(const TTFont* font, uint32_t offset)
 
 static inline uint32_t get_uint32(const TTFont* font, uint32_t offset)
 {
-    const uint8_t *rebase = font->ttf_bytes + offset;
-    uint32_t b3 = rebase[0], b2 = rebase[1], b1 = rebase[2], b0 = rebase[3];
-    return (uint32_t) (b3 << 24 | b2 << 16 | b1 << 8 | b0);
+    return be_load32(font->ttf_bytes + offset);
 }
 
 /**
@@ -91,11 +321,18 @@ int cmap_init(TTFont *font) {
     uint16_t  format[3] = {0, 0, 0};
     // skip uint16 version
     num = get_uint16(font, font->tables.cmap.offset + 2);
+    if (4 + 8 * (uint32_t) num > font->tables.cmap.length) {
+        return -1;
+    }
     // read all subTable
     for (i = 0; i < num; ++i) {
         entry = font->tables.cmap.offset + 4 + i * 8;
         category = get_uint32(font, entry);
 //        DebugPrintf("read cmap %x\n", category)
+        // a subtable must at least hold its format
+        if (get_uint32(font, entry + 4) > font->tables.cmap.length - 2) {
+            continue;
+        }
         switch (category) {
             case 0x00000003: // Unicode platform Unicode BMP only
             case 0x00030001: // Windows platform Unicode BMP
@@ -130,7 +367,14 @@ int cmap_init(TTFont *font) {
         return -1;
     }
 
-    memset(font->glyf_index.plane1, 0, sizeof(uint16_t) * UCS_PLANE_RANGE);
+    if (cmap_validate(font, cmapOffset, cmapFormat) < 0) {
+        DebugPrintf("cmap format %d subtable out of bounds\n", cmapFormat)
+        return -1;
+    }
+
+    if (glyf_index_init(&font->glyf_index) < 0) {
+        return -1;
+    }
 
     switch (cmapFormat) {
         case 0:
@@ -148,13 +392,86 @@ int cmap_init(TTFont *font) {
 }
 
 int head_init(TTFont *font) {
+    font->info.unitsPerEm = get_uint16(font, font->tables.head.offset + 18);
     font->info.indexToLocFormat = get_uint16(font, font->tables.head.offset + 50);
     font->info.numGlyphs = get_uint16(font, font->tables.maxp.offset + 4);
+    font->info.numLongHmtx = get_uint16(font, font->tables.hhea.offset + 34);
     DebugPrintf("head locFormat %d numGlyphs %d\n", font->info.indexToLocFormat, font->info.numGlyphs)
+    if (font->info.unitsPerEm == 0 || font->info.numLongHmtx == 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * kern table https://docs.microsoft.com/en-us/typography/opentype/spec/kern
+ * only the first horizontal format 0 subtable, its sorted pair array is located once here
+ * no kern table is not an error, kerning is just 0
+ */
+int kern_init(TTFont *font) {
+    uint32_t offset = font->tables.kern.offset, end = offset + font->tables.kern.length;
+    uint16_t i, num, length, coverage, pairs;
+
+    font->info.numKernPairs = 0;
+    font->info.kernPairs = 0;
+    if (!offset || font->tables.kern.length < 4 || end > font->ttf_size || end < offset) {
+        return 0;
+    }
+    // version 0, the Apple version 1 layout is not supported
+    if (get_uint16(font, offset) != 0) {
+        return 0;
+    }
+    num = get_uint16(font, offset + 2);
+    offset += 4;
+    for (i = 0; i < num && offset + 14 <= end; ++i) {
+        length = get_uint16(font, offset + 2);
+        coverage = get_uint16(font, offset + 4);
+        // format 0 in the high byte, horizontal, neither minimum nor cross stream
+        if ((coverage & 0xFF07) == 0x0001) {
+            pairs = get_uint16(font, offset + 6);
+            if (offset + 14 + 6 * (uint32_t) pairs <= end) {
+                font->info.numKernPairs = pairs;
+                font->info.kernPairs = offset + 14;
+            }
+            break;
+        }
+        if (length < 6) {
+            break;
+        }
+        offset += length;
+    }
+    DebugPrintf("kern pairs %d\n", font->info.numKernPairs)
+    return 0;
+}
+
+/**
+ * the tables every reader relies on exist and lie inside the font,
+ * with the fixed size headers head_init reads
+ */
+static int tables_validate(const TTFont *font)
+{
+    const TTFontTable *tables[] = {
+        &font->tables.cmap, &font->tables.glyf, &font->tables.head, &font->tables.hhea,
+        &font->tables.hmtx, &font->tables.loca, &font->tables.maxp
+    };
+    size_t i;
+    for (i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+        if (!tables[i]->offset || tables[i]->offset > font->ttf_size
+            || tables[i]->length > font->ttf_size - tables[i]->offset) {
+            return -1;
+        }
+    }
+    if (font->tables.head.length < 54 || font->tables.hhea.length < 36 || font->tables.maxp.length < 6
+        || font->tables.cmap.length < 4) {
+        return -1;
+    }
     return 0;
 }
 
 int font_init(TTFont *font) {
+    if (font->ttf_size < 12) {
+        return -1;
+    }
     uint32_t magic_number = get_uint32(font, 0);
 
     if (magic_number != 0x00010000 && magic_number != 0x74727565 && magic_number != 0x4F54544F) {
@@ -162,25 +479,30 @@ int font_init(TTFont *font) {
     }
     // parse tables
     uint32_t tag;
-    uint16_t numTables = get_uint32(font, 4);
-    uint16_t count = 0;
+    uint16_t numTables = get_uint16(font, 4);
+    uint16_t count;
     uint32_t offset;
 
+    if (12 + 16 * (size_t) numTables > font->ttf_size) {
+        return -1;
+    }
+
     #define CASE_FONT_TABLE_TAG(tag, hex) \
         case hex: \
             font->tables.tag.offset = get_uint32(font, offset + 8); \
             font->tables.tag.length = get_uint32(font, offset + 12); \
             break;
 
-    while (count < numTables) {
-        count++;
+    for (count = 0; count < numTables; ++count) {
         offset = 16 * count + 12;
         tag = get_uint32(font, offset);
         switch (tag) {
             CASE_FONT_TABLE_TAG(cmap, 0x636d6170)
             CASE_FONT_TABLE_TAG(glyf, 0x676c7966)
             CASE_FONT_TABLE_TAG(head, 0x68656164)
+            CASE_FONT_TABLE_TAG(hhea, 0x68686561)
             CASE_FONT_TABLE_TAG(hmtx, 0x686d7478)
+            CASE_FONT_TABLE_TAG(kern, 0x6b65726e)
             CASE_FONT_TABLE_TAG(loca, 0x6c6f6361)
             CASE_FONT_TABLE_TAG(maxp, 0x6d617870)
             default:
@@ -188,9 +510,12 @@ int font_init(TTFont *font) {
                 break;
         }
     }
-    // @todo check tables
     DebugPrintf("Read tables offsets\n")
-    if (head_init(font) < 0 || cmap_init(font) < 0) {
+    // validated once here, the readers below and the glyf decoder do not bounds check
+    if (tables_validate(font) < 0) {
+        return -1;
+    }
+    if (head_init(font) < 0 || glyf_validate(font) < 0 || cmap_init(font) < 0 || kern_init(font) < 0) {
         return -2;
     }
 
@@ -203,6 +528,7 @@ TTFont *font_load(const void *mem, size_t size) {
         return NULL;
     }
     memset(font, 0, sizeof *font);
+    font->font_size = FONT_DEFAULT_SIZE;
     font->ttf_bytes = mem;
     font->ttf_size = size;
     if (font_init(font) < 0) {
@@ -212,117 +538,1384 @@ TTFont *font_load(const void *mem, size_t size) {
     return font;
 }
 
-void font_free(TTFont *font){
-    if (!font) return;
-    VT_free(font);
+/**
+ * content hash of font bytes and cache payload, 8 bytes per step
+ */
+static uint64_t font_hash(const uint8_t *bytes, size_t size)
+{
+    uint64_t word, hash = 0xcbf29ce484222325ULL ^ (uint64_t) size;
+    size_t i;
+    for (i = 0; i + 8 <= size; i += 8) {
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
 }
 
-void font_set_size(TTFont *font, uint16_t size) {
-    font->font_size = size;
-}
+#if defined(_WIN32)
 
-void font_free_bitmap(TTFontBitmap *bitmap) {
-    if (!bitmap) return;
-    VT_free(bitmap);
-}
+static int cache_map(TTFontCacheMapping *cache, const char *path)
+{
+    HANDLE file;
+    DWORD high, low;
 
-int font_render(TTFont *font, uint32_t codepoint) {
-    uint32_t glyfOffset;
-    uint16_t shortCode = (uint16_t) codepoint;
-    uint32_t glyfIndex = font->glyf_index.plane1[shortCode];
-    DebugPrintf("find glyf index %d\n", glyfIndex)
-    if (font->info.indexToLocFormat == 0) {
-        glyfOffset = font->tables.loca.offset + (2 * glyfIndex);
-    } else {
-        glyfOffset = font->tables.loca.offset + (4 * glyfIndex);
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    low = GetFileSize(file, &high);
+    if (low == INVALID_FILE_SIZE || high || low < sizeof(TTFontCacheHeader)) {
+        CloseHandle(file);
+        return -1;
+    }
+    cache->size = low;
+    cache->mapping = CreateFileMapping(file, NULL, PAGE_READONLY, high, low, NULL);
+    CloseHandle(file);
+    if (!cache->mapping) {
+        return -1;
+    }
+    if (!(cache->memory = MapViewOfFile(cache->mapping, FILE_MAP_READ, 0, 0, 0))) {
+        CloseHandle(cache->mapping);
+        cache->mapping = NULL;
+        return -1;
     }
-    DebugPrintf("glyf offset %d\n", glyfOffset)
     return 0;
 }
 
-static int cmap_format0(TTFont *font, uint32_t offset) {
-    int i;
-    for(i = 0; i < 256; ++i) {
-        // skip uint16 format uint16 length uint16 language
-        font->glyf_index.plane1[i] = get_uint8(font, offset + 6 + i);
+static void cache_unmap(TTFontCacheMapping *cache)
+{
+    if (cache->memory) {
+        UnmapViewOfFile(cache->memory);
+        cache->memory = NULL;
+    }
+    if (cache->mapping) {
+        CloseHandle(cache->mapping);
+        cache->mapping = NULL;
+    }
+}
+
+#else
+
+static int cache_map(TTFontCacheMapping *cache, const char *path)
+{
+    struct stat info;
+    void *memory;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &info) < 0 || info.st_size < (off_t) sizeof(TTFontCacheHeader)) {
+        close(fd);
+        return -1;
     }
+    memory = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return -1;
+    }
+    cache->memory = memory;
+    cache->size = (size_t) info.st_size;
     return 0;
 }
 
-static int cmap_format4(TTFont *font, uint32_t offset)
+static void cache_unmap(TTFontCacheMapping *cache)
 {
-    int i, j, total = 0;
-    uint16_t segCount, segCountX2, endCode, startCode, idRangeOffset;
-    int16_t idDelta;
-    uint32_t tmpOffset, tmpOffset2, segArraySize;
+    if (cache->memory) {
+        munmap(cache->memory, cache->size);
+        cache->memory = NULL;
+    }
+}
 
-    uint16_t tableLength = get_uint16(font, offset + 2);
-    segCountX2 = get_uint16(font, offset + 6);
-    segCount = segCountX2 / 2;
+#endif
 
-    segArraySize = sizeof(uint16_t) * segCount;
-    for (i = 0; i < segCount; ++i) {
-        tmpOffset = offset + 14 + (i * 2);
-        endCode = get_uint16(font, tmpOffset);
-        tmpOffset += segArraySize + 2;
-        startCode = get_uint16(font, tmpOffset);
-        tmpOffset += segArraySize;
-        idDelta = get_int16(font, tmpOffset);
-        tmpOffset += segArraySize;
-        idRangeOffset = get_uint16(font, tmpOffset);
+/**
+ * adopt a mapped cache file, nothing is copied except the page map
+ */
+static int cache_load(TTFont *font, const char *path, uint64_t hash)
+{
+    const TTFontCacheHeader *header;
+    const TTFontCacheData *data;
+    const uint8_t *payload;
+    uint32_t i;
 
-        for (j = startCode; j <= endCode; ++j) {
-            if (idRangeOffset > 0) {
-                tmpOffset2 = tmpOffset + idRangeOffset + ((j - startCode) * 2);
-                if (tmpOffset2 > tableLength + offset) {
-                    DebugPrintf("cmap format4 warning charCode %d may not valid\n", j)
-                    continue;
-                }
-                font->glyf_index.plane1[j] = get_uint16(font, tmpOffset2);
-            } else {
-                font->glyf_index.plane1[j] = j + idDelta;
-            }
-            total++;
+    if (cache_map(&font->cache, path) < 0) {
+        return -1;
+    }
+    header = font->cache.memory;
+    payload = (const uint8_t *) font->cache.memory + sizeof(TTFontCacheHeader);
+    data = (const TTFontCacheData *) payload;
+
+    if (header->magic != FONT_CACHE_MAGIC || header->version != FONT_CACHE_VERSION
+        || header->font_hash != hash || header->font_size != font->ttf_size
+        || header->payload_size != font->cache.size - sizeof(TTFontCacheHeader)
+        || header->payload_size < sizeof(TTFontCacheData)) {
+        goto invalid;
+    }
+    if (data->num_pages == 0 || data->num_pages > UCS_PAGE_COUNT + 1
+        || header->payload_size != sizeof(TTFontCacheData) + data->num_pages * sizeof(*font->glyf_index.pages)) {
+        goto invalid;
+    }
+    if (font_hash(payload, header->payload_size) != header->checksum) {
+        goto invalid;
+    }
+    for (i = 0; i < UCS_PAGE_COUNT; ++i) {
+        if (data->page_map[i] >= data->num_pages) {
+            goto invalid;
         }
     }
-    DebugPrintf("cmap total %d\n", total)
+
+    font->tables = data->tables;
+    font->info = data->info;
+    memcpy(font->glyf_index.page_map, data->page_map, sizeof(data->page_map));
+    font->glyf_index.pages = (void *) (payload + sizeof(TTFontCacheData));
+    font->glyf_index.num_pages = (uint16_t) data->num_pages;
+    font->glyf_index.cap_pages = 0;
+    DebugPrintf("font cache hit %s pages %u\n", path, data->num_pages)
     return 0;
+
+invalid:
+    DebugPrintf("font cache invalid %s\n", path)
+    cache_unmap(&font->cache);
+    return -1;
 }
 
-static int cmap_format6(TTFont *font, uint32_t offset)
+/**
+ * write through a temporary file so concurrent readers never map a partial cache
+ */
+static int cache_store(const TTFont *font, const char *path, uint64_t hash)
 {
-    uint16_t i, firstCode, entryCount;
-    firstCode = get_uint16(font, offset + 6);
-    entryCount = get_uint16(font, offset + 8);
-    for (i = 0; i < entryCount; ++i) {
-        font->glyf_index.plane1[firstCode + i] = get_uint16(font, offset + 10 + (2 * i));
+    TTFontCacheHeader header;
+    TTFontCacheData *data;
+    size_t pagesSize, payloadSize, pathLength;
+    char *tmpPath;
+    FILE *f;
+    int written;
+
+    pagesSize = font->glyf_index.num_pages * sizeof(*font->glyf_index.pages);
+    payloadSize = sizeof(TTFontCacheData) + pagesSize;
+    pathLength = strlen(path);
+    if (!(data = VT_malloc(payloadSize))) {
+        return -1;
     }
-    DebugPrintf("cmap format6 firstCode %d total %d\n", firstCode, entryCount)
-    return 0;
+    if (!(tmpPath = VT_malloc(pathLength + 5))) {
+        VT_free(data);
+        return -1;
+    }
+    memset(data, 0, sizeof(TTFontCacheData));
+    data->tables = font->tables;
+    data->info = font->info;
+    data->num_pages = font->glyf_index.num_pages;
+    memcpy(data->page_map, font->glyf_index.page_map, sizeof(data->page_map));
+    memcpy(data + 1, font->glyf_index.pages, pagesSize);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = FONT_CACHE_MAGIC;
+    header.version = FONT_CACHE_VERSION;
+    header.font_hash = hash;
+    header.font_size = font->ttf_size;
+    header.checksum = font_hash((const uint8_t *) data, payloadSize);
+    header.payload_size = payloadSize;
+
+    memcpy(tmpPath, path, pathLength);
+    memcpy(tmpPath + pathLength, ".tmp", 5);
+    written = 0;
+    if ((f = fopen(tmpPath, "wb"))) {
+        written = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(data, payloadSize, 1, f) == 1;
+        written = (fclose(f) == 0) && written;
+    }
+#if defined(_WIN32)
+    if (written) {
+        remove(path);
+    }
+#endif
+    if (written && rename(tmpPath, path) != 0) {
+        written = 0;
+    }
+    if (!written) {
+        remove(tmpPath);
+    }
+    DebugPrintf("font cache store %s %s\n", path, written ? "ok" : "failed")
+    VT_free(tmpPath);
+    VT_free(data);
+    return written ? 0 : -1;
 }
 
-static int cmap_format12(TTFont *font, uint32_t offset)
-{
-    uint32_t i, j, num, startCharCode, endCharCode, startGlyphID, tmpOffset, total = 0;
-    num = get_uint32(font, offset + 12);
-    for (i = 0; i < num; ++i) {
-        tmpOffset = offset + 16 + (i * 12);
-        startCharCode = get_uint32(font, tmpOffset);
-        endCharCode = get_uint32(font, tmpOffset + 4);
-        startGlyphID = get_uint32(font, tmpOffset + 8);
-        if (startCharCode > 0xFFFF) {
-            // @todo add other plane
-            break;
-        }
-        for (j = startCharCode; j <= endCharCode; ++j) {
-            if (j < 0xFFFF) {
-                total++;
-                font->glyf_index.plane1[j] = j - startCharCode + startGlyphID;
-            }
-        }
+TTFont *font_load_cached(const void *mem, size_t size, const char *cache_path) {
+    TTFont *font;
+    uint64_t hash;
+    if (!cache_path) {
+        return font_load(mem, size);
     }
-    DebugPrintf("cmap total %d\n", total)
-    return 0;
+    if (!(font = VT_malloc(sizeof *font))) {
+        return NULL;
+    }
+    memset(font, 0, sizeof *font);
+    font->font_size = FONT_DEFAULT_SIZE;
+    font->ttf_bytes = mem;
+    font->ttf_size = size;
+    hash = font_hash(mem, size);
+    if (cache_load(font, cache_path, hash) == 0) {
+        return font;
+    }
+    if (font_init(font) < 0) {
+        font_free(font);
+        return NULL;
+    }
+    // a failed store only costs the next start a cold load
+    cache_store(font, cache_path, hash);
+    return font;
+}
+
+void font_free(TTFont *font){
+    if (!font) return;
+    glyf_index_free(&font->glyf_index);
+    glyf_context_free(&font->glyf_context);
+    cache_unmap(&font->cache);
+    VT_free(font);
+}
+
+void font_set_size(TTFont *font, uint16_t size) {
+    font->font_size = size;
+}
+
+uint16_t font_get_size(const TTFont *font) {
+    return font->font_size;
+}
+
+uint16_t font_lookup(TTFont *font, uint32_t codepoint) {
+    return glyf_index_get(&font->glyf_index, codepoint);
+}
+
+int font_glyph_metrics(TTFont *font, uint16_t glyph, TTFontGlyphMetrics *metrics) {
+    return glyph_metrics(font, glyph, font->font_size, metrics);
 }
 
+int font_render_glyph(TTFont *font, uint16_t glyph, uint8_t *pixels, int stride) {
+    return glyph_render(font, &font->glyf_context, glyph, font->font_size, pixels, stride);
+}
+
+int font_render_glyph_mono(TTFont *font, uint16_t glyph, uint8_t *bits, int stride) {
+    return glyph_render_mono(font, &font->glyf_context, glyph, font->font_size, bits, stride);
+}
+
+TTFontGLYFContext *font_context_new(void) {
+    TTFontGLYFContext *ctx;
+    if (!(ctx = VT_malloc(sizeof *ctx))) {
+        return NULL;
+    }
+    memset(ctx, 0, sizeof *ctx);
+    return ctx;
+}
+
+void font_context_free(TTFontGLYFContext *ctx) {
+    if (!ctx) return;
+    glyf_context_free(ctx);
+    VT_free(ctx);
+}
+
+int font_glyph_metrics_at(TTFont *font, uint16_t glyph, uint16_t size, TTFontGlyphMetrics *metrics) {
+    return glyph_metrics(font, glyph, size, metrics);
+}
+
+int font_render_glyph_at(TTFont *font, TTFontGLYFContext *ctx, uint16_t glyph, uint16_t size, uint8_t *pixels, int stride) {
+    return glyph_render(font, ctx, glyph, size, pixels, stride);
+}
+
+int font_render_glyph_mono_at(TTFont *font, TTFontGLYFContext *ctx, uint16_t glyph, uint16_t size, uint8_t *bits, int stride) {
+    return glyph_render_mono(font, ctx, glyph, size, bits, stride);
+}
 
+void font_free_bitmap(TTFontBitmap *bitmap) {
+    if (!bitmap) return;
+    VT_free(bitmap);
+}
+
+TTFontBitmap *font_render(TTFont *font, uint32_t codepoint) {
+    TTFontBitmap *bitmap;
+    TTFontGlyphMetrics metrics;
+    uint16_t glyph = glyf_index_get(&font->glyf_index, codepoint);
+
+    if (glyph_metrics(font, glyph, font->font_size, &metrics) < 0) {
+        return NULL;
+    }
+    // header and pixels in one block, released by font_free_bitmap
+    if (!(bitmap = VT_malloc(sizeof *bitmap + (size_t) metrics.width * metrics.height))) {
+        return NULL;
+    }
+    bitmap->metrics = metrics;
+    bitmap->pixels = (uint8_t *) (bitmap + 1);
+    if (glyph_render(font, &font->glyf_context, glyph, font->font_size, bitmap->pixels, metrics.width) < 0) {
+        VT_free(bitmap);
+        return NULL;
+    }
+    return bitmap;
+}
+
+TTFontSet *font_set_new(TTFont *const *faces, int count) {
+    TTFontSet *set;
+    const TTFontTableGLYFIndex *index;
+    uint32_t page, *dst;
+    uint16_t slot, glyph;
+    int face, i;
+
+    if (count <= 0 || count > FONT_SET_MAX_FACES || !(set = VT_malloc(sizeof *set))) {
+        return NULL;
+    }
+    memset(set, 0, sizeof *set);
+    for (face = 0; face < count; ++face) {
+        set->faces[face] = faces[face];
+    }
+    set->num_faces = count;
+    // a merged page for every page any face maps, plus the shared empty slot 0
+    set->num_pages = 1;
+    for (page = 0; page < UCS_PAGE_COUNT; ++page) {
+        for (face = 0; face < count; ++face) {
+            if (faces[face]->glyf_index.page_map[page]) {
+                set->page_map[page] = set->num_pages++;
+                break;
+            }
+        }
+    }
+    if (!(set->pages = VT_malloc(sizeof(*set->pages) * set->num_pages))) {
+        VT_free(set);
+        return NULL;
+    }
+    memset(set->pages, 0, sizeof(*set->pages) * set->num_pages);
+    for (page = 0; page < UCS_PAGE_COUNT; ++page) {
+        if (!set->page_map[page]) {
+            continue;
+        }
+        dst = set->pages[set->page_map[page]];
+        // last face first, so earlier faces overwrite and win
+        for (face = count - 1; face >= 0; --face) {
+            index = &faces[face]->glyf_index;
+            if (!(slot = index->page_map[page])) {
+                continue;
+            }
+            for (i = 0; i < UCS_PAGE_SIZE; ++i) {
+                if ((glyph = index->pages[slot][i])) {
+                    dst[i] = (uint32_t) face << 16 | glyph;
+                }
+            }
+        }
+    }
+    return set;
+}
+
+void font_set_free(TTFontSet *set) {
+    if (!set) return;
+    VT_free(set->pages);
+    VT_free(set);
+}
+
+void font_set_set_size(TTFontSet *set, uint16_t size) {
+    uint16_t face;
+    for (face = 0; face < set->num_faces; ++face) {
+        font_set_size(set->faces[face], size);
+    }
+}
+
+int font_set_count(const TTFontSet *set) {
+    return set->num_faces;
+}
+
+TTFont *font_set_face(const TTFontSet *set, int face) {
+    return face >= 0 && face < set->num_faces ? set->faces[face] : NULL;
+}
+
+TTFontSetGlyph font_set_lookup(const TTFontSet *set, uint32_t codepoint) {
+    TTFontSetGlyph result = {0, 0};
+    uint32_t entry;
+
+    if (codepoint <= UCS_CODEPOINT_MAX) {
+        entry = set->pages[set->page_map[codepoint >> UCS_PAGE_SHIFT]][codepoint & UCS_PAGE_MASK];
+        result.face = entry >> 16;
+        result.glyph = entry & 0xFFFF;
+    }
+    return result;
+}
+
+/**
+ * everything the cmap_format* reader of the selected subtable touches lies inside the cmap table
+ */
+static int cmap_validate(const TTFont *font, uint32_t offset, uint16_t format)
+{
+    uint64_t size = (uint64_t) font->tables.cmap.offset + font->tables.cmap.length - offset;
+    switch (format) {
+        case 0:
+            return size >= 6 + 256 ? 0 : -1;
+        case 4:
+            // the glyph id array reads are checked against the subtable length
+            if (size < 14 || get_uint16(font, offset + 2) > size) {
+                return -1;
+            }
+            return size >= 16 + 4 * (uint64_t) get_uint16(font, offset + 6) ? 0 : -1;
+        case 6:
+            if (size < 10) {
+                return -1;
+            }
+            return size >= 10 + 2 * (uint64_t) get_uint16(font, offset + 8) ? 0 : -1;
+        case 12:
+            if (size < 16) {
+                return -1;
+            }
+            return size >= 16 + 12 * (uint64_t) get_uint32(font, offset + 12) ? 0 : -1;
+        default:
+            return -1;
+    }
+}
+
+static int cmap_format0(TTFont *font, uint32_t offset) {
+    int i;
+    for(i = 0; i < 256; ++i) {
+        // skip uint16 format uint16 length uint16 language
+        if (glyf_index_set(&font->glyf_index, i, get_uint8(font, offset + 6 + i)) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int cmap_format4(TTFont *font, uint32_t offset)
+{
+    int i, j, total = 0;
+    uint16_t segCount, segCountX2, endCode, startCode, idRangeOffset;
+    uint16_t *segments, *endCodes, *startCodes, *idDeltas, *idRangeOffsets;
+    int16_t idDelta;
+    uint16_t glyph;
+    uint32_t tmpOffset, tmpOffset2, segArraySize;
+
+    uint16_t tableLength = get_uint16(font, offset + 2);
+    segCountX2 = get_uint16(font, offset + 6);
+    segCount = segCountX2 / 2;
+
+    segArraySize = sizeof(uint16_t) * segCount;
+    // endCode[segCount], reservedPad, startCode[segCount], idDelta[segCount], idRangeOffset[segCount]
+    if (!(segments = VT_malloc(sizeof(uint16_t) * (4 * segCount + 1)))) {
+        return -1;
+    }
+    be_decode16(segments, font->ttf_bytes + offset + 14, 4 * segCount + 1);
+    endCodes = segments;
+    startCodes = endCodes + segCount + 1;
+    idDeltas = startCodes + segCount;
+    idRangeOffsets = idDeltas + segCount;
+
+    for (i = 0; i < segCount; ++i) {
+        endCode = endCodes[i];
+        startCode = startCodes[i];
+        idDelta = (int16_t) idDeltas[i];
+        idRangeOffset = idRangeOffsets[i];
+        if (startCode > endCode) {
+            continue;
+        }
+        if (idRangeOffset == 0) {
+            // the common case, a run of consecutive glyphs
+            if (glyf_index_set_range(&font->glyf_index, startCode, endCode - startCode + 1U,
+                                     (uint16_t) (startCode + idDelta)) < 0) {
+                VT_free(segments);
+                return -1;
+            }
+            total += endCode - startCode + 1;
+            continue;
+        }
+        tmpOffset = offset + 16 + 3 * segArraySize + i * 2;
+        for (j = startCode; j <= endCode; ++j) {
+            tmpOffset2 = tmpOffset + idRangeOffset + ((j - startCode) * 2);
+            if (tmpOffset2 + 2 > tableLength + offset) {
+                DebugPrintf("cmap format4 warning charCode %d may not valid\n", j)
+                continue;
+            }
+            glyph = get_uint16(font, tmpOffset2);
+            if (glyph) {
+                glyph += idDelta;
+            }
+            if (glyf_index_set(&font->glyf_index, j, glyph) < 0) {
+                VT_free(segments);
+                return -1;
+            }
+            total++;
+        }
+    }
+    VT_free(segments);
+    DebugPrintf("cmap total %d\n", total)
+    return 0;
+}
+
+static int cmap_format6(TTFont *font, uint32_t offset)
+{
+    uint16_t i, firstCode, entryCount;
+    firstCode = get_uint16(font, offset + 6);
+    entryCount = get_uint16(font, offset + 8);
+    for (i = 0; i < entryCount; ++i) {
+        if (glyf_index_set(&font->glyf_index, firstCode + i, get_uint16(font, offset + 10 + (2 * i))) < 0) {
+            return -1;
+        }
+    }
+    DebugPrintf("cmap format6 firstCode %d total %d\n", firstCode, entryCount)
+    return 0;
+}
+
+static int cmap_format12(TTFont *font, uint32_t offset)
+{
+    uint32_t i, num, startCharCode, endCharCode, startGlyphID, tmpOffset, total = 0;
+    num = get_uint32(font, offset + 12);
+    for (i = 0; i < num; ++i) {
+        tmpOffset = offset + 16 + (i * 12);
+        startCharCode = get_uint32(font, tmpOffset);
+        endCharCode = get_uint32(font, tmpOffset + 4);
+        startGlyphID = get_uint32(font, tmpOffset + 8);
+        if (startCharCode > UCS_CODEPOINT_MAX) {
+            break;
+        }
+        if (endCharCode > UCS_CODEPOINT_MAX) {
+            endCharCode = UCS_CODEPOINT_MAX;
+        }
+        if (startCharCode > endCharCode) {
+            continue;
+        }
+        total += endCharCode - startCharCode + 1;
+        if (glyf_index_set_range(&font->glyf_index, startCharCode, endCharCode - startCharCode + 1,
+                                 (uint16_t) startGlyphID) < 0) {
+            return -1;
+        }
+    }
+    DebugPrintf("cmap total %d\n", total)
+    return 0;
+}
+
+/**
+ * glyf outline decoding and rasterization
+ * https://docs.microsoft.com/en-us/typography/opentype/spec/glyf
+ */
+#define GLYF_ON_CURVE         0x01
+#define GLYF_X_SHORT          0x02
+#define GLYF_Y_SHORT          0x04
+#define GLYF_REPEAT           0x08
+#define GLYF_X_SAME           0x10
+#define GLYF_Y_SAME           0x20
+
+#define GLYF_ARGS_ARE_WORDS   0x0001
+#define GLYF_ARGS_ARE_XY      0x0002
+#define GLYF_HAVE_SCALE       0x0008
+#define GLYF_MORE_COMPONENTS  0x0020
+#define GLYF_HAVE_XY_SCALE    0x0040
+#define GLYF_HAVE_2X2         0x0080
+
+#define GLYF_MAX_DEPTH 4
+
+// 24.8 pixel coordinates
+#define FONT_RASTER_SHIFT 8
+#define FONT_RASTER_PIXEL (1 << FONT_RASTER_SHIFT)
+// accum units of one fully covered pixel, PIXEL * 2 * PIXEL
+#define FONT_RASTER_ONE (FONT_RASTER_PIXEL * FONT_RASTER_PIXEL * 2)
+// max curve flattening error, 1/4 pixel
+#define FONT_RASTER_TOLERANCE (FONT_RASTER_PIXEL / 4)
+#define FONT_RASTER_MAX_STEPS 64
+
+static inline int32_t floor_div(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    return (int32_t) ((a % b != 0 && a < 0) ? q - 1 : q);
+}
+
+static inline int32_t ceil_div(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    return (int32_t) ((a % b != 0 && a > 0) ? q + 1 : q);
+}
+
+// font units to 24.8 fixed pixels
+static int32_t scale_fixed(int64_t units, uint16_t size, uint16_t upem)
+{
+    return floor_div(units * size * FONT_RASTER_PIXEL + upem / 2, upem);
+}
+
+static int glyf_context_reserve(void **mem, uint32_t *cap, uint32_t count, size_t item)
+{
+    void *grow;
+    uint32_t size;
+    if (count <= *cap) {
+        return 0;
+    }
+    size = *cap ? *cap : 64;
+    while (size < count) {
+        size *= 2;
+    }
+    if (!(grow = VT_realloc(*mem, size * item))) {
+        return -1;
+    }
+    *mem = grow;
+    *cap = size;
+    return 0;
+}
+
+static void glyf_context_free(TTFontGLYFContext *ctx)
+{
+    VT_free(ctx->points);
+    VT_free(ctx->flags);
+    VT_free(ctx->end_pts);
+    VT_free(ctx->accum);
+    VT_free(ctx->crossings);
+    VT_free(ctx->row_crossings);
+    VT_free(ctx->row_starts);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+/**
+ * offset and length of a glyph record in glyf, length 0 for empty glyphs
+ */
+static int glyf_locate(const TTFont *font, uint16_t glyph, uint32_t *offset, uint32_t *length)
+{
+    uint32_t this, next;
+    if (glyph >= font->info.numGlyphs) {
+        return -1;
+    }
+    if (font->info.indexToLocFormat == 0) {
+        this = 2U * get_uint16(font, font->tables.loca.offset + 2 * glyph);
+        next = 2U * get_uint16(font, font->tables.loca.offset + 2 * glyph + 2);
+    } else {
+        this = get_uint32(font, font->tables.loca.offset + 4 * glyph);
+        next = get_uint32(font, font->tables.loca.offset + 4 * glyph + 4);
+    }
+    if (next < this) {
+        return -1;
+    }
+    *offset = font->tables.glyf.offset + this;
+    *length = next - this;
+    return 0;
+}
+
+/**
+ * a glyph record holds everything glyf_simple or glyf_compound read from it
+ */
+static int glyf_record_validate(const TTFont *font, uint32_t offset, uint32_t length)
+{
+    uint32_t i, pos, numContours, numPoints, coords = 0;
+    uint8_t flag = 0, repeat = 0;
+    int16_t contours;
+    uint16_t flags;
+
+    // shorter records are drawn as empty
+    if (length < 10) {
+        return 0;
+    }
+    contours = get_int16(font, offset);
+    if (contours > 0) {
+        numContours = (uint32_t) contours;
+        pos = 10 + 2 * numContours;
+        if (pos + 2 > length) {
+            return -1;
+        }
+        numPoints = get_uint16(font, offset + pos - 2) + 1U;
+        pos += 2 + get_uint16(font, offset + pos);
+        for (i = 0; i < numPoints; ++i) {
+            if (repeat) {
+                repeat--;
+            } else {
+                if (pos + 1 > length) {
+                    return -1;
+                }
+                flag = get_uint8(font, offset + pos++);
+                if (flag & GLYF_REPEAT) {
+                    if (pos + 1 > length) {
+                        return -1;
+                    }
+                    repeat = get_uint8(font, offset + pos++);
+                }
+            }
+            coords += (flag & GLYF_X_SHORT) ? 1 : (flag & GLYF_X_SAME) ? 0 : 2;
+            coords += (flag & GLYF_Y_SHORT) ? 1 : (flag & GLYF_Y_SAME) ? 0 : 2;
+        }
+        return pos <= length && coords <= length - pos ? 0 : -1;
+    }
+    if (contours < 0) {
+        pos = 10;
+        do {
+            if (pos + 4 > length) {
+                return -1;
+            }
+            flags = get_uint16(font, offset + pos);
+            pos += 4;
+            pos += (flags & GLYF_ARGS_ARE_WORDS) ? 4 : 2;
+            if (flags & GLYF_HAVE_SCALE) {
+                pos += 2;
+            } else if (flags & GLYF_HAVE_XY_SCALE) {
+                pos += 4;
+            } else if (flags & GLYF_HAVE_2X2) {
+                pos += 8;
+            }
+            if (pos > length) {
+                return -1;
+            }
+        } while (flags & GLYF_MORE_COMPONENTS);
+    }
+    return 0;
+}
+
+/**
+ * hmtx holds the advances glyph_advance reads, loca is ascending and inside glyf,
+ * and every glyph record is whole
+ */
+static int glyf_validate(const TTFont *font)
+{
+    uint32_t glyph, numGlyphs = font->info.numGlyphs, this, next, entry;
+    uint32_t numLong = font->info.numLongHmtx < numGlyphs ? font->info.numLongHmtx : numGlyphs;
+
+    if (4 * numLong > font->tables.hmtx.length) {
+        return -1;
+    }
+    entry = font->info.indexToLocFormat == 0 ? 2 : 4;
+    if ((uint64_t) entry * (numGlyphs + 1) > font->tables.loca.length) {
+        return -1;
+    }
+    for (glyph = 0; glyph < numGlyphs; ++glyph) {
+        if (entry == 2) {
+            this = 2U * get_uint16(font, font->tables.loca.offset + 2 * glyph);
+            next = 2U * get_uint16(font, font->tables.loca.offset + 2 * glyph + 2);
+        } else {
+            this = get_uint32(font, font->tables.loca.offset + 4 * glyph);
+            next = get_uint32(font, font->tables.loca.offset + 4 * glyph + 4);
+        }
+        if (next < this || next > font->tables.glyf.length) {
+            DebugPrintf("loca entry %u out of order\n", glyph)
+            return -1;
+        }
+        if (glyf_record_validate(font, font->tables.glyf.offset + this, next - this) < 0) {
+            DebugPrintf("glyf record %u truncated\n", glyph)
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// advance width in font units, glyphs past numLongHmtx share the last one
+static inline uint16_t glyph_advance(const TTFont *font, uint16_t glyph)
+{
+    if (glyph >= font->info.numLongHmtx) {
+        glyph = font->info.numLongHmtx - 1;
+    }
+    return get_uint16(font, font->tables.hmtx.offset + 4 * glyph);
+}
+
+static int glyph_metrics(TTFont *font, uint16_t glyph, uint16_t size, TTFontGlyphMetrics *metrics)
+{
+    uint32_t offset, length;
+    uint16_t advance;
+    int64_t upem = font->info.unitsPerEm;
+    int32_t xMin, yMin, xMax, yMax;
+
+    memset(metrics, 0, sizeof(*metrics));
+    if (glyf_locate(font, glyph, &offset, &length) < 0) {
+        return -1;
+    }
+    advance = glyph_advance(font, glyph);
+    metrics->advance = (int16_t) ((advance * size + upem / 2) / upem);
+    if (length < 10) {
+        return 0;
+    }
+    xMin = floor_div((int64_t) get_int16(font, offset + 2) * size, upem);
+    yMin = floor_div((int64_t) get_int16(font, offset + 4) * size, upem);
+    xMax = ceil_div((int64_t) get_int16(font, offset + 6) * size, upem);
+    yMax = ceil_div((int64_t) get_int16(font, offset + 8) * size, upem);
+    if (xMax <= xMin || yMax <= yMin) {
+        return 0;
+    }
+    metrics->bearing_x = (int16_t) xMin;
+    metrics->bearing_y = (int16_t) yMax;
+    metrics->width = (uint16_t) (xMax - xMin);
+    metrics->height = (uint16_t) (yMax - yMin);
+    return 0;
+}
+
+// kerning in font units, binary search over the (left << 16 | right) sorted pairs
+static int16_t kern_pair(const TTFont *font, uint16_t left, uint16_t right)
+{
+    uint32_t key = (uint32_t) left << 16 | right, probe, lo = 0, hi = font->info.numKernPairs, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        probe = get_uint32(font, font->info.kernPairs + 6 * mid);
+        if (probe < key) {
+            lo = mid + 1;
+        } else if (probe > key) {
+            hi = mid;
+        } else {
+            return get_int16(font, font->info.kernPairs + 6 * mid + 4);
+        }
+    }
+    return 0;
+}
+
+int32_t font_render_run(TTFontSet *set, const uint32_t *codepoints, int count, TTFontRunGlyph *glyphs)
+{
+    TTFontSetGlyph resolved;
+    TTFontRunGlyph *out;
+    TTFont *font;
+    uint16_t prev_face = 0, prev_glyph = 0;
+    int32_t pen = 0;
+    int i;
+
+    for (i = 0; i < count; ++i) {
+        out = glyphs + i;
+        resolved = font_set_lookup(set, codepoints[i]);
+        font = set->faces[resolved.face];
+        // kerning only applies between neighbours of the same face
+        if (i && resolved.face == prev_face && font->info.numKernPairs) {
+            pen += scale_fixed(kern_pair(font, prev_glyph, resolved.glyph), font->font_size, font->info.unitsPerEm);
+        }
+        out->face = resolved.face;
+        out->glyph = resolved.glyph;
+        out->x = floor_div(pen + FONT_RASTER_PIXEL / 2, FONT_RASTER_PIXEL);
+        if (glyph_metrics(font, resolved.glyph, font->font_size, &out->metrics) < 0) {
+            return -1;
+        }
+        // the pen advances unrounded, metrics.advance is only the rounded one
+        pen += scale_fixed(glyph_advance(font, resolved.glyph), font->font_size, font->info.unitsPerEm);
+        prev_face = resolved.face;
+        prev_glyph = resolved.glyph;
+    }
+    return floor_div(pen + FONT_RASTER_PIXEL / 2, FONT_RASTER_PIXEL);
+}
+
+/**
+ * accumulate a line segment confined to one pixel cell
+ * the cell gets the area right of the segment, the next cell the rest,
+ * so a prefix sum over accum yields the coverage
+ */
+static inline void raster_cell(TTFontGLYFContext *ctx, int32_t row, int32_t col,
+                               int32_t xa, int32_t ya, int32_t xb, int32_t yb)
+{
+    int32_t dy = yb - ya;
+    int32_t sum = xa + xb - 2 * (col << FONT_RASTER_SHIFT);
+    int32_t *cell = ctx->accum + row * ctx->width + col;
+    cell[0] += dy * (2 * FONT_RASTER_PIXEL - sum);
+    cell[1] += dy * sum;
+}
+
+// a segment confined to one pixel row, split at column boundaries
+static void raster_row(TTFontGLYFContext *ctx, int32_t row, int32_t xa, int32_t ya, int32_t xb, int32_t yb)
+{
+    int32_t col, bound, x = xa, y = ya, ny;
+    if (ya == yb) {
+        return;
+    }
+    if (xa <= xb) {
+        col = xa >> FONT_RASTER_SHIFT;
+        for (;;) {
+            bound = (col + 1) << FONT_RASTER_SHIFT;
+            if (xb <= bound) {
+                raster_cell(ctx, row, col, x, y, xb, yb);
+                return;
+            }
+            ny = ya + (int32_t) ((int64_t) (yb - ya) * (bound - xa) / (xb - xa));
+            raster_cell(ctx, row, col, x, y, bound, ny);
+            x = bound;
+            y = ny;
+            col++;
+        }
+    } else {
+        col = (xa - 1) >> FONT_RASTER_SHIFT;
+        for (;;) {
+            bound = col << FONT_RASTER_SHIFT;
+            if (xb >= bound) {
+                raster_cell(ctx, row, col, x, y, xb, yb);
+                return;
+            }
+            ny = ya + (int32_t) ((int64_t) (yb - ya) * (bound - xa) / (xb - xa));
+            raster_cell(ctx, row, col, x, y, bound, ny);
+            x = bound;
+            y = ny;
+            col--;
+        }
+    }
+}
+
+/**
+ * a segment for the mono rasterizer, records where it crosses the pixel center rows
+ * a center on the segment's upper end counts, one on the lower end does not, so joined edges cross once
+ */
+static void mono_line(TTFontGLYFContext *ctx, int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    TTFontCrossing *crossing;
+    int32_t winding = 1, row, last, t;
+
+    if (y0 > y1) {
+        t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+        winding = -1;
+    }
+    // rows whose center row * PIXEL + PIXEL / 2 lies in [y0, y1)
+    row = (y0 + FONT_RASTER_PIXEL / 2 - 1) >> FONT_RASTER_SHIFT;
+    last = ((y1 + FONT_RASTER_PIXEL / 2 - 1) >> FONT_RASTER_SHIFT) - 1;
+    row = row < 0 ? 0 : row;
+    last = last >= ctx->height ? ctx->height - 1 : last;
+    if (row > last) {
+        return;
+    }
+    if (glyf_context_reserve((void **) &ctx->crossings, &ctx->cap_crossings,
+                             ctx->num_crossings + (uint32_t) (last - row + 1), sizeof(TTFontCrossing)) < 0) {
+        ctx->failed = 1;
+        return;
+    }
+    crossing = ctx->crossings + ctx->num_crossings;
+    ctx->num_crossings += (uint32_t) (last - row + 1);
+    for (; row <= last; ++row, ++crossing) {
+        t = row * FONT_RASTER_PIXEL + FONT_RASTER_PIXEL / 2;
+        crossing->x = x0 + (int32_t) ((int64_t) (x1 - x0) * (t - y0) / (y1 - y0));
+        crossing->row = row;
+        crossing->winding = winding;
+    }
+}
+
+// a segment in 24.8, split at row boundaries
+static void raster_line(TTFontGLYFContext *ctx, int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    int32_t row, bound, x = x0, y = y0, nx;
+    if (y0 == y1) {
+        return;
+    }
+    if (ctx->mono) {
+        mono_line(ctx, x0, y0, x1, y1);
+        return;
+    }
+    if (y0 < y1) {
+        row = y0 >> FONT_RASTER_SHIFT;
+        for (;;) {
+            bound = (row + 1) << FONT_RASTER_SHIFT;
+            if (y1 <= bound) {
+                raster_row(ctx, row, x, y, x1, y1);
+                return;
+            }
+            nx = x0 + (int32_t) ((int64_t) (x1 - x0) * (bound - y0) / (y1 - y0));
+            raster_row(ctx, row, x, y, nx, bound);
+            x = nx;
+            y = bound;
+            row++;
+        }
+    } else {
+        row = (y0 - 1) >> FONT_RASTER_SHIFT;
+        for (;;) {
+            bound = row << FONT_RASTER_SHIFT;
+            if (y1 >= bound) {
+                raster_row(ctx, row, x, y, x1, y1);
+                return;
+            }
+            nx = x0 + (int32_t) ((int64_t) (x1 - x0) * (bound - y0) / (y1 - y0));
+            raster_row(ctx, row, x, y, nx, bound);
+            x = nx;
+            y = bound;
+            row--;
+        }
+    }
+}
+
+/**
+ * flatten a quadratic bezier, the step count bounds the chord error
+ * |p0 - 2 p1 + p2| / (8 n^2) by FONT_RASTER_TOLERANCE
+ */
+static void raster_quad(TTFontGLYFContext *ctx, int32_t x0, int32_t y0, int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+    int64_t dx = x0 - 2 * x1 + x2, dy = y0 - 2 * y1 + y2, n2, t, u;
+    int64_t dd = (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+    int32_t i, n = 1, px = x0, py = y0, nx, ny;
+
+    while (n < FONT_RASTER_MAX_STEPS && (int64_t) n * n * 8 * FONT_RASTER_TOLERANCE < dd) {
+        n++;
+    }
+    n2 = (int64_t) n * n;
+    for (i = 1; i < n; ++i) {
+        t = i;
+        u = n - i;
+        nx = (int32_t) ((x0 * u * u + 2 * x1 * t * u + x2 * t * t) / n2);
+        ny = (int32_t) ((y0 * u * u + 2 * y1 * t * u + y2 * t * t) / n2);
+        raster_line(ctx, px, py, nx, ny);
+        px = nx;
+        py = ny;
+    }
+    raster_line(ctx, px, py, x2, y2);
+}
+
+static void raster_contour(TTFontGLYFContext *ctx, const int32_t *points, const uint8_t *flags, uint32_t count)
+{
+    int32_t sx, sy, cx, cy, qx = 0, qy = 0, px, py, mx, my;
+    uint32_t i, begin, end;
+    int control = 0;
+
+    if (count < 2) {
+        return;
+    }
+    begin = 0;
+    end = count;
+    if (flags[0] & GLYF_ON_CURVE) {
+        sx = points[0];
+        sy = points[1];
+        begin = 1;
+    } else if (flags[count - 1] & GLYF_ON_CURVE) {
+        sx = points[2 * (count - 1)];
+        sy = points[2 * (count - 1) + 1];
+        end = count - 1;
+    } else {
+        sx = (points[0] + points[2 * (count - 1)]) >> 1;
+        sy = (points[1] + points[2 * (count - 1) + 1]) >> 1;
+    }
+    cx = sx;
+    cy = sy;
+    for (i = begin; i < end; ++i) {
+        px = points[2 * i];
+        py = points[2 * i + 1];
+        if (flags[i] & GLYF_ON_CURVE) {
+            if (control) {
+                raster_quad(ctx, cx, cy, qx, qy, px, py);
+            } else {
+                raster_line(ctx, cx, cy, px, py);
+            }
+            cx = px;
+            cy = py;
+            control = 0;
+        } else {
+            if (control) {
+                mx = (qx + px) >> 1;
+                my = (qy + py) >> 1;
+                raster_quad(ctx, cx, cy, qx, qy, mx, my);
+                cx = mx;
+                cy = my;
+            }
+            qx = px;
+            qy = py;
+            control = 1;
+        }
+    }
+    if (control) {
+        raster_quad(ctx, cx, cy, qx, qy, sx, sy);
+    } else {
+        raster_line(ctx, cx, cy, sx, sy);
+    }
+}
+
+static int glyf_simple(TTFont *font, TTFontGLYFContext *ctx, uint32_t offset, uint16_t numContours,
+                       const TTFontTransform *trf)
+{
+    uint32_t i, numPoints, begin;
+    uint8_t flag = 0, repeat = 0;
+    int32_t value, xMax, yMax;
+    int64_t x, y;
+    int32_t *points;
+
+    if (glyf_context_reserve((void **) &ctx->end_pts, &ctx->cap_contours, numContours, sizeof(uint16_t)) < 0) {
+        return -1;
+    }
+    for (i = 0; i < numContours; ++i) {
+        ctx->end_pts[i] = get_uint16(font, offset + 10 + 2 * i);
+        if (i > 0 && ctx->end_pts[i] <= ctx->end_pts[i - 1]) {
+            return -1;
+        }
+    }
+    numPoints = ctx->end_pts[numContours - 1] + 1U;
+    if (glyf_context_reserve((void **) &ctx->flags, &ctx->cap_flags, numPoints, sizeof(uint8_t)) < 0
+        || glyf_context_reserve((void **) &ctx->points, &ctx->cap_points, numPoints, 2 * sizeof(int32_t)) < 0) {
+        return -1;
+    }
+    // skip instructions
+    offset += 10 + 2 * numContours;
+    offset += 2 + get_uint16(font, offset);
+
+    for (i = 0; i < numPoints; ++i) {
+        if (repeat) {
+            repeat--;
+        } else {
+            flag = get_uint8(font, offset++);
+            if (flag & GLYF_REPEAT) {
+                repeat = get_uint8(font, offset++);
+            }
+        }
+        ctx->flags[i] = flag;
+    }
+
+    // decode deltas into font units first, transform afterwards
+    points = ctx->points;
+    value = 0;
+    for (i = 0; i < numPoints; ++i) {
+        flag = ctx->flags[i];
+        if (flag & GLYF_X_SHORT) {
+            value += (flag & GLYF_X_SAME) ? get_uint8(font, offset) : -get_uint8(font, offset);
+            offset += 1;
+        } else if (!(flag & GLYF_X_SAME)) {
+            value += get_int16(font, offset);
+            offset += 2;
+        }
+        points[2 * i] = value;
+    }
+    value = 0;
+    for (i = 0; i < numPoints; ++i) {
+        flag = ctx->flags[i];
+        if (flag & GLYF_Y_SHORT) {
+            value += (flag & GLYF_Y_SAME) ? get_uint8(font, offset) : -get_uint8(font, offset);
+            offset += 1;
+        } else if (!(flag & GLYF_Y_SAME)) {
+            value += get_int16(font, offset);
+            offset += 2;
+        }
+        points[2 * i + 1] = value;
+    }
+
+    // clamp into the raster, the right edge stays inside the last column
+    xMax = (ctx->width << FONT_RASTER_SHIFT) - 1;
+    yMax = ctx->height << FONT_RASTER_SHIFT;
+    for (i = 0; i < numPoints; ++i) {
+        x = ((trf->a * points[2 * i] + trf->c * points[2 * i + 1]) >> 16) + trf->e;
+        y = ((trf->b * points[2 * i] + trf->d * points[2 * i + 1]) >> 16) + trf->f;
+        points[2 * i] = (int32_t) (x < 0 ? 0 : x > xMax ? xMax : x);
+        points[2 * i + 1] = (int32_t) (y < 0 ? 0 : y > yMax ? yMax : y);
+    }
+
+    begin = 0;
+    for (i = 0; i < numContours; ++i) {
+        raster_contour(ctx, points + 2 * begin, ctx->flags + begin, ctx->end_pts[i] + 1U - begin);
+        begin = ctx->end_pts[i] + 1U;
+    }
+    return 0;
+}
+
+static int glyf_outline(TTFont *font, TTFontGLYFContext *ctx, uint16_t glyph, const TTFontTransform *trf, int depth);
+
+static int glyf_compound(TTFont *font, TTFontGLYFContext *ctx, uint32_t offset, const TTFontTransform *trf, int depth)
+{
+    TTFontTransform local, child;
+    uint16_t flags, glyph;
+    int32_t dx, dy;
+
+    offset += 10;
+    do {
+        flags = get_uint16(font, offset);
+        glyph = get_uint16(font, offset + 2);
+        offset += 4;
+        if (flags & GLYF_ARGS_ARE_WORDS) {
+            dx = get_int16(font, offset);
+            dy = get_int16(font, offset + 2);
+            offset += 4;
+        } else {
+            dx = (int8_t) get_uint8(font, offset);
+            dy = (int8_t) get_uint8(font, offset + 1);
+            offset += 2;
+        }
+        // F2Dot14 to 16.16
+        local.a = local.d = 1 << 16;
+        local.b = local.c = 0;
+        if (flags & GLYF_HAVE_SCALE) {
+            local.a = local.d = get_int16(font, offset) * 4;
+            offset += 2;
+        } else if (flags & GLYF_HAVE_XY_SCALE) {
+            local.a = get_int16(font, offset) * 4;
+            local.d = get_int16(font, offset + 2) * 4;
+            offset += 4;
+        } else if (flags & GLYF_HAVE_2X2) {
+            local.a = get_int16(font, offset) * 4;
+            local.b = get_int16(font, offset + 2) * 4;
+            local.c = get_int16(font, offset + 4) * 4;
+            local.d = get_int16(font, offset + 6) * 4;
+            offset += 8;
+        }
+        // point matching is not supported, skip such components
+        if (!(flags & GLYF_ARGS_ARE_XY)) {
+            continue;
+        }
+        child.a = (trf->a * local.a + trf->c * local.b) >> 16;
+        child.b = (trf->b * local.a + trf->d * local.b) >> 16;
+        child.c = (trf->a * local.c + trf->c * local.d) >> 16;
+        child.d = (trf->b * local.c + trf->d * local.d) >> 16;
+        child.e = ((trf->a * dx + trf->c * dy) >> 16) + trf->e;
+        child.f = ((trf->b * dx + trf->d * dy) >> 16) + trf->f;
+        if (glyf_outline(font, ctx, glyph, &child, depth + 1) < 0) {
+            return -1;
+        }
+    } while (flags & GLYF_MORE_COMPONENTS);
+    return 0;
+}
+
+static int glyf_outline(TTFont *font, TTFontGLYFContext *ctx, uint16_t glyph, const TTFontTransform *trf, int depth)
+{
+    uint32_t offset, length;
+    int16_t numContours;
+
+    // guard against compound glyphs referencing themselves
+    if (depth > GLYF_MAX_DEPTH) {
+        return -1;
+    }
+    if (glyf_locate(font, glyph, &offset, &length) < 0) {
+        return -1;
+    }
+    if (length < 10) {
+        return 0;
+    }
+    numContours = get_int16(font, offset);
+    if (numContours > 0) {
+        return glyf_simple(font, ctx, offset, (uint16_t) numContours, trf);
+    } else if (numContours < 0) {
+        return glyf_compound(font, ctx, offset, trf, depth);
+    }
+    return 0;
+}
+
+/**
+ * decode the outline into ctx, scaled to size and placed in the metrics' bitmap box
+ */
+static int glyph_place(TTFont *font, TTFontGLYFContext *ctx, uint16_t glyph, uint16_t size,
+                       const TTFontGlyphMetrics *metrics)
+{
+    TTFontTransform trf;
+    int64_t scale;
+
+    // font units to 24.8 pixels, y down, bbox corner at origin
+    scale = ((int64_t) size << (16 + FONT_RASTER_SHIFT)) / font->info.unitsPerEm;
+    trf.a = scale;
+    trf.b = 0;
+    trf.c = 0;
+    trf.d = -scale;
+    trf.e = -(int64_t) metrics->bearing_x * FONT_RASTER_PIXEL;
+    trf.f = (int64_t) metrics->bearing_y * FONT_RASTER_PIXEL;
+    return glyf_outline(font, ctx, glyph, &trf, 0);
+}
+
+/**
+ * render glyph coverage into pixels, width * height of glyph_metrics at size
+ */
+static int glyph_render(TTFont *font, TTFontGLYFContext *ctx, uint16_t glyph, uint16_t size, uint8_t *pixels, int stride)
+{
+    TTFontGlyphMetrics metrics;
+    uint32_t cells, i;
+    int32_t x, y, acc, value;
+
+    if (glyph_metrics(font, glyph, size, &metrics) < 0) {
+        return -1;
+    }
+    if (metrics.width == 0 || metrics.height == 0) {
+        return 0;
+    }
+    ctx->width = metrics.width;
+    ctx->height = metrics.height;
+    cells = (uint32_t) metrics.width * metrics.height;
+    if (glyf_context_reserve((void **) &ctx->accum, &ctx->cap_accum, cells + 1, sizeof(int32_t)) < 0) {
+        return -1;
+    }
+    memset(ctx->accum, 0, (cells + 1) * sizeof(int32_t));
+    if (glyph_place(font, ctx, glyph, size, &metrics) < 0) {
+        return -1;
+    }
+
+    acc = 0;
+    i = 0;
+    for (y = 0; y < metrics.height; ++y) {
+        for (x = 0; x < metrics.width; ++x, ++i) {
+            acc += ctx->accum[i];
+            value = acc < 0 ? -acc : acc;
+            value = value > FONT_RASTER_ONE ? FONT_RASTER_ONE : value;
+            pixels[x] = (uint8_t) ((value * 255 + FONT_RASTER_ONE / 2) / FONT_RASTER_ONE);
+        }
+        pixels += stride;
+    }
+    return 0;
+}
+
+// set the bits of pixels [c0, c1), most significant bit first
+static void mono_fill(uint8_t *row, int32_t c0, int32_t c1)
+{
+    int32_t b0 = c0 >> 3, b1 = (c1 - 1) >> 3;
+    uint8_t head = (uint8_t) (0xFF >> (c0 & 7)), tail = (uint8_t) (0xFF << (7 - ((c1 - 1) & 7)));
+    if (b0 == b1) {
+        row[b0] |= head & tail;
+        return;
+    }
+    row[b0] |= head;
+    memset(row + b0 + 1, 0xFF, (size_t) (b1 - b0 - 1));
+    row[b1] |= tail;
+}
+
+/**
+ * render glyph without anti-aliasing into bits, (width + 7) / 8 bytes of glyph_metrics at size per row
+ * a pixel is set when its center is inside the outline by the non-zero winding rule
+ */
+static int glyph_render_mono(TTFont *font, TTFontGLYFContext *ctx, uint16_t glyph, uint16_t size, uint8_t *bits, int stride)
+{
+    TTFontGlyphMetrics metrics;
+    const TTFontCrossing *crossing;
+    int32_t *xs, key, start = 0, c0, c1;
+    uint32_t i, j, n, rowBytes;
+    int32_t y, winding;
+    int status;
+
+    if (glyph_metrics(font, glyph, size, &metrics) < 0) {
+        return -1;
+    }
+    if (metrics.width == 0 || metrics.height == 0) {
+        return 0;
+    }
+    ctx->width = metrics.width;
+    ctx->height = metrics.height;
+    ctx->num_crossings = 0;
+    ctx->failed = 0;
+    ctx->mono = 1;
+    status = glyph_place(font, ctx, glyph, size, &metrics);
+    ctx->mono = 0;
+    if (status < 0 || ctx->failed) {
+        return -1;
+    }
+
+    // counting sort of the crossings by row
+    if (glyf_context_reserve((void **) &ctx->row_starts, &ctx->cap_row_starts, (uint32_t) metrics.height + 1,
+                             sizeof(uint32_t)) < 0
+        || glyf_context_reserve((void **) &ctx->row_crossings, &ctx->cap_row_crossings, ctx->num_crossings + 1,
+                                sizeof(int32_t)) < 0) {
+        return -1;
+    }
+    memset(ctx->row_starts, 0, ((size_t) metrics.height + 1) * sizeof(uint32_t));
+    for (i = 0; i < ctx->num_crossings; ++i) {
+        ctx->row_starts[ctx->crossings[i].row + 1]++;
+    }
+    for (y = 0; y < metrics.height; ++y) {
+        ctx->row_starts[y + 1] += ctx->row_starts[y];
+    }
+    for (i = 0; i < ctx->num_crossings; ++i) {
+        crossing = ctx->crossings + i;
+        ctx->row_crossings[ctx->row_starts[crossing->row]++] = crossing->x * 2 + (crossing->winding > 0);
+    }
+
+    rowBytes = ((uint32_t) metrics.width + 7) / 8;
+    for (y = 0; y < metrics.height; ++y, bits += stride) {
+        memset(bits, 0, rowBytes);
+        // row_starts[y] was advanced to the end of row y, which is where row y + 1 starts
+        j = y ? ctx->row_starts[y - 1] : 0;
+        n = ctx->row_starts[y] - j;
+        xs = ctx->row_crossings + j;
+        // few crossings per row, insertion sort
+        for (i = 1; i < n; ++i) {
+            key = xs[i];
+            for (j = i; j > 0 && xs[j - 1] > key; --j) {
+                xs[j] = xs[j - 1];
+            }
+            xs[j] = key;
+        }
+        winding = 0;
+        for (i = 0; i < n; ++i) {
+            if (winding == 0) {
+                start = xs[i] >> 1;
+            }
+            winding += (xs[i] & 1) ? 1 : -1;
+            if (winding == 0) {
+                // pixels whose center lies in [start, end)
+                c0 = (start + FONT_RASTER_PIXEL / 2 - 1) >> FONT_RASTER_SHIFT;
+                c1 = ((xs[i] >> 1) + FONT_RASTER_PIXEL / 2 - 1) >> FONT_RASTER_SHIFT;
+                c0 = c0 < 0 ? 0 : c0;
+                c1 = c1 > metrics.width ? metrics.width : c1;
+                if (c0 < c1) {
+                    mono_fill(bits, c0, c1);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -22,13 +22,111 @@ extern "C" {
 
     typedef struct TTFont TTFont;
     typedef struct TTFontBitmap TTFontBitmap;
+    typedef struct TTFontGlyphMetrics TTFontGlyphMetrics;
+    typedef struct TTFontGLYFContext TTFontGLYFContext;
+    typedef struct TTFontSet TTFontSet;
+    typedef struct TTFontSetGlyph TTFontSetGlyph;
+    typedef struct TTFontRunGlyph TTFontRunGlyph;
+
+// fallback chain length limit of a TTFontSet
+#define FONT_SET_MAX_FACES 16
+
+    /**
+     * glyph metrics in pixels at the font size, y up from the baseline
+     * the bitmap box spans [bearing_x, bearing_x + width) x (bearing_y - height, bearing_y]
+     */
+    struct TTFontGlyphMetrics {
+        int16_t advance;
+        int16_t bearing_x;
+        int16_t bearing_y;
+        uint16_t width;
+        uint16_t height;
+    };
+
+    /**
+     * 8-bit coverage, metrics.width * metrics.height, rows are metrics.width bytes
+     */
+    struct TTFontBitmap {
+        TTFontGlyphMetrics metrics;
+        uint8_t *pixels;
+    };
 
     TTFont *font_load(const void *mem, size_t size);
+    /**
+     * like font_load, but reuses the parsed tables and code point index from cache_path
+     * when it matches the font content, otherwise parses the font and (re)writes the cache
+     */
+    TTFont *font_load_cached(const void *mem, size_t size, const char *cache_path);
     void font_free(TTFont *ttFont);
     void font_set_size(TTFont *ttFont, uint16_t size);
-    int font_render(TTFont *ttFont, uint32_t codepoint);
+    uint16_t font_get_size(const TTFont *ttFont);
+    uint16_t font_lookup(TTFont *ttFont, uint32_t codepoint);
+    int font_glyph_metrics(TTFont *ttFont, uint16_t glyph, TTFontGlyphMetrics *metrics);
+    /**
+     * render into a caller buffer of at least metrics.height rows of stride bytes,
+     * reuses the font's scratch, no allocation once it has grown
+     */
+    int font_render_glyph(TTFont *ttFont, uint16_t glyph, uint8_t *pixels, int stride);
+    /**
+     * render without anti-aliasing into a 1 bit per pixel bitmap, for monochrome panels
+     * a pixel is set when its center is inside the outline (non-zero winding)
+     * metrics.height rows of stride bytes, at least (metrics.width + 7) / 8, leftmost pixel in the most significant bit
+     */
+    int font_render_glyph_mono(TTFont *ttFont, uint16_t glyph, uint8_t *bits, int stride);
+    TTFontBitmap *font_render(TTFont *ttFont, uint32_t codepoint);
+    /**
+     * size explicit variants that only read the font, with a caller owned scratch context
+     * they may run on other threads next to the font_render* calls above
+     */
+    TTFontGLYFContext *font_context_new(void);
+    void font_context_free(TTFontGLYFContext *ctx);
+    int font_glyph_metrics_at(TTFont *ttFont, uint16_t glyph, uint16_t size, TTFontGlyphMetrics *metrics);
+    int font_render_glyph_at(TTFont *ttFont, TTFontGLYFContext *ctx, uint16_t glyph, uint16_t size,
+                             uint8_t *pixels, int stride);
+    int font_render_glyph_mono_at(TTFont *ttFont, TTFontGLYFContext *ctx, uint16_t glyph, uint16_t size,
+                                  uint8_t *bits, int stride);
     void font_free_bitmap(TTFontBitmap *bitmap);
 
+    /**
+     * glyph of a font set, face indexes the list given to font_set_new
+     * unmapped code points resolve to glyph 0 of face 0
+     */
+    struct TTFontSetGlyph {
+        uint16_t face;
+        uint16_t glyph;
+    };
+
+    /**
+     * ordered fallback chain over already loaded fonts, the first face mapping a code point wins
+     * faces are borrowed and must outlive the set
+     */
+    TTFontSet *font_set_new(TTFont *const *faces, int count);
+    void font_set_free(TTFontSet *set);
+    // font_set_size on every face
+    void font_set_set_size(TTFontSet *set, uint16_t size);
+    int font_set_count(const TTFontSet *set);
+    TTFont *font_set_face(const TTFontSet *set, int face);
+    // one merged lookup, no per face probing
+    TTFontSetGlyph font_set_lookup(const TTFontSet *set, uint32_t codepoint);
+
+    /**
+     * a positioned glyph of a run, metrics at its face's current size
+     * the bitmap's left edge is x + metrics.bearing_x pixels right of the run origin
+     */
+    struct TTFontRunGlyph {
+        TTFontGlyphMetrics metrics;
+        uint16_t face;
+        uint16_t glyph;
+        int32_t x;
+    };
+
+    /**
+     * resolve a whole run (e.g. a terminal row) in one pass: face and glyph, metrics, pen position
+     * and same face kerning, glyphs must hold count entries
+     * returns the run advance in pixels, -1 on a broken glyph
+     */
+    int32_t font_render_run(TTFontSet *set, const uint32_t *codepoints, int count, TTFontRunGlyph *glyphs);
+
 #ifdef __cplusplus
 }
 #endif
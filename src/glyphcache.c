@@ -0,0 +1,639 @@
+#include <stdlib.h>
+#include <string.h>
+#include "vt2000.h"
+#include "glyphcache.h"
+
+#define GLYPH_CACHE_MAX_SHELVES 128
+#define GLYPH_CACHE_ENTRIES_PER_PAGE 1024
+// new shelves are rounded up so close heights share a shelf
+#define GLYPH_CACHE_SHELF_ROUND 4
+#define GLYPH_CACHE_NONE 0xFFFFFFFFu
+
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t height;
+} GlyphCacheShelf;
+
+typedef struct {
+    uint8_t *pixels;
+    uint64_t stamp;
+    // head of the slots list living in this page
+    uint32_t slots;
+    uint16_t next_y;
+    uint16_t num_shelves;
+    GlyphCacheShelf shelves[GLYPH_CACHE_MAX_SHELVES];
+} GlyphCachePage;
+
+typedef struct {
+    GlyphCacheEntry entry;
+    uint64_t key;
+    // next slot of the same page, or of the free list
+    uint32_t next;
+    uint32_t page;
+} GlyphCacheSlot;
+
+struct GlyphCache {
+    GlyphCachePage *pages;
+    uint32_t num_pages;
+    uint32_t max_pages;
+    GlyphCacheSlot *slots;
+    uint32_t free_slots;
+    // open addressing, slot index or GLYPH_CACHE_NONE
+    uint32_t *table;
+    uint32_t table_mask;
+    uint64_t clock;
+    uint8_t *scratch;
+    size_t cap_scratch;
+    uint8_t format;
+    // bytes per atlas row, a page is GLYPH_CACHE_PAGE_SIZE rows
+    uint32_t page_stride;
+};
+
+static inline uint64_t cache_key(uint16_t font_id, uint16_t glyph, uint16_t size, uint8_t style)
+{
+    return (uint64_t) font_id << 40 | (uint64_t) glyph << 24 | (uint64_t) size << 8 | style;
+}
+
+static inline uint32_t cache_hash(const GlyphCache *cache, uint64_t key)
+{
+    key *= 0x9e3779b97f4a7c15ULL;
+    return (uint32_t) (key >> 32) & cache->table_mask;
+}
+
+static uint32_t table_find(const GlyphCache *cache, uint64_t key)
+{
+    uint32_t i = cache_hash(cache, key), slot;
+    while ((slot = cache->table[i]) != GLYPH_CACHE_NONE) {
+        if (cache->slots[slot].key == key) {
+            return i;
+        }
+        i = (i + 1) & cache->table_mask;
+    }
+    return GLYPH_CACHE_NONE;
+}
+
+static void table_insert(GlyphCache *cache, uint32_t slot)
+{
+    uint32_t i = cache_hash(cache, cache->slots[slot].key);
+    while (cache->table[i] != GLYPH_CACHE_NONE) {
+        i = (i + 1) & cache->table_mask;
+    }
+    cache->table[i] = slot;
+}
+
+// backward shift deletion, keeps probe chains intact without tombstones
+static void table_remove(GlyphCache *cache, uint64_t key)
+{
+    uint32_t i, j, k;
+    if ((i = table_find(cache, key)) == GLYPH_CACHE_NONE) {
+        return;
+    }
+    j = i;
+    for (;;) {
+        j = (j + 1) & cache->table_mask;
+        if (cache->table[j] == GLYPH_CACHE_NONE) {
+            break;
+        }
+        k = cache_hash(cache, cache->slots[cache->table[j]].key);
+        // entry at j may move to i only if its home k is not cyclically within (i, j]
+        if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+            cache->table[i] = cache->table[j];
+            i = j;
+        }
+    }
+    cache->table[i] = GLYPH_CACHE_NONE;
+}
+
+static void page_reset(GlyphCache *cache, GlyphCachePage *page)
+{
+    uint32_t slot, next;
+    for (slot = page->slots; slot != GLYPH_CACHE_NONE; slot = next) {
+        next = cache->slots[slot].next;
+        table_remove(cache, cache->slots[slot].key);
+        cache->slots[slot].next = cache->free_slots;
+        cache->free_slots = slot;
+    }
+    page->slots = GLYPH_CACHE_NONE;
+    page->next_y = 0;
+    page->num_shelves = 0;
+}
+
+static GlyphCachePage *page_lru(GlyphCache *cache)
+{
+    GlyphCachePage *lru = NULL;
+    uint32_t i;
+    for (i = 0; i < cache->num_pages; ++i) {
+        if (!lru || cache->pages[i].stamp < lru->stamp) {
+            lru = cache->pages + i;
+        }
+    }
+    return lru;
+}
+
+static GlyphCachePage *page_mru(GlyphCache *cache)
+{
+    GlyphCachePage *mru = NULL;
+    uint32_t i;
+    for (i = 0; i < cache->num_pages; ++i) {
+        if (!mru || cache->pages[i].stamp > mru->stamp) {
+            mru = cache->pages + i;
+        }
+    }
+    return mru;
+}
+
+static int shelf_alloc(GlyphCachePage *page, uint16_t width, uint16_t height, uint16_t *x, uint16_t *y)
+{
+    GlyphCacheShelf *shelf, *best = NULL;
+    uint16_t i, rounded;
+
+    if (width == 0 || height == 0) {
+        *x = *y = 0;
+        return 0;
+    }
+    // best fit over existing shelves
+    for (i = 0; i < page->num_shelves; ++i) {
+        shelf = page->shelves + i;
+        if (shelf->height >= height && shelf->x + width <= GLYPH_CACHE_PAGE_SIZE
+            && (!best || shelf->height < best->height)) {
+            best = shelf;
+        }
+    }
+    if (!best) {
+        rounded = (uint16_t) ((height + GLYPH_CACHE_SHELF_ROUND - 1) / GLYPH_CACHE_SHELF_ROUND * GLYPH_CACHE_SHELF_ROUND);
+        if (page->next_y + rounded > GLYPH_CACHE_PAGE_SIZE) {
+            rounded = height;
+        }
+        if (page->num_shelves >= GLYPH_CACHE_MAX_SHELVES || page->next_y + rounded > GLYPH_CACHE_PAGE_SIZE) {
+            return -1;
+        }
+        best = page->shelves + page->num_shelves++;
+        best->x = 0;
+        best->y = page->next_y;
+        best->height = rounded;
+        page->next_y = (uint16_t) (page->next_y + rounded);
+    }
+    *x = best->x;
+    *y = best->y;
+    best->x = (uint16_t) (best->x + width);
+    return 0;
+}
+
+/**
+ * find room for width * height, growing the page set up to max_pages and
+ * evicting the least recently used page after that
+ */
+static GlyphCachePage *cache_alloc(GlyphCache *cache, uint16_t width, uint16_t height, uint16_t *x, uint16_t *y)
+{
+    GlyphCachePage *page;
+    uint32_t i;
+
+    for (i = 0; i < cache->num_pages; ++i) {
+        if (shelf_alloc(cache->pages + i, width, height, x, y) == 0) {
+            return cache->pages + i;
+        }
+    }
+    if (cache->num_pages < cache->max_pages) {
+        page = cache->pages + cache->num_pages;
+        if ((page->pixels = VT_malloc((size_t) cache->page_stride * GLYPH_CACHE_PAGE_SIZE))) {
+            cache->num_pages++;
+            page->slots = GLYPH_CACHE_NONE;
+            page->next_y = 0;
+            page->num_shelves = 0;
+            page->stamp = cache->clock;
+            if (shelf_alloc(page, width, height, x, y) == 0) {
+                return page;
+            }
+        }
+    }
+    if (!(page = page_lru(cache))) {
+        return NULL;
+    }
+    page_reset(cache, page);
+    return shelf_alloc(page, width, height, x, y) == 0 ? page : NULL;
+}
+
+static uint32_t slot_alloc(GlyphCache *cache)
+{
+    GlyphCachePage *page;
+    uint32_t slot, i;
+
+    if (cache->free_slots == GLYPH_CACHE_NONE) {
+        // out of entries, drop the least recently used page that holds any
+        page = NULL;
+        for (i = 0; i < cache->num_pages; ++i) {
+            if (cache->pages[i].slots != GLYPH_CACHE_NONE && (!page || cache->pages[i].stamp < page->stamp)) {
+                page = cache->pages + i;
+            }
+        }
+        if (!page) {
+            return GLYPH_CACHE_NONE;
+        }
+        page_reset(cache, page);
+    }
+    slot = cache->free_slots;
+    cache->free_slots = cache->slots[slot].next;
+    return slot;
+}
+
+/**
+ * synthetic styles applied while copying from scratch into the atlas
+ * bold smears one pixel to the right, italic shears by a quarter pixel per row
+ */
+static void style_copy(const uint8_t *src, uint16_t srcWidth, uint16_t height, uint8_t style,
+                       uint8_t *dst, int stride, uint16_t width)
+{
+    uint16_t x, y, shift;
+    uint8_t value, prev;
+    for (y = 0; y < height; ++y, src += srcWidth, dst += stride) {
+        memset(dst, 0, width);
+        shift = (style & GLYPH_STYLE_ITALIC) ? (uint16_t) ((height - 1 - y) / 4) : 0;
+        prev = 0;
+        for (x = 0; x < srcWidth; ++x) {
+            value = src[x];
+            dst[x + shift] = (style & GLYPH_STYLE_BOLD) && prev > value ? prev : value;
+            prev = value;
+        }
+        if (style & GLYPH_STYLE_BOLD) {
+            dst[srcWidth + shift] = prev;
+        }
+    }
+}
+
+// dst |= src moved shift pixels to the right, 1 bit rows
+static void mono_or_shifted(uint8_t *dst, uint16_t dstBytes, const uint8_t *src, uint16_t srcBytes, uint16_t shift)
+{
+    uint16_t i, skip = shift >> 3, bit = shift & 7;
+    for (i = 0; i < srcBytes && i + skip < dstBytes; ++i) {
+        dst[i + skip] |= (uint8_t) (src[i] >> bit);
+        if (bit && i + skip + 1 < dstBytes) {
+            dst[i + skip + 1] |= (uint8_t) (src[i] << (8 - bit));
+        }
+    }
+}
+
+// style_copy for GLYPH_FORMAT_MONO, bold ors in the row once more one pixel to the right
+static void style_copy_mono(const uint8_t *src, uint16_t srcWidth, uint16_t height, uint8_t style,
+                            uint8_t *dst, int stride, uint16_t width)
+{
+    uint16_t y, shift, srcBytes = (uint16_t) ((srcWidth + 7) / 8), dstBytes = (uint16_t) ((width + 7) / 8);
+    for (y = 0; y < height; ++y, src += srcBytes, dst += stride) {
+        memset(dst, 0, dstBytes);
+        shift = (style & GLYPH_STYLE_ITALIC) ? (uint16_t) ((height - 1 - y) / 4) : 0;
+        mono_or_shifted(dst, dstBytes, src, srcBytes, shift);
+        if (style & GLYPH_STYLE_BOLD) {
+            mono_or_shifted(dst, dstBytes, src, srcBytes, (uint16_t) (shift + 1));
+        }
+    }
+}
+
+GlyphCache *glyph_cache_new(int max_pages)
+{
+    return glyph_cache_new_format(max_pages, GLYPH_FORMAT_COVERAGE);
+}
+
+GlyphCache *glyph_cache_new_format(int max_pages, uint8_t format)
+{
+    GlyphCache *cache;
+    uint32_t numSlots, tableSize, i;
+
+    if (max_pages <= 0 || format > GLYPH_FORMAT_MONO) {
+        return NULL;
+    }
+    if (!(cache = VT_malloc(sizeof *cache))) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof *cache);
+    cache->max_pages = (uint32_t) max_pages;
+    cache->format = format;
+    cache->page_stride = format == GLYPH_FORMAT_MONO ? GLYPH_CACHE_PAGE_SIZE / 8 : GLYPH_CACHE_PAGE_SIZE;
+    numSlots = cache->max_pages * GLYPH_CACHE_ENTRIES_PER_PAGE;
+    // keep the load factor at or below one half
+    for (tableSize = 1; tableSize < 2 * numSlots; tableSize *= 2);
+    cache->table_mask = tableSize - 1;
+
+    cache->pages = VT_malloc(sizeof(*cache->pages) * cache->max_pages);
+    cache->slots = VT_malloc(sizeof(*cache->slots) * numSlots);
+    cache->table = VT_malloc(sizeof(*cache->table) * tableSize);
+    if (!cache->pages || !cache->slots || !cache->table) {
+        glyph_cache_free(cache);
+        return NULL;
+    }
+    memset(cache->table, 0xFF, sizeof(*cache->table) * tableSize);
+    for (i = 0; i < numSlots; ++i) {
+        cache->slots[i].next = i + 1 < numSlots ? i + 1 : GLYPH_CACHE_NONE;
+    }
+    cache->free_slots = 0;
+    return cache;
+}
+
+void glyph_cache_free(GlyphCache *cache)
+{
+    uint32_t i;
+    if (!cache) return;
+    for (i = 0; i < cache->num_pages; ++i) {
+        VT_free(cache->pages[i].pixels);
+    }
+    VT_free(cache->pages);
+    VT_free(cache->slots);
+    VT_free(cache->table);
+    VT_free(cache->scratch);
+    VT_free(cache);
+}
+
+void glyph_cache_clear(GlyphCache *cache)
+{
+    uint32_t i;
+    for (i = 0; i < cache->num_pages; ++i) {
+        page_reset(cache, cache->pages + i);
+    }
+}
+
+/**
+ * reserve an entry slot and atlas room for width * height, the entry is only
+ * visible to lookups after cache_commit
+ * mono glyphs are given whole bytes, so every row starts on a byte
+ */
+static GlyphCacheSlot *cache_reserve(GlyphCache *cache, uint16_t width, uint16_t height, uint8_t **pixels)
+{
+    GlyphCacheSlot *slot;
+    GlyphCachePage *page;
+    uint32_t slotIndex;
+    uint16_t x, y;
+
+    if (width > GLYPH_CACHE_PAGE_SIZE || height > GLYPH_CACHE_PAGE_SIZE) {
+        return NULL;
+    }
+    if ((slotIndex = slot_alloc(cache)) == GLYPH_CACHE_NONE) {
+        return NULL;
+    }
+    slot = cache->slots + slotIndex;
+    // blank glyphs take no atlas space and are filed under the most recent page
+    page = NULL;
+    x = y = 0;
+    if (width == 0 || height == 0) {
+        page = page_mru(cache);
+    } else if (cache->format == GLYPH_FORMAT_MONO) {
+        width = (uint16_t) ((width + 7) & ~7);
+    }
+    if (!page && !(page = cache_alloc(cache, width, height, &x, &y))) {
+        slot->next = cache->free_slots;
+        cache->free_slots = slotIndex;
+        return NULL;
+    }
+    slot->page = (uint32_t) (page - cache->pages);
+    if (cache->format == GLYPH_FORMAT_MONO) {
+        x /= 8;
+    }
+    *pixels = page->pixels + (size_t) y * cache->page_stride + x;
+    return slot;
+}
+
+static const GlyphCacheEntry *cache_commit(GlyphCache *cache, GlyphCacheSlot *slot, uint64_t key,
+                                           const TTFontGlyphMetrics *metrics, uint8_t *pixels)
+{
+    GlyphCachePage *page = cache->pages + slot->page;
+    uint32_t slotIndex = (uint32_t) (slot - cache->slots);
+
+    slot->entry.metrics = *metrics;
+    slot->entry.pixels = pixels;
+    slot->entry.stride = (int) cache->page_stride;
+    slot->entry.format = cache->format;
+    slot->key = key;
+    slot->next = page->slots;
+    page->slots = slotIndex;
+    page->stamp = cache->clock;
+    table_insert(cache, slotIndex);
+    return &slot->entry;
+}
+
+// the atlas area stays unused until the page is evicted
+static void cache_release(GlyphCache *cache, GlyphCacheSlot *slot)
+{
+    slot->next = cache->free_slots;
+    cache->free_slots = (uint32_t) (slot - cache->slots);
+}
+
+static const GlyphCacheEntry *cache_find(GlyphCache *cache, uint64_t key)
+{
+    GlyphCacheSlot *slot;
+    uint32_t index;
+
+    cache->clock++;
+    if ((index = table_find(cache, key)) == GLYPH_CACHE_NONE) {
+        return NULL;
+    }
+    slot = cache->slots + cache->table[index];
+    cache->pages[slot->page].stamp = cache->clock;
+    return &slot->entry;
+}
+
+const GlyphCacheEntry *glyph_cache_get(GlyphCache *cache, TTFont *font, uint16_t font_id,
+                                       uint16_t glyph, uint8_t style)
+{
+    const GlyphCacheEntry *entry;
+    TTFontGlyphMetrics metrics;
+    GlyphCacheSlot *slot;
+    uint64_t key = cache_key(font_id, glyph, font_get_size(font), style);
+    uint16_t width, height;
+    uint8_t *pixels;
+    size_t area;
+
+    if ((entry = cache_find(cache, key))) {
+        return entry;
+    }
+    if (font_glyph_metrics(font, glyph, &metrics) < 0) {
+        return NULL;
+    }
+    width = metrics.width;
+    height = metrics.height;
+    if (width && height) {
+        if (style & GLYPH_STYLE_BOLD) {
+            width += 1;
+        }
+        if (style & GLYPH_STYLE_ITALIC) {
+            width = (uint16_t) (width + (height - 1) / 4);
+        }
+    } else {
+        width = height = 0;
+    }
+    if (!(slot = cache_reserve(cache, width, height, &pixels))) {
+        return NULL;
+    }
+
+    if (width && height && cache->format == GLYPH_FORMAT_MONO) {
+        if (style == GLYPH_STYLE_REGULAR) {
+            if (font_render_glyph_mono(font, glyph, pixels, (int) cache->page_stride) < 0) {
+                goto failure;
+            }
+        } else {
+            area = (size_t) (metrics.width + 7) / 8 * metrics.height;
+            if (area > cache->cap_scratch) {
+                VT_free(cache->scratch);
+                if (!(cache->scratch = VT_malloc(area))) {
+                    cache->cap_scratch = 0;
+                    goto failure;
+                }
+                cache->cap_scratch = area;
+            }
+            if (font_render_glyph_mono(font, glyph, cache->scratch, (metrics.width + 7) / 8) < 0) {
+                goto failure;
+            }
+            style_copy_mono(cache->scratch, metrics.width, metrics.height, style, pixels, (int) cache->page_stride,
+                            width);
+        }
+    } else if (width && height) {
+        if (style == GLYPH_STYLE_REGULAR) {
+            if (font_render_glyph(font, glyph, pixels, GLYPH_CACHE_PAGE_SIZE) < 0) {
+                goto failure;
+            }
+        } else {
+            area = (size_t) metrics.width * metrics.height;
+            if (area > cache->cap_scratch) {
+                VT_free(cache->scratch);
+                if (!(cache->scratch = VT_malloc(area))) {
+                    cache->cap_scratch = 0;
+                    goto failure;
+                }
+                cache->cap_scratch = area;
+            }
+            if (font_render_glyph(font, glyph, cache->scratch, metrics.width) < 0) {
+                goto failure;
+            }
+            style_copy(cache->scratch, metrics.width, metrics.height, style, pixels, GLYPH_CACHE_PAGE_SIZE, width);
+        }
+    }
+    metrics.width = width;
+    metrics.height = height;
+    return cache_commit(cache, slot, key, &metrics, pixels);
+
+failure:
+    cache_release(cache, slot);
+    return NULL;
+}
+
+int glyph_cache_put(GlyphCache *cache, uint16_t font_id, uint16_t glyph, uint16_t size, uint8_t style,
+                    const TTFontGlyphMetrics *metrics, const uint8_t *pixels, int stride)
+{
+    GlyphCacheSlot *slot;
+    uint64_t key = cache_key(font_id, glyph, size, style);
+    const uint8_t *src;
+    uint8_t *dst, *row;
+    uint16_t x, y;
+
+    if (cache_find(cache, key)) {
+        return 0;
+    }
+    if (!(slot = cache_reserve(cache, metrics->width, metrics->height, &dst))) {
+        return -1;
+    }
+    if (metrics->width && metrics->height && cache->format == GLYPH_FORMAT_MONO) {
+        for (y = 0; y < metrics->height; ++y) {
+            src = pixels + (size_t) y * stride;
+            row = dst + (size_t) y * cache->page_stride;
+            memset(row, 0, (metrics->width + 7) / 8);
+            for (x = 0; x < metrics->width; ++x) {
+                row[x >> 3] |= (uint8_t) ((src[x] >> 7) << (7 - (x & 7)));
+            }
+        }
+    } else if (metrics->width && metrics->height) {
+        for (y = 0; y < metrics->height; ++y) {
+            memcpy(dst + (size_t) y * GLYPH_CACHE_PAGE_SIZE, pixels + (size_t) y * stride, metrics->width);
+        }
+    }
+    cache_commit(cache, slot, key, metrics, dst);
+    return 0;
+}
+
+/**
+ * glyph_cache_blit of a GLYPH_FORMAT_MONO entry, clipped to [x0, x1) x [y0, y1)
+ * a byte of the glyph covers eight pixels, blank ones are skipped whole
+ */
+static void blit_mono(const GlyphCacheEntry *entry, uint32_t *dst, int stride, int x0, int y0, int x1, int y1,
+                      int x, int y, uint32_t color)
+{
+    const uint8_t *src;
+    uint32_t *out, rgb = color & 0x00ffffff;
+    int i, j, k, n, bit;
+    uint8_t bits;
+
+    for (j = y0; j < y1; ++j) {
+        src = entry->pixels + (size_t) (j - y) * entry->stride;
+        out = dst + (size_t) j * stride;
+        for (i = x0; i < x1; i += n) {
+            bit = i - x;
+            bits = (uint8_t) (src[bit >> 3] << (bit & 7));
+            n = 8 - (bit & 7);
+            n = n > x1 - i ? x1 - i : n;
+            for (k = 0; k < n && bits; ++k, bits = (uint8_t) (bits << 1)) {
+                if (bits & 0x80) {
+                    out[i + k] = (out[i + k] & 0xff000000) | rgb;
+                }
+            }
+        }
+    }
+}
+
+void glyph_cache_blit(const GlyphCacheEntry *entry, uint32_t *dst, int stride, int width, int height,
+                      int x, int y, uint32_t color)
+{
+    const uint8_t *src;
+    uint32_t *out, pixel, alpha, inverse, rb, g;
+    int x0, y0, x1, y1, i, j;
+
+    x0 = x < 0 ? 0 : x;
+    y0 = y < 0 ? 0 : y;
+    x1 = x + entry->metrics.width > width ? width : x + entry->metrics.width;
+    y1 = y + entry->metrics.height > height ? height : y + entry->metrics.height;
+    if (entry->format == GLYPH_FORMAT_MONO) {
+        blit_mono(entry, dst, stride, x0, y0, x1, y1, x, y, color);
+        return;
+    }
+    for (j = y0; j < y1; ++j) {
+        src = entry->pixels + (size_t) (j - y) * entry->stride + (x0 - x);
+        out = dst + (size_t) j * stride;
+        for (i = x0; i < x1; ++i) {
+            alpha = *src++;
+            if (alpha == 0) {
+                continue;
+            }
+            if (alpha == 255) {
+                out[i] = (out[i] & 0xff000000) | (color & 0x00ffffff);
+                continue;
+            }
+            // red and blue in one multiply, x / 255 ~ (x + 1 + (x >> 8)) >> 8
+            pixel = out[i];
+            inverse = 255 - alpha;
+            rb = (color & 0x00ff00ff) * alpha + (pixel & 0x00ff00ff) * inverse + 0x00800080;
+            rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+            g = (color & 0x0000ff00) * alpha + (pixel & 0x0000ff00) * inverse + 0x00008000;
+            g = ((g + ((g >> 8) & 0x0000ff00)) >> 8) & 0x0000ff00;
+            out[i] = (pixel & 0xff000000) | rb | g;
+        }
+    }
+}
+
+int glyph_cache_draw_run(GlyphCache *cache, TTFontSet *set, const TTFontRunGlyph *glyphs, int count,
+                         uint8_t style, uint32_t *dst, int stride, int width, int height,
+                         int x, int y, uint32_t color)
+{
+    const GlyphCacheEntry *entry;
+    const TTFontRunGlyph *glyph;
+    int i, missed = 0;
+
+    for (i = 0; i < count; ++i) {
+        glyph = glyphs + i;
+        if (!glyph->metrics.width || !glyph->metrics.height) {
+            continue;
+        }
+        // blitted right away, a later miss in the run may evict this entry's page
+        if (!(entry = glyph_cache_get(cache, font_set_face(set, glyph->face), glyph->face, glyph->glyph, style))) {
+            ++missed;
+            continue;
+        }
+        glyph_cache_blit(entry, dst, stride, width, height, x + glyph->x + entry->metrics.bearing_x,
+                         y - entry->metrics.bearing_y, color);
+    }
+    return missed;
+}
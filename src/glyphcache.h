@@ -0,0 +1,81 @@
+/**
+ * rasterized glyph cache
+ * coverage bitmaps are shelf packed into a few atlas pages,
+ * keyed by (font id, glyph, pixel size, synthetic style), evicted a whole page at a time
+ * not thread safe, owned by the render thread
+ */
+
+#ifndef VT2000_GLYPHCACHE_H
+#define VT2000_GLYPHCACHE_H
+
+#include <stdint.h>
+#include "font.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GLYPH_STYLE_REGULAR 0x00
+#define GLYPH_STYLE_BOLD    0x01
+#define GLYPH_STYLE_ITALIC  0x02
+
+// atlas page edge in pixels
+#define GLYPH_CACHE_PAGE_SIZE 512
+
+// pixel format of a cache, fixed when it is created
+// one byte of coverage per pixel
+#define GLYPH_FORMAT_COVERAGE 0
+// one bit per pixel, no anti-aliasing, for monochrome panels, an eighth of the atlas memory
+#define GLYPH_FORMAT_MONO     1
+
+    typedef struct GlyphCache GlyphCache;
+    typedef struct GlyphCacheEntry GlyphCacheEntry;
+
+    /**
+     * a cached glyph, pixels points into an atlas page with rows of stride bytes
+     * GLYPH_FORMAT_MONO rows are bits, leftmost pixel in the most significant bit of the first byte
+     * valid until the next glyph_cache_get on the same cache
+     */
+    struct GlyphCacheEntry {
+        TTFontGlyphMetrics metrics;
+        const uint8_t *pixels;
+        int stride;
+        uint8_t format;
+    };
+
+    // a GLYPH_FORMAT_COVERAGE cache
+    GlyphCache *glyph_cache_new(int max_pages);
+    GlyphCache *glyph_cache_new_format(int max_pages, uint8_t format);
+    void glyph_cache_free(GlyphCache *cache);
+    void glyph_cache_clear(GlyphCache *cache);
+    /**
+     * look up a glyph at the font's current size, rasterizing it into the atlas on a miss
+     * NULL if it can not be rendered or is larger than a page
+     */
+    const GlyphCacheEntry *glyph_cache_get(GlyphCache *cache, TTFont *font, uint16_t font_id,
+                                           uint16_t glyph, uint8_t style);
+    /**
+     * insert an already rendered glyph (e.g. from a background worker), no-op if present
+     * pixels are 8-bit coverage either way, a GLYPH_FORMAT_MONO cache sets the pixels of at least half coverage
+     */
+    int glyph_cache_put(GlyphCache *cache, uint16_t font_id, uint16_t glyph, uint16_t size, uint8_t style,
+                        const TTFontGlyphMetrics *metrics, const uint8_t *pixels, int stride);
+    /**
+     * blend color (0xAARRGGBB, alpha ignored) over a 32-bit framebuffer with the glyph coverage,
+     * or set the glyph's pixels to it for GLYPH_FORMAT_MONO
+     * x y is the top left corner of the glyph bitmap, clipped to width * height
+     */
+    void glyph_cache_blit(const GlyphCacheEntry *entry, uint32_t *dst, int stride, int width, int height,
+                          int x, int y, uint32_t color);
+    /**
+     * fetch and blit a run from font_render_run, glyphs keyed by (face, glyph) of the set
+     * x y is the run origin on the baseline, returns the number of glyphs that could not be drawn
+     */
+    int glyph_cache_draw_run(GlyphCache *cache, TTFontSet *set, const TTFontRunGlyph *glyphs, int count,
+                             uint8_t style, uint32_t *dst, int stride, int width, int height,
+                             int x, int y, uint32_t color);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //VT2000_GLYPHCACHE_H
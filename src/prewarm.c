@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "vt2000.h"
+#include "backend.h"
+#include "prewarm.h"
+
+// power of two, finished glyphs waiting for the render thread
+#define PREWARM_QUEUE_SIZE 256
+#define PREWARM_QUEUE_MASK (PREWARM_QUEUE_SIZE - 1)
+
+#if defined(_MSC_VER)
+# define WIN32_LEAN_AND_MEAN 1
+# include <windows.h>
+# define PREWARM_LOAD(p) ((uint32_t) InterlockedCompareExchange((volatile LONG *) (p), 0, 0))
+# define PREWARM_STORE(p, v) InterlockedExchange((volatile LONG *) (p), (LONG) (v))
+#else
+# define PREWARM_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+# define PREWARM_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+typedef struct {
+    TTFontGlyphMetrics metrics;
+    uint16_t glyph;
+    // width * height bytes, NULL for blank glyphs
+    uint8_t *pixels;
+} GlyphPrewarmItem;
+
+struct GlyphPrewarm {
+    TTFont *font;
+    TTFontGLYFContext *ctx;
+    uint32_t *codepoints;
+    size_t count;
+    uint16_t font_id;
+    uint16_t size;
+    // head is only written by the worker, tail only by the render thread
+    uint32_t head;
+    uint32_t tail;
+    uint32_t cancel;
+    uint32_t finished;
+    GlyphPrewarmItem queue[PREWARM_QUEUE_SIZE];
+    VTThread *thread;
+};
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} GlyphPrewarmRange;
+
+static const GlyphPrewarmRange default_ranges[] = {
+    {0x0020, 0x007E}, // ASCII
+    {0x00A0, 0x00FF}, // Latin-1
+    {0x2500, 0x257F}, // box drawing
+    {0x2580, 0x259F}, // block elements
+    {0x3000, 0x3011}, // CJK punctuation
+    {0xFF01, 0xFF1F}, // full width punctuation and digits
+};
+
+// most frequent hanzi in modern Chinese text, in order
+static const uint16_t default_hanzi[] = {
+    0x7684, 0x4e00, 0x662f, 0x4e0d, 0x4e86, 0x5728, 0x4eba, 0x6709, 0x6211, 0x4ed6,
+    0x8fd9, 0x4e2a, 0x4eec, 0x4e2d, 0x6765, 0x4e0a, 0x5927, 0x4e3a, 0x548c, 0x56fd,
+    0x5730, 0x5230, 0x4ee5, 0x8bf4, 0x65f6, 0x8981, 0x5c31, 0x51fa, 0x4f1a, 0x53ef,
+    0x4e5f, 0x4f60, 0x5bf9, 0x751f, 0x80fd, 0x800c, 0x5b50, 0x90a3, 0x5f97, 0x4e8e,
+    0x7740, 0x4e0b, 0x81ea, 0x4e4b, 0x5e74, 0x8fc7, 0x53d1, 0x540e, 0x4f5c, 0x91cc,
+    0x7528, 0x9053, 0x884c, 0x6240, 0x7136, 0x5bb6, 0x79cd, 0x4e8b, 0x6210, 0x65b9,
+    0x591a, 0x7ecf, 0x4e48, 0x53bb, 0x6cd5, 0x5b66, 0x5982, 0x90fd, 0x540c, 0x73b0,
+    0x5f53, 0x6ca1, 0x52a8, 0x9762, 0x8d77, 0x770b, 0x5b9a, 0x5929, 0x5206, 0x8fd8,
+    0x8fdb, 0x597d, 0x5c0f, 0x90e8, 0x5176, 0x4e9b, 0x4e3b, 0x6837, 0x7406, 0x5fc3,
+    0x5979, 0x672c, 0x524d, 0x5f00, 0x4f46, 0x56e0, 0x53ea, 0x4ece, 0x60f3, 0x5b9e,
+    0x65e5, 0x519b, 0x8005, 0x610f, 0x65e0, 0x529b, 0x5b83, 0x4e0e, 0x957f, 0x628a,
+    0x673a, 0x5341, 0x6c11, 0x7b2c, 0x516c, 0x6b64, 0x5df2, 0x5de5, 0x4f7f, 0x60c5,
+    0x660e, 0x6027, 0x77e5, 0x5168, 0x4e09, 0x53c8, 0x5173, 0x70b9, 0x6b63, 0x4e1a,
+    0x5916, 0x5c06, 0x4e24, 0x9ad8, 0x95f4, 0x7531, 0x95ee, 0x5f88, 0x6700, 0x91cd,
+    0x5e76, 0x7269, 0x624b, 0x5e94, 0x6218, 0x5411, 0x5934, 0x6587, 0x4f53, 0x653f,
+    0x7f8e, 0x76f8, 0x89c1, 0x88ab, 0x5229, 0x4ec0, 0x4e8c, 0x7b49, 0x4ea7, 0x6216,
+    0x65b0, 0x5df1, 0x5236, 0x8eab, 0x679c, 0x52a0, 0x897f, 0x65af, 0x6708, 0x8bdd,
+    0x5408, 0x56de, 0x7279, 0x4ee3, 0x5185, 0x4fe1, 0x8868, 0x5316, 0x8001, 0x7ed9,
+    0x4e16, 0x4f4d, 0x6b21, 0x5ea6, 0x95e8, 0x4efb, 0x5e38, 0x5148, 0x6d77, 0x901a,
+    0x6559, 0x513f, 0x539f, 0x4e1c, 0x58f0, 0x63d0, 0x7acb, 0x53ca, 0x6bd4, 0x5458,
+    0x89e3, 0x6c34, 0x540d, 0x771f, 0x8bba, 0x5904, 0x8d70, 0x4e49, 0x5404, 0x5165,
+    0x51e0, 0x53e3, 0x8ba4, 0x6761, 0x5e73, 0x7cfb, 0x6c14, 0x9898, 0x6d3b, 0x5c14,
+    0x66f4, 0x522b, 0x6253, 0x5973, 0x53d8, 0x56db, 0x795e, 0x603b, 0x4f55, 0x7535,
+    0x6570, 0x5b89, 0x5c11, 0x62a5, 0x624d, 0x7ed3, 0x53cd, 0x53d7, 0x76ee, 0x592a,
+    0x91cf, 0x518d, 0x611f, 0x5efa, 0x52a1, 0x505a, 0x63a5, 0x5fc5, 0x573a, 0x4ef6,
+    0x8ba1, 0x7ba1, 0x671f, 0x5e02, 0x76f4, 0x5fb7, 0x8d44, 0x547d, 0x5c71, 0x91d1,
+    0x6307, 0x514b, 0x8bb8, 0x7edf, 0x533a, 0x4fdd, 0x81f3, 0x961f, 0x5f62, 0x793e,
+    0x4fbf, 0x7a7a, 0x51b3, 0x6cbb, 0x5c55, 0x9a6c, 0x79d1, 0x53f8, 0x4e94, 0x57fa,
+    0x773c, 0x4e66, 0x975e, 0x5219, 0x542c, 0x767d, 0x5374, 0x754c, 0x8fbe, 0x5149,
+    0x653e, 0x5f3a, 0x5373, 0x50cf, 0x96be, 0x4e14, 0x6743, 0x601d, 0x738b, 0x8c61,
+    0x5b8c, 0x8bbe, 0x5f0f, 0x8272, 0x8def, 0x8bb0, 0x5357, 0x54c1, 0x4f4f, 0x544a,
+    0x7c7b, 0x6c42, 0x636e, 0x7a0b, 0x5317, 0x8fb9, 0x6b7b, 0x5f20, 0x8be5, 0x4ea4,
+    0x89c4, 0x4e07, 0x53d6, 0x62c9, 0x683c, 0x671b, 0x89c9, 0x672f, 0x9886, 0x5171,
+    0x786e, 0x4f20, 0x5e08, 0x89c2, 0x6e05, 0x4eca, 0x5207, 0x9662, 0x8ba9, 0x8bc6,
+    0x5019, 0x5e26, 0x5bfc, 0x4e89, 0x8fd0, 0x7b11, 0x98de, 0x98ce, 0x6b65, 0x6539,
+    0x6536, 0x6839, 0x5e72, 0x9020, 0x8a00, 0x8054, 0x6301, 0x7ec4, 0x6bcf, 0x6d4e,
+    0x8f66, 0x4eb2, 0x6781, 0x6797, 0x670d, 0x5feb, 0x529e, 0x8bae, 0x5f80, 0x5143,
+    0x82f1, 0x58eb, 0x8bc1, 0x8fd1, 0x5931, 0x8f6c, 0x592b, 0x4ee4, 0x51c6, 0x5e03,
+    0x59cb, 0x600e, 0x5462, 0x5b58, 0x672a, 0x8fdc, 0x53eb, 0x53f0, 0x5355, 0x5f71,
+    0x5177, 0x7f57, 0x5b57, 0x7231, 0x51fb, 0x6d41, 0x5907, 0x5175, 0x8fde, 0x8c03,
+    0x6df1, 0x5546, 0x7b97, 0x8d28, 0x56e2, 0x96c6, 0x767e, 0x9700, 0x4ef7, 0x82b1,
+    0x515a, 0x534e, 0x57ce, 0x77f3, 0x7ea7, 0x6574, 0x5e9c, 0x79bb, 0x51b5, 0x4e9a,
+    0x8bf7, 0x6280, 0x9645, 0x7ea6, 0x793a, 0x590d, 0x75c5, 0x606f, 0x7a76, 0x7ebf,
+    0x4f3c, 0x5b98, 0x706b, 0x65ad, 0x7cbe, 0x6ee1, 0x652f, 0x89c6, 0x6d88, 0x8d8a,
+    0x5668, 0x5bb9, 0x7167, 0x987b, 0x4e5d, 0x589e, 0x7814, 0x5199, 0x79f0, 0x4f01,
+    0x516b, 0x529f, 0x5417, 0x5305, 0x7247, 0x53f2, 0x59d4, 0x4e4e, 0x67e5, 0x8f7b,
+    0x6613, 0x65e9, 0x66fe, 0x9664, 0x519c, 0x627e, 0x88c5, 0x5e7f, 0x663e, 0x5427,
+    0x963f, 0x674e, 0x6807, 0x8c08, 0x5403, 0x56fe, 0x5ff5, 0x516d, 0x5f15, 0x5386,
+    0x9996, 0x533b, 0x5c40, 0x7a81, 0x4e13, 0x8d39, 0x53f7, 0x5c3d, 0x53e6, 0x5468,
+    0x8f83, 0x6ce8, 0x8bed, 0x4ec5, 0x8003, 0x843d, 0x9752, 0x968f, 0x9009, 0x5217,
+};
+
+static int prewarm_render(GlyphPrewarm *prewarm, uint32_t codepoint, GlyphPrewarmItem *item)
+{
+    size_t bytes;
+
+    if (!(item->glyph = font_lookup(prewarm->font, codepoint))) {
+        return -1;
+    }
+    if (font_glyph_metrics_at(prewarm->font, item->glyph, prewarm->size, &item->metrics) < 0) {
+        return -1;
+    }
+    item->pixels = NULL;
+    bytes = (size_t) item->metrics.width * item->metrics.height;
+    if (!bytes) {
+        return 0;
+    }
+    if (!(item->pixels = VT_malloc(bytes))) {
+        return -1;
+    }
+    if (font_render_glyph_at(prewarm->font, prewarm->ctx, item->glyph, prewarm->size,
+                             item->pixels, item->metrics.width) < 0) {
+        VT_free(item->pixels);
+        return -1;
+    }
+    return 0;
+}
+
+static void prewarm_run(void *param)
+{
+    GlyphPrewarm *prewarm = (GlyphPrewarm *) param;
+    GlyphPrewarmItem item;
+    uint32_t head = prewarm->head;
+    size_t i;
+
+    backend_thread_lower_priority();
+    for (i = 0; i < prewarm->count && !PREWARM_LOAD(&prewarm->cancel); ++i) {
+        if (prewarm_render(prewarm, prewarm->codepoints[i], &item) < 0) {
+            continue;
+        }
+        // ring full, wait for the render thread rather than the other way around
+        while (head - PREWARM_LOAD(&prewarm->tail) >= PREWARM_QUEUE_SIZE) {
+            if (PREWARM_LOAD(&prewarm->cancel)) {
+                VT_free(item.pixels);
+                goto done;
+            }
+            backend_sleep_ms(1);
+        }
+        prewarm->queue[head & PREWARM_QUEUE_MASK] = item;
+        PREWARM_STORE(&prewarm->head, ++head);
+    }
+done:
+    PREWARM_STORE(&prewarm->finished, 1);
+}
+
+static uint32_t *prewarm_default_list(size_t *count)
+{
+    uint32_t *codepoints, *p, c;
+    size_t i, n = sizeof(default_hanzi) / sizeof(default_hanzi[0]);
+
+    for (i = 0; i < sizeof(default_ranges) / sizeof(default_ranges[0]); ++i) {
+        n += default_ranges[i].last - default_ranges[i].first + 1;
+    }
+    if (!(p = codepoints = VT_malloc(n * sizeof(uint32_t)))) {
+        return NULL;
+    }
+    for (i = 0; i < sizeof(default_ranges) / sizeof(default_ranges[0]); ++i) {
+        for (c = default_ranges[i].first; c <= default_ranges[i].last; ++c) {
+            *p++ = c;
+        }
+    }
+    for (i = 0; i < sizeof(default_hanzi) / sizeof(default_hanzi[0]); ++i) {
+        *p++ = default_hanzi[i];
+    }
+    *count = n;
+    return codepoints;
+}
+
+GlyphPrewarm *glyph_prewarm_start(TTFont *font, uint16_t font_id, uint16_t size,
+                                  const uint32_t *codepoints, size_t count)
+{
+    GlyphPrewarm *prewarm;
+
+    if (!font || !size || !(prewarm = VT_malloc(sizeof(GlyphPrewarm)))) {
+        return NULL;
+    }
+    memset(prewarm, 0, sizeof(GlyphPrewarm));
+    prewarm->font = font;
+    prewarm->font_id = font_id;
+    prewarm->size = size;
+    if (codepoints) {
+        if (count && (prewarm->codepoints = VT_malloc(count * sizeof(uint32_t)))) {
+            memcpy(prewarm->codepoints, codepoints, count * sizeof(uint32_t));
+            prewarm->count = count;
+        }
+    } else {
+        prewarm->codepoints = prewarm_default_list(&prewarm->count);
+    }
+    if (!prewarm->codepoints || !(prewarm->ctx = font_context_new())) {
+        goto fail;
+    }
+    if (!(prewarm->thread = backend_thread_start(prewarm_run, prewarm))) {
+        goto fail;
+    }
+    return prewarm;
+
+fail:
+    DebugPrintf("glyph prewarm: failed to start\n")
+    font_context_free(prewarm->ctx);
+    VT_free(prewarm->codepoints);
+    VT_free(prewarm);
+    return NULL;
+}
+
+int glyph_prewarm_drain(GlyphPrewarm *prewarm, GlyphCache *cache, int max_glyphs)
+{
+    GlyphPrewarmItem *item;
+    uint32_t tail, head;
+    int n = 0;
+
+    if (!prewarm) {
+        return 0;
+    }
+    tail = prewarm->tail;
+    head = PREWARM_LOAD(&prewarm->head);
+    while (tail != head && n < max_glyphs) {
+        item = &prewarm->queue[tail & PREWARM_QUEUE_MASK];
+        glyph_cache_put(cache, prewarm->font_id, item->glyph, prewarm->size, GLYPH_STYLE_REGULAR,
+                        &item->metrics, item->pixels, item->metrics.width);
+        VT_free(item->pixels);
+        ++tail;
+        ++n;
+    }
+    PREWARM_STORE(&prewarm->tail, tail);
+    return n;
+}
+
+int glyph_prewarm_done(GlyphPrewarm *prewarm)
+{
+    return !prewarm || (PREWARM_LOAD(&prewarm->finished) && PREWARM_LOAD(&prewarm->head) == prewarm->tail);
+}
+
+void glyph_prewarm_stop(GlyphPrewarm *prewarm)
+{
+    uint32_t tail, head;
+
+    if (!prewarm) {
+        return;
+    }
+    PREWARM_STORE(&prewarm->cancel, 1);
+    backend_thread_join(prewarm->thread);
+    head = prewarm->head;
+    for (tail = prewarm->tail; tail != head; ++tail) {
+        VT_free(prewarm->queue[tail & PREWARM_QUEUE_MASK].pixels);
+    }
+    font_context_free(prewarm->ctx);
+    VT_free(prewarm->codepoints);
+    VT_free(prewarm);
+}
+
+int glyph_prewarm_load_list(const char *path, uint32_t **codepoints, size_t *count)
+{
+    FILE *file;
+    uint32_t *list = NULL, *grown, c;
+    size_t n = 0, cap = 0;
+    int ch, more;
+
+    if (!(file = fopen(path, "rb"))) {
+        DebugPrintf("glyph prewarm: can not open %s\n", path)
+        return -1;
+    }
+    while ((ch = fgetc(file)) != EOF) {
+        // lead byte, stray continuation bytes and invalid leads are skipped
+        if (ch < 0x80) {
+            c = ch;
+            more = 0;
+        } else if ((ch & 0xE0) == 0xC0) {
+            c = ch & 0x1F;
+            more = 1;
+        } else if ((ch & 0xF0) == 0xE0) {
+            c = ch & 0x0F;
+            more = 2;
+        } else if ((ch & 0xF8) == 0xF0) {
+            c = ch & 0x07;
+            more = 3;
+        } else {
+            continue;
+        }
+        for (; more; --more) {
+            if ((ch = fgetc(file)) == EOF || (ch & 0xC0) != 0x80) {
+                break;
+            }
+            c = (c << 6) | (ch & 0x3F);
+        }
+        if (more || c <= 0x20 || c == 0x7F || c == 0xFEFF || c > 0x10FFFF) {
+            if (more && ch != EOF) {
+                ungetc(ch, file);
+            }
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 256;
+            if (!(grown = VT_realloc(list, cap * sizeof(uint32_t)))) {
+                VT_free(list);
+                fclose(file);
+                return -1;
+            }
+            list = grown;
+        }
+        list[n++] = c;
+    }
+    fclose(file);
+    *codepoints = list;
+    *count = n;
+    return 0;
+}
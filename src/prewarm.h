@@ -0,0 +1,48 @@
+/**
+ * background glyph pre-warming
+ * a low priority worker rasterizes a code point list with its own scratch context,
+ * finished glyphs wait in a lock free single producer / single consumer ring
+ * until the render thread drains them into its glyph cache
+ */
+
+#ifndef VT2000_PREWARM_H
+#define VT2000_PREWARM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "font.h"
+#include "glyphcache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct GlyphPrewarm GlyphPrewarm;
+
+    /**
+     * start rasterizing codepoints at size, most wanted first
+     * NULL codepoints uses the built-in list: ASCII, Latin-1, box drawing, block elements,
+     * CJK punctuation and the most frequent hanzi
+     * the font must stay loaded until glyph_prewarm_stop
+     */
+    GlyphPrewarm *glyph_prewarm_start(TTFont *font, uint16_t font_id, uint16_t size,
+                                      const uint32_t *codepoints, size_t count);
+    /**
+     * move up to max_glyphs finished glyphs into the cache, called from the render thread
+     * never waits on the worker, returns the number of glyphs moved
+     */
+    int glyph_prewarm_drain(GlyphPrewarm *prewarm, GlyphCache *cache, int max_glyphs);
+    // 1 once the worker is through its list and everything has been drained
+    int glyph_prewarm_done(GlyphPrewarm *prewarm);
+    // cancel the worker, wait for it to exit and drop what was not drained
+    void glyph_prewarm_stop(GlyphPrewarm *prewarm);
+    /**
+     * read a frequency file, UTF-8 text listing the characters most frequent first,
+     * white space is ignored. codepoints is malloc'd, release with free
+     */
+    int glyph_prewarm_load_list(const char *path, uint32_t **codepoints, size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //VT2000_PREWARM_H
@@ -14,6 +14,11 @@
  * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. */
 
+/* Before any system header, so the C library does not declare its own reallocarray(). */
+#if !defined(_WIN32)
+# define _POSIX_C_SOURCE 1
+#endif
+
 #include <assert.h>
 #include <errno.h>
 #include <math.h>
@@ -29,14 +34,30 @@
 # define WIN32_LEAN_AND_MEAN 1
 # include <windows.h>
 #else
-# define _POSIX_C_SOURCE 1
 # include <fcntl.h>
 # include <sys/mman.h>
 # include <sys/stat.h>
 # include <unistd.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define SCHRIFT_SSE2 1
+# include <emmintrin.h>
+/* AVX2 kernels are compiled in anyway and only picked at runtime. */
+# if defined(_MSC_VER) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#  define SCHRIFT_AVX2 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#   include <intrin.h>
+#   define TARGET_AVX2
+#  else
+#   define TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+# endif
+#endif
+
 #include "schrift.h"
+#include "bedecode.h"
 
 #define SCHRIFT_VERSION "0.10.2"
 
@@ -64,6 +85,72 @@
 #define GOT_AN_X_AND_Y_SCALE       0x040
 #define GOT_A_SCALE_MATRIX         0x080
 
+/* Rasterizer precision. Defining SCHRIFT_FLOAT rasterizes in single precision,
+ * which halves the Cell buffer (8 instead of 16 bytes per pixel) and doubles
+ * the lanes of the post-processing kernels. Metrics stay in double either way. */
+#if defined(SCHRIFT_FLOAT)
+typedef float Real;
+# define REAL(x)          x##f
+# define REAL_ABS(x)      fabsf(x)
+# define REAL_BELOW(x)    nextafterf((Real) (x), 0.0f)
+#else
+typedef double Real;
+# define REAL(x)          x
+# define REAL_ABS(x)      fabs(x)
+# define REAL_BELOW(x)    nextafter((x), 0.0)
+#endif
+
+/* Vectors of Reals for the point kernels. */
+#if SCHRIFT_SSE2 && !defined(SCHRIFT_FLOAT)
+typedef __m128d Real128;
+# define R128_LANES        2
+# define R128_LOAD(p)      _mm_loadu_pd(p)
+# define R128_STORE(p, v)  _mm_storeu_pd(p, v)
+# define R128_SET1(x)      _mm_set1_pd(x)
+# define R128_ADD(a, b)    _mm_add_pd(a, b)
+# define R128_MUL(a, b)    _mm_mul_pd(a, b)
+# define R128_MIN(a, b)    _mm_min_pd(a, b)
+# define R128_MAX(a, b)    _mm_max_pd(a, b)
+#elif SCHRIFT_SSE2
+typedef __m128 Real128;
+# define R128_LANES        4
+# define R128_LOAD(p)      _mm_loadu_ps(p)
+# define R128_STORE(p, v)  _mm_storeu_ps(p, v)
+# define R128_SET1(x)      _mm_set1_ps(x)
+# define R128_ADD(a, b)    _mm_add_ps(a, b)
+# define R128_MUL(a, b)    _mm_mul_ps(a, b)
+# define R128_MIN(a, b)    _mm_min_ps(a, b)
+# define R128_MAX(a, b)    _mm_max_ps(a, b)
+#endif
+#if SCHRIFT_AVX2 && !defined(SCHRIFT_FLOAT)
+typedef __m256d Real256;
+# define R256_LANES        4
+# define R256_LOAD(p)      _mm256_loadu_pd(p)
+# define R256_STORE(p, v)  _mm256_storeu_pd(p, v)
+# define R256_SET1(x)      _mm256_set1_pd(x)
+# define R256_ADD(a, b)    _mm256_add_pd(a, b)
+# define R256_MUL(a, b)    _mm256_mul_pd(a, b)
+# define R256_MIN(a, b)    _mm256_min_pd(a, b)
+# define R256_MAX(a, b)    _mm256_max_pd(a, b)
+#elif SCHRIFT_AVX2
+typedef __m256 Real256;
+# define R256_LANES        8
+# define R256_LOAD(p)      _mm256_loadu_ps(p)
+# define R256_STORE(p, v)  _mm256_storeu_ps(p, v)
+# define R256_SET1(x)      _mm256_set1_ps(x)
+# define R256_ADD(a, b)    _mm256_add_ps(a, b)
+# define R256_MUL(a, b)    _mm256_mul_ps(a, b)
+# define R256_MIN(a, b)    _mm256_min_ps(a, b)
+# define R256_MAX(a, b)    _mm256_max_ps(a, b)
+#endif
+
+/* Largest distance in pixels between a curve and the lines it is drawn with. */
+#define FLATNESS REAL(0.125)
+/* Bounds the work per curve for absurd sizes. */
+#define MAX_CURVE_SEGMENTS 256
+/* Glyphs of more pixels are rasterized a scanline at a time, without a cell buffer of their size. */
+#define SCANLINE_THRESHOLD (128 * 128)
+
 /* macros */
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define SIGN(x)   (((x) > 0) - ((x) < 0))
@@ -76,22 +163,45 @@
 
 enum { SrcMapping, SrcUser };
 
+/* Tables resolved once by init_font(). */
+enum { TableCmap, TableGlyf, TableHead, TableHhea, TableHmtx, TableKern, TableLoca, TableMaxp, NumTables };
+
+/* BMP pages of 256 code points. Hot pages get a direct glyph array at load,
+ * the rest of the code space goes through the cmap subtable's segment search. */
+#define CMAP_PAGE_SHIFT 8
+#define CMAP_PAGE_SIZE  (1 << CMAP_PAGE_SHIFT)
+#define CMAP_NUM_PAGES  (0x10000 >> CMAP_PAGE_SHIFT)
+
+/* How sft_gmetrics() ends for a glyph of the eager metrics table. */
+enum { GlyphOk, GlyphEmpty, GlyphNoHmtx, GlyphBroken };
+
 /* structs */
 typedef struct Point   Point;
 typedef struct Line    Line;
 typedef struct Curve   Curve;
 typedef struct Cell    Cell;
 typedef struct Outline Outline;
+typedef struct CachedOutline CachedOutline;
+typedef struct KernPair KernPair;
 typedef struct Raster  Raster;
+typedef struct Edge    Edge;
+typedef struct Span    Span;
 
-struct Point { double x, y; };
+struct Point { Real x, y; };
 struct Line  { uint_least16_t beg, end; };
 struct Curve { uint_least16_t beg, end, ctrl; };
-struct Cell  { double area, cover; };
-
+struct Cell  { Real area, cover; };
+/* A line of the scanline rasterizer, top.y < bottom.y, dir is the sign of its original y direction. */
+struct Edge  { Point top, bottom; Real dxdy; int dir; };
+/* The cells [beg, end] of a scanline that an edge touched. */
+struct Span  { int beg, end; };
+
+/* The points are stored as separate x and y arrays, so that they can be transformed and clipped
+ * a vector at a time. */
 struct Outline
 {
-	Point *points;
+	Real  *xs;
+	Real  *ys;
 	Curve *curves;
 	Line  *lines;
 	uint_least16_t numPoints;
@@ -102,6 +212,40 @@ struct Outline
 	uint_least16_t capLines;
 };
 
+/* A decoded glyph outline in font units, compound components already resolved.
+ * points, curves and lines live in the same allocation as the struct. */
+struct CachedOutline
+{
+	Real  *xs;
+	Real  *ys;
+	Curve *curves;
+	Line  *lines;
+	uint_least16_t numPoints;
+	uint_least16_t numCurves;
+	uint_least16_t numLines;
+};
+
+/* Reusable render scratch. The buffers grow monotonically and are reset, not freed, between glyphs. */
+struct SFT_Arena
+{
+	Outline outl;
+	Cell   *cells;
+	size_t  capCells;
+	void   *scan;
+	size_t  capScan;
+};
+
+/* One slot of the kerning hash, values summed over all applicable subtables, in FUnits. */
+struct KernPair
+{
+	uint_least32_t key;
+	int_least16_t  xShift;
+	int_least16_t  yShift;
+};
+
+/* No valid glyph id is 0xFFFF, so this pair can never occur. */
+#define KERN_EMPTY 0xFFFFFFFFu
+
 struct Raster
 {
 	Cell *cells;
@@ -121,21 +265,67 @@ struct SFT_Font
 	uint_least16_t unitsPerEm;
 	int_least16_t  locaFormat;
 	uint_least16_t numLongHmtx;
+	int_least16_t  ascender;
+	int_least16_t  descender;
+	int_least16_t  lineGap;
+	/* Table offsets, 0 for a table the font does not have. */
+	uint_fast32_t  tables[NumTables];
+	/* The selected cmap subtable, cmapFormat -1 if there is no usable one. */
+	uint_fast32_t  cmapTable;
+	int            cmapFormat;
+	/* Direct glyph arrays of hot BMP pages, NULL pages use the subtable. */
+	const uint_least16_t *cmapPages[CMAP_NUM_PAGES];
+	/* Per glyph outline cache, NULL unless enabled with sft_cacheoutlines(). */
+	CachedOutline **outlines;
+	uint_least16_t numGlyphs;
+	/* Eager glyph metrics in FUnits, NULL unless enabled with sft_cachemetrics().
+	 * One allocation of numGlyphs entries per array, mtxAdvance is its base. */
+	uint_least16_t *mtxAdvance;
+	int_least16_t  *mtxLsb;
+	int_least16_t  *mtxBox[4];
+	uint_least8_t  *mtxState;
+	/* The advance nearly all advancing glyphs share, 0 for a proportional face. */
+	uint_least16_t  monoAdvance;
+	/* Kerning pairs, decoded once at load. kernStatus is -1 for a malformed kern table. */
+	KernPair      *kernPairs;
+	uint_fast32_t  kernMask;
+	int            kernShift;
+	int            kernStatus;
+	/* Set when hmtx, loca and every glyph record passed validate_glyphs() at load,
+	 * glyph decoding then skips its per read bounds checks. */
+	int            trusted;
 };
 
 /* function declarations */
 /* generic utility functions */
 static void *reallocarray(void *optr, size_t nmemb, size_t size);
-static inline int fast_floor(double x);
-static inline int fast_ceil (double x);
+static inline int fast_floor(Real x);
+static inline int fast_ceil (Real x);
+/* kerning */
+static inline uint_fast32_t kern_hash(uint_fast32_t key, int shift);
+static int  init_kerning(SFT_Font *font);
+static int  kern_insert(SFT_Font *font, uint_fast32_t key, int xShift, int yShift);
+static void kern_lookup(const SFT *sft, SFT_Glyph leftGlyph, SFT_Glyph rightGlyph, SFT_Kerning *kerning);
 /* file loading */
 static int  map_file  (SFT_Font *font, const char *filename);
 static void unmap_file(SFT_Font *font);
 static int  init_font (SFT_Font *font);
+static int  validate_glyphs(SFT_Font *font, const uint_fast32_t lengths[NumTables]);
+static int  validate_record(SFT_Font *font, uint_fast32_t offset, uint_fast32_t length);
+static int  load_num_glyphs(SFT_Font *font);
 /* simple mathematical operations */
-static Point midpoint(Point a, Point b);
-static void transform_points(unsigned int numPts, Point *points, double trf[6]);
-static void clip_points(unsigned int numPts, Point *points, int width, int height);
+static Point outline_point(const Outline *outl, uint_fast16_t i);
+static void midpoint(Outline *outl, uint_fast16_t dst, uint_fast16_t a, uint_fast16_t b);
+#if SCHRIFT_SSE2
+static unsigned int transform_points_sse2(unsigned int numPts, Real *xs, Real *ys, const Real m[6]);
+static unsigned int clip_points_sse2(unsigned int numPts, Real *xs, Real *ys, Real xMax, Real yMax);
+#endif
+#if SCHRIFT_AVX2
+static unsigned int transform_points_avx2(unsigned int numPts, Real *xs, Real *ys, const Real m[6]);
+static unsigned int clip_points_avx2(unsigned int numPts, Real *xs, Real *ys, Real xMax, Real yMax);
+#endif
+static void transform_points(unsigned int numPts, Real *xs, Real *ys, double trf[6]);
+static void clip_points(unsigned int numPts, Real *xs, Real *ys, int width, int height);
 /* 'outline' data structure management */
 static int  init_outline(Outline *outl);
 static void free_outline(Outline *outl);
@@ -144,6 +334,7 @@ static int  grow_curves (Outline *outl);
 static int  grow_lines  (Outline *outl);
 /* TTF parsing utilities */
 static inline int is_safe_offset(SFT_Font *font, uint_fast32_t offset, uint_fast32_t margin);
+static inline int is_safe_glyph_data(SFT_Font *font, uint_fast32_t offset, uint_fast32_t margin);
 static void *csearch(const void *key, const void *base,
 	size_t nmemb, size_t size, int (*compar)(const void *, const void *));
 static int  cmpu16(const void *a, const void *b);
@@ -153,33 +344,66 @@ static inline int_least8_t   geti8 (SFT_Font *font, uint_fast32_t offset);
 static inline uint_least16_t getu16(SFT_Font *font, uint_fast32_t offset);
 static inline int_least16_t  geti16(SFT_Font *font, uint_fast32_t offset);
 static inline uint_least32_t getu32(SFT_Font *font, uint_fast32_t offset);
-static int gettable(SFT_Font *font, char tag[4], uint_fast32_t *offset);
+static int find_table(SFT_Font *font, const char tag[4], uint_fast32_t *offset, uint_fast32_t *length);
+static inline int gettable(SFT_Font *font, int table, uint_fast32_t *offset);
 /* codepoint to glyph id translation */
 static int  cmap_fmt4(SFT_Font *font, uint_fast32_t table, SFT_UChar charCode, uint_fast32_t *glyph);
 static int  cmap_fmt6(SFT_Font *font, uint_fast32_t table, SFT_UChar charCode, uint_fast32_t *glyph);
+static int  select_cmap(SFT_Font *font);
+static int  init_cmap(SFT_Font *font);
+static void free_cmap(SFT_Font *font);
+static int  cmap_lookup(SFT_Font *font, SFT_UChar charCode, uint_fast32_t *glyph);
 static int  glyph_id(SFT_Font *font, SFT_UChar charCode, uint_fast32_t *glyph);
 /* glyph metrics lookup */
 static int  hor_metrics(SFT_Font *font, uint_fast32_t glyph, int *advanceWidth, int *leftSideBearing);
 static int  glyph_bbox(const SFT *sft, uint_fast32_t outline, int box[4]);
+static int  scale_bbox(const SFT *sft, int box[4]);
+static int  bulk_hor_metrics(SFT_Font *font, uint16_t *scratch);
+static int  bulk_outline_offsets(SFT_Font *font, uint16_t *scratch, uint32_t *offsets);
+static int  table_gmetrics(const SFT *sft, SFT_Glyph glyph, SFT_GMetrics *metrics);
 /* decoding outlines */
 static int  outline_offset(SFT_Font *font, uint_fast32_t glyph, uint_fast32_t *offset);
 static int  simple_flags(SFT_Font *font, uint_fast32_t *offset, uint_fast16_t numPts, uint8_t *flags);
-static int  simple_points(SFT_Font *font, uint_fast32_t offset, uint_fast16_t numPts, uint8_t *flags, Point *points);
+static int  simple_points(SFT_Font *font, uint_fast32_t offset, uint_fast16_t numPts, uint8_t *flags, Real *xs, Real *ys);
+static const uint8_t *simple_flags_unchecked(const uint8_t *data, uint_fast16_t numPts, uint8_t *flags);
+static void simple_points_unchecked(const uint8_t *data, uint_fast16_t numPts, const uint8_t *flags, Real *xs, Real *ys);
 static int  decode_contour(uint8_t *flags, uint_fast16_t basePoint, uint_fast16_t count, Outline *outl);
 static int  simple_outline(SFT_Font *font, uint_fast32_t offset, unsigned int numContours, Outline *outl);
 static int  compound_outline(SFT_Font *font, uint_fast32_t offset, int recDepth, Outline *outl);
 static int  decode_outline(SFT_Font *font, uint_fast32_t offset, int recDepth, Outline *outl);
-/* tesselation */
-static int  is_flat(Outline *outl, Curve curve);
-static int  tesselate_curve(Curve curve, Outline *outl);
-static int  tesselate_curves(Outline *outl);
+static int  cached_outline(SFT_Font *font, SFT_Glyph glyph, int recDepth, CachedOutline **cached);
+static int  append_outline(Outline *outl, const CachedOutline *cached);
 /* silhouette rasterization */
 static void draw_line(Raster buf, Point origin, Point goal);
 static void draw_lines(Outline *outl, Raster buf);
+static unsigned int curve_segments(Point p0, Point p1, Point p2);
+static unsigned int flatten_curve(Point p0, Point p1, Point p2, int width, int height, Point *pts);
+static void draw_curve(Raster buf, Point p0, Point p1, Point p2);
+static void draw_curves(Outline *outl, Raster buf);
+/* scanline rasterization */
+static unsigned int count_edges(Outline *outl);
+static void add_edge(Edge *edges, unsigned int *num, Point origin, Point goal);
+static unsigned int build_edges(Outline *outl, int width, int height, Edge *edges);
+static int  cmpedge(const void *a, const void *b);
+static Span draw_edge(Raster row, const Edge *edge, int y);
+static void fill_scanline(Cell *cells, uint8_t *pixels, int width, Span *spans, unsigned int numSpans);
+static void raster_scanlines(Outline *outl, SFT_Image image, void *scratch, unsigned int maxEdges);
+static size_t scanline_scratch(unsigned int maxEdges, int width);
 /* post-processing */
+static void post_process_scalar(const Cell *cells, uint8_t *image, unsigned int num, Real accum);
+#if SCHRIFT_SSE2
+static unsigned int post_process_sse2(const Cell *cells, uint8_t *image, unsigned int num, Real *accum);
+#endif
+#if SCHRIFT_AVX2
+static int has_avx2(void);
+static unsigned int post_process_avx2(const Cell *cells, uint8_t *image, unsigned int num, Real *accum);
+#endif
 static void post_process(Raster buf, uint8_t *image);
 /* glyph rendering */
+static void raster_outline(Outline *outl, SFT_Image image, Cell *cells);
 static int  render_outline(Outline *outl, double transform[6], SFT_Image image);
+static int  render_outline_arena(Outline *outl, double transform[6], SFT_Image image, SFT_Arena *arena);
+static int  render_glyph(const SFT *sft, SFT_Glyph glyph, SFT_Image image, SFT_Arena *arena);
 
 /* function implementations */
 
@@ -232,27 +456,127 @@ sft_loadfile(char const *filename)
 void
 sft_freefont(SFT_Font *font)
 {
+	unsigned int i;
 	if (!font) return;
+	if (font->outlines) {
+		for (i = 0; i < font->numGlyphs; ++i)
+			free(font->outlines[i]);
+		free(font->outlines);
+	}
+	free(font->mtxAdvance);
+	free(font->kernPairs);
+	free_cmap(font);
 	/* Only unmap if we mapped it ourselves. */
 	if (font->source == SrcMapping)
 		unmap_file(font);
 	free(font);
 }
 
+int
+sft_cacheoutlines(SFT_Font *font)
+{
+	if (font->outlines)
+		return 0;
+	if (load_num_glyphs(font) < 0)
+		return -1;
+	if (!(font->outlines = calloc(font->numGlyphs ? font->numGlyphs : 1, sizeof *font->outlines)))
+		return -1;
+	return 0;
+}
+
+int
+sft_cachemetrics(SFT_Font *font)
+{
+	uint_fast32_t glyph, outline, n, votes = 0, advancing = 0, shared = 0;
+	int adv, lsb, mono = 0, bulkHmtx, bulkLoca;
+	uint8_t *mem;
+	uint32_t *loca;
+	uint16_t *words;
+
+	if (font->mtxAdvance)
+		return 0;
+	if (load_num_glyphs(font) < 0)
+		return -1;
+	n = font->numGlyphs;
+	/* Six int16 arrays, then the state bytes, so every array stays aligned. */
+	if (!(mem = calloc(n ? n : 1, 6 * sizeof (int_least16_t) + 1)))
+		return -1;
+	font->mtxAdvance = (uint_least16_t *) mem;
+	font->mtxLsb     = (int_least16_t *) (font->mtxAdvance + n);
+	font->mtxBox[0]  = font->mtxLsb + n;
+	font->mtxBox[1]  = font->mtxBox[0] + n;
+	font->mtxBox[2]  = font->mtxBox[1] + n;
+	font->mtxBox[3]  = font->mtxBox[2] + n;
+	font->mtxState   = (uint_least8_t *) (font->mtxBox[3] + n);
+
+	/* hmtx and loca are decoded in bulk when they are whole,
+	 * a truncated table goes through the per glyph reads and their errors. */
+	loca  = malloc((n + 1) * sizeof *loca);
+	words = malloc(2 * (n + 1) * sizeof *words);
+	bulkHmtx = loca && words && bulk_hor_metrics(font, words) == 0;
+	bulkLoca = loca && words && bulk_outline_offsets(font, words, loca) == 0;
+	free(words);
+
+	for (glyph = 0; glyph < n; ++glyph) {
+		if (!bulkHmtx) {
+			if (hor_metrics(font, glyph, &adv, &lsb) < 0) {
+				font->mtxState[glyph] = GlyphNoHmtx;
+				continue;
+			}
+			font->mtxAdvance[glyph] = (uint_least16_t) adv;
+			font->mtxLsb[glyph]     = (int_least16_t) lsb;
+		}
+		/* Majority vote for the common advance, checked below. */
+		if ((adv = font->mtxAdvance[glyph])) {
+			if (!votes)
+				mono = adv;
+			if (mono == adv)
+				++votes;
+			else
+				--votes;
+		}
+		if (bulkLoca) {
+			outline = loca[glyph];
+		} else if (outline_offset(font, glyph, &outline) < 0) {
+			font->mtxState[glyph] = GlyphBroken;
+			continue;
+		}
+		if (!outline) {
+			font->mtxState[glyph] = GlyphEmpty;
+			continue;
+		}
+		if (!is_safe_offset(font, outline, 10)) {
+			font->mtxState[glyph] = GlyphBroken;
+			continue;
+		}
+		font->mtxBox[0][glyph] = geti16(font, outline + 2);
+		font->mtxBox[1][glyph] = geti16(font, outline + 4);
+		font->mtxBox[2][glyph] = geti16(font, outline + 6);
+		font->mtxBox[3][glyph] = geti16(font, outline + 8);
+		font->mtxState[glyph]  = GlyphOk;
+	}
+	free(loca);
+	/* Monospace fonts still carry the odd wide or narrow glyph (e.g. a .notdef),
+	 * so the face counts as monospace when nearly every advancing glyph agrees. */
+	for (glyph = 0; glyph < n; ++glyph) {
+		if (font->mtxAdvance[glyph]) {
+			++advancing;
+			shared += font->mtxAdvance[glyph] == mono;
+		}
+	}
+	font->monoAdvance = advancing && shared >= advancing - advancing / 16 ? (uint_least16_t) mono : 0;
+	return 0;
+}
+
 int
 sft_lmetrics(const SFT *sft, SFT_LMetrics *metrics)
 {
 	double factor;
-	uint_fast32_t hhea;
 	memset(metrics, 0, sizeof *metrics);
-	if (gettable(sft->font, "hhea", &hhea) < 0)
-		return -1;
-	if (!is_safe_offset(sft->font, hhea, 36))
-		return -1;
 	factor = sft->yScale / sft->font->unitsPerEm;
-	metrics->ascender  = geti16(sft->font, hhea + 4) * factor;
-	metrics->descender = geti16(sft->font, hhea + 6) * factor;
-	metrics->lineGap   = geti16(sft->font, hhea + 8) * factor;
+	metrics->ascender  = sft->font->ascender  * factor;
+	metrics->descender = sft->font->descender * factor;
+	metrics->lineGap   = sft->font->lineGap   * factor;
 	return 0;
 }
 
@@ -272,6 +596,9 @@ sft_gmetrics(const SFT *sft, SFT_Glyph glyph, SFT_GMetrics *metrics)
 
 	memset(metrics, 0, sizeof *metrics);
 
+	if (sft->font->mtxAdvance && glyph < sft->font->numGlyphs)
+		return table_gmetrics(sft, glyph, metrics);
+
 	if (hor_metrics(sft->font, glyph, &adv, &lsb) < 0)
 		return -1;
 	metrics->advanceWidth    = adv * xScale;
@@ -290,79 +617,61 @@ sft_gmetrics(const SFT *sft, SFT_Glyph glyph, SFT_GMetrics *metrics)
 	return 0;
 }
 
+int
+sft_cmetrics(const SFT *sft, SFT_CMetrics *metrics)
+{
+	SFT_Font *font = sft->font;
+	double xScale = sft->xScale / font->unitsPerEm;
+	double yScale = sft->yScale / font->unitsPerEm;
+	int ascent, descent;
+
+	memset(metrics, 0, sizeof *metrics);
+	if (!font->mtxAdvance || !font->monoAdvance)
+		return -1;
+	ascent  = (int) ceil(font->ascender * yScale);
+	descent = (int) ceil(-font->descender * yScale);
+	metrics->width    = (int) ceil(font->monoAdvance * xScale);
+	metrics->height   = ascent + descent + (int) floor(font->lineGap * yScale + 0.5);
+	metrics->baseline = ascent;
+	return 0;
+}
+
 int
 sft_kerning(const SFT *sft, SFT_Glyph leftGlyph, SFT_Glyph rightGlyph,
             SFT_Kerning *kerning)
 {
-	void *match;
-	uint_fast32_t offset;
-	unsigned int numTables, numPairs, length, format, flags;
-	int value;
-	uint8_t key[4];
-
 	memset(kerning, 0, sizeof *kerning);
+	if (sft->font->kernStatus < 0)
+		return -1;
+	kern_lookup(sft, leftGlyph, rightGlyph, kerning);
+	return 0;
+}
 
-	if (gettable(sft->font, "kern", &offset) < 0)
+int
+sft_kerning_run(const SFT *sft, const SFT_Glyph *glyphs, int count, SFT_Kerning *kernings)
+{
+	int i;
+	if (count < 2)
 		return 0;
-
-	/* Read kern table header. */
-	if (!is_safe_offset(sft->font, offset, 4))
+	memset(kernings, 0, (size_t) (count - 1) * sizeof *kernings);
+	if (sft->font->kernStatus < 0)
 		return -1;
-	if (getu16(sft->font, offset) != 0)
+	if (!sft->font->kernPairs)
 		return 0;
-	numTables = getu16(sft->font, offset + 2);
-	offset += 4;
-
-	while (numTables > 0) {
-		/* Read subtable header. */
-		if (!is_safe_offset(sft->font, offset, 6))
-			return -1;
-		length = getu16(sft->font, offset + 2);
-		format = getu8 (sft->font, offset + 4);
-		flags  = getu8 (sft->font, offset + 5);
-		offset += 6;
-
-		if (format == 0 && (flags & HORIZONTAL_KERNING) && !(flags & MINIMUM_KERNING)) {
-			/* Read format 0 header. */
-			if (!is_safe_offset(sft->font, offset, 8))
-				return -1;
-			numPairs = getu16(sft->font, offset);
-			offset += 8;
-			/* Look up character code pair via binary search. */
-			key[0] = (leftGlyph  >> 8) & 0xFF;
-			key[1] =  leftGlyph  & 0xFF;
-			key[2] = (rightGlyph >> 8) & 0xFF;
-			key[3] =  rightGlyph & 0xFF;
-			if ((match = bsearch(key, sft->font->memory + offset,
-				numPairs, 6, cmpu32)) != NULL) {
-				
-				value = geti16(sft->font, (uint_fast32_t) ((uint8_t *) match - sft->font->memory + 4));
-				if (flags & CROSS_STREAM_KERNING) {
-					kerning->yShift += value;
-				} else {
-					kerning->xShift += value;
-				}
-			}
-
-		}
-
-		offset += length;
-		--numTables;
+	for (i = 0; i < count - 1; ++i) {
+		kern_lookup(sft, glyphs[i], glyphs[i + 1], &kernings[i]);
 	}
-
-	kerning->xShift = kerning->xShift / sft->font->unitsPerEm * sft->xScale;
-	kerning->yShift = kerning->yShift / sft->font->unitsPerEm * sft->yScale;
-
 	return 0;
 }
 
-int
-sft_render(const SFT *sft, SFT_Glyph glyph, SFT_Image image)
+static int
+render_glyph(const SFT *sft, SFT_Glyph glyph, SFT_Image image, SFT_Arena *arena)
 {
 	uint_fast32_t outline;
 	double transform[6];
 	int bbox[4];
-	Outline outl;
+	Outline local, *outl;
+	CachedOutline *cached;
 
 	if (outline_offset(sft->font, glyph, &outline) < 0)
 		return -1;
@@ -385,23 +694,75 @@ sft_render(const SFT *sft, SFT_Glyph glyph, SFT_Image image)
 		transform[5] = sft->yOffset - bbox[1];
 	}
 	
-	memset(&outl, 0, sizeof outl);
-	if (init_outline(&outl) < 0)
-		goto failure;
+	if (arena) {
+		outl = &arena->outl;
+		if (!outl->capPoints && init_outline(outl) < 0) {
+			free_outline(outl);
+			memset(outl, 0, sizeof *outl);
+			return -1;
+		}
+		outl->numPoints = 0;
+		outl->numCurves = 0;
+		outl->numLines  = 0;
+	} else {
+		outl = &local;
+		memset(outl, 0, sizeof *outl);
+		if (init_outline(outl) < 0)
+			goto failure;
+	}
 
-	if (decode_outline(sft->font, outline, 0, &outl) < 0)
-		goto failure;
-	if (render_outline(&outl, transform, image) < 0)
+	if (sft->font->outlines) {
+		/* Only transform and raster are paid again at a new size. */
+		if (cached_outline(sft->font, glyph, 0, &cached) < 0)
+			goto failure;
+		if (append_outline(outl, cached) < 0)
+			goto failure;
+	} else {
+		if (decode_outline(sft->font, outline, 0, outl) < 0)
+			goto failure;
+	}
+	if (arena)
+		return render_outline_arena(outl, transform, image, arena);
+	if (render_outline(outl, transform, image) < 0)
 		goto failure;
 
-	free_outline(&outl);
+	free_outline(outl);
 	return 0;
 
 failure:
-	free_outline(&outl);
+	if (!arena)
+		free_outline(outl);
 	return -1;
 }
 
+int
+sft_render(const SFT *sft, SFT_Glyph glyph, SFT_Image image)
+{
+	return render_glyph(sft, glyph, image, NULL);
+}
+
+SFT_Arena *
+sft_arena_new(void)
+{
+	return calloc(1, sizeof(SFT_Arena));
+}
+
+void
+sft_arena_free(SFT_Arena *arena)
+{
+	if (!arena) return;
+	free_outline(&arena->outl);
+	free(arena->cells);
+	free(arena->scan);
+	free(arena);
+}
+
+int
+sft_render_arena(const SFT *sft, SFT_Glyph glyph, SFT_Image image, SFT_Arena *arena)
+{
+	return render_glyph(sft, glyph, image, arena);
+}
+
 /* This is sqrt(SIZE_MAX+1), as s1*s2 <= SIZE_MAX
  * if both s1 < MUL_NO_OVERFLOW and s2 < MUL_NO_OVERFLOW */
 #define MUL_NO_OVERFLOW	((size_t)1 << (sizeof(size_t) * 4))
@@ -422,14 +783,14 @@ reallocarray(void *optr, size_t nmemb, size_t size)
 
 /* TODO maybe we should use long here instead of int. */
 static inline int
-fast_floor(double x)
+fast_floor(Real x)
 {
 	int i = (int) x;
 	return i - (i > x);
 }
 
 static inline int
-fast_ceil(double x)
+fast_ceil(Real x)
 {
 	int i = (int) x;
 	return i + (i < x);
@@ -526,7 +887,14 @@ unmap_file(SFT_Font *font)
 static int
 init_font(SFT_Font *font)
 {
+	/* In the order of the Table enum. */
+	static const char tags[NumTables][4] = {
+		{'c','m','a','p'}, {'g','l','y','f'}, {'h','e','a','d'}, {'h','h','e','a'},
+		{'h','m','t','x'}, {'k','e','r','n'}, {'l','o','c','a'}, {'m','a','x','p'}
+	};
 	uint_fast32_t scalerType, head, hhea;
+	uint_fast32_t lengths[NumTables];
+	int i;
 
 	if (!is_safe_offset(font, 0, 12))
 		return -1;
@@ -535,136 +903,480 @@ init_font(SFT_Font *font)
 	if (scalerType != FILE_MAGIC_ONE && scalerType != FILE_MAGIC_TWO)
 		return -1;
 
-	if (gettable(font, "head", &head) < 0)
+	for (i = 0; i < NumTables; ++i) {
+		if (find_table(font, tags[i], &font->tables[i], &lengths[i]) < 0)
+			font->tables[i] = lengths[i] = 0;
+	}
+
+	if (gettable(font, TableHead, &head) < 0)
 		return -1;
 	if (!is_safe_offset(font, head, 54))
 		return -1;
 	font->unitsPerEm = getu16(font, head + 18);
 	font->locaFormat = geti16(font, head + 50);
 	
-	if (gettable(font, "hhea", &hhea) < 0)
+	if (gettable(font, TableHhea, &hhea) < 0)
 		return -1;
 	if (!is_safe_offset(font, hhea, 36))
 		return -1;
+	font->ascender    = geti16(font, hhea + 4);
+	font->descender   = geti16(font, hhea + 6);
+	font->lineGap     = geti16(font, hhea + 8);
 	font->numLongHmtx = getu16(font, hhea + 34);
 
+	/* A broken kern table only disables kerning, like it did when it was parsed per call. */
+	if (init_kerning(font) < 0) {
+		free(font->kernPairs);
+		font->kernPairs  = NULL;
+		font->kernStatus = -1;
+	}
+
+	if (init_cmap(font) < 0)
+		return -1;
+
+	/* A font failing validation still loads, it just keeps checking every read. */
+	font->trusted = validate_glyphs(font, lengths) == 0;
+
 	return 0;
 }
 
-static Point
-midpoint(Point a, Point b)
+/* Checks once what glyph decoding would otherwise check on every read:
+ * hmtx covers every glyph, loca is ascending and inside glyf, and each glyph record
+ * holds the data its header claims. */
+static int
+validate_glyphs(SFT_Font *font, const uint_fast32_t lengths[NumTables])
 {
-	return (Point) {
-		0.5 * (a.x + b.x),
-		0.5 * (a.y + b.y)
-	};
-}
+	uint_fast32_t n, numLong, loca, glyf, entry, glyph, this, next;
+	int table;
 
-/* Applies an affine linear transformation matrix to a set of points. */
-static void
-transform_points(unsigned int numPts, Point *points, double trf[6])
-{
-	Point pt;
-	unsigned int i;
-	for (i = 0; i < numPts; ++i) {
-		pt = points[i];
-		points[i] = (Point) {
-			pt.x * trf[0] + pt.y * trf[2] + trf[4],
-			pt.x * trf[1] + pt.y * trf[3] + trf[5]
-		};
+	for (table = 0; table < NumTables; ++table) {
+		if (font->tables[table] && !is_safe_offset(font, font->tables[table], lengths[table]))
+			return -1;
+	}
+	if (load_num_glyphs(font) < 0)
+		return -1;
+	if (gettable(font, TableLoca, &loca) < 0 || gettable(font, TableGlyf, &glyf) < 0 || !font->tables[TableHmtx])
+		return -1;
+	n = font->numGlyphs;
+
+	numLong = MIN(font->numLongHmtx, n);
+	if (!numLong && n)
+		return -1;
+	if (4 * numLong + 2 * (n - numLong) > lengths[TableHmtx])
+		return -1;
+
+	entry = font->locaFormat == 0 ? 2 : 4;
+	if (entry * (n + 1) > lengths[TableLoca])
+		return -1;
+	this = 0;
+	for (glyph = 0; glyph <= n; ++glyph) {
+		next = entry == 2 ? 2U * (uint_fast32_t) getu16(font, loca + 2 * glyph) : getu32(font, loca + 4 * glyph);
+		if (glyph && next < this)
+			return -1;
+		if (next > lengths[TableGlyf])
+			return -1;
+		if (glyph && next != this && validate_record(font, glyf + this, next - this) < 0)
+			return -1;
+		this = next;
 	}
+	return 0;
 }
 
-static void
-clip_points(unsigned int numPts, Point *points, int width, int height)
+/* A glyph record of length bytes holds everything decode_outline() reads from it. */
+static int
+validate_record(SFT_Font *font, uint_fast32_t offset, uint_fast32_t length)
 {
-	Point pt;
-	unsigned int i;
-
-	for (i = 0; i < numPts; ++i) {
-		pt = points[i];
+	uint_fast32_t pos, numPts, coords = 0, i;
+	unsigned int flags;
+	uint8_t value = 0, repeat = 0;
+	int numContours;
 
-		if (pt.x < 0.0) {
-			points[i].x = 0.0;
-		}
-		if (pt.x >= width) {
-			points[i].x = nextafter(width, 0.0);
-		}
-		if (pt.y < 0.0) {
-			points[i].y = 0.0;
-		}
-		if (pt.y >= height) {
-			points[i].y = nextafter(height, 0.0);
+	if (length < 10)
+		return -1;
+	numContours = geti16(font, offset);
+	if (numContours > 0) {
+		pos = 10 + 2 * (uint_fast32_t) numContours;
+		if (pos + 2 > length)
+			return -1;
+		numPts = getu16(font, offset + pos - 2) + 1U;
+		pos += 2 + getu16(font, offset + pos);
+		for (i = 0; i < numPts; ++i) {
+			if (repeat) {
+				--repeat;
+			} else {
+				if (pos + 1 > length)
+					return -1;
+				value = getu8(font, offset + pos++);
+				if (value & REPEAT_FLAG) {
+					if (pos + 1 > length)
+						return -1;
+					repeat = getu8(font, offset + pos++);
+				}
+			}
+			coords += value & X_CHANGE_IS_SMALL ? 1 : value & X_CHANGE_IS_ZERO ? 0 : 2;
+			coords += value & Y_CHANGE_IS_SMALL ? 1 : value & Y_CHANGE_IS_ZERO ? 0 : 2;
 		}
+		return pos <= length && coords <= length - pos ? 0 : -1;
+	} else if (numContours < 0) {
+		pos = 10;
+		do {
+			if (pos + 4 > length)
+				return -1;
+			flags = getu16(font, offset + pos);
+			pos += 4;
+			pos += flags & OFFSETS_ARE_LARGE ? 4 : 2;
+			if (flags & GOT_A_SINGLE_SCALE)
+				pos += 2;
+			else if (flags & GOT_AN_X_AND_Y_SCALE)
+				pos += 4;
+			else if (flags & GOT_A_SCALE_MATRIX)
+				pos += 8;
+			if (pos > length)
+				return -1;
+		} while (flags & THERE_ARE_MORE_COMPONENTS);
 	}
+	return 0;
 }
 
 static int
-init_outline(Outline *outl)
+load_num_glyphs(SFT_Font *font)
 {
-	/* TODO Smaller initial allocations */
-	outl->numPoints = 0;
-	outl->capPoints = 64;
-	if (!(outl->points = malloc(outl->capPoints * sizeof *outl->points)))
-		return -1;
-	outl->numCurves = 0;
-	outl->capCurves = 64;
-	if (!(outl->curves = malloc(outl->capCurves * sizeof *outl->curves)))
+	uint_fast32_t maxp;
+	if (gettable(font, TableMaxp, &maxp) < 0)
 		return -1;
-	outl->numLines = 0;
-	outl->capLines = 64;
-	if (!(outl->lines = malloc(outl->capLines * sizeof *outl->lines)))
+	if (!is_safe_offset(font, maxp, 6))
 		return -1;
+	font->numGlyphs = getu16(font, maxp + 4);
 	return 0;
 }
 
-static void
-free_outline(Outline *outl)
+/* Fibonacci hashing, the top bits of the product mix both glyphs. */
+static inline uint_fast32_t
+kern_hash(uint_fast32_t key, int shift)
 {
-	free(outl->points);
-	free(outl->curves);
-	free(outl->lines);
+	return ((key * 0x9E3779B1u) & 0xFFFFFFFFu) >> shift;
 }
 
+/* Decodes every horizontal format 0 kern subtable into one open-addressed hash,
+ * so a lookup no longer scans the table directory, the subtables and their pair arrays. */
 static int
-grow_points(Outline *outl)
+init_kerning(SFT_Font *font)
 {
-	void *mem;
-	uint_fast16_t cap;
-	assert(outl->capPoints);
-	/* Since we use uint_fast16_t for capacities, we have to be extra careful not to trigger integer overflow. */
-	if (outl->capPoints > UINT16_MAX / 2)
+	uint_fast32_t offset, base, total = 0, cap, key, i;
+	unsigned int numTables, numPairs, length, format, flags, t;
+	int value;
+
+	if (gettable(font, TableKern, &offset) < 0)
+		return 0;
+	if (!is_safe_offset(font, offset, 4))
 		return -1;
-	cap = (uint_fast16_t) (2U * outl->capPoints);
-	if (!(mem = reallocarray(outl->points, cap, sizeof *outl->points)))
+	if (getu16(font, offset) != 0)
+		return 0;
+	numTables = getu16(font, offset + 2);
+	base = offset + 4;
+
+	/* First pass validates and counts the pairs, to size the hash. */
+	for (offset = base, t = 0; t < numTables; ++t) {
+		if (!is_safe_offset(font, offset, 6))
+			return -1;
+		length = getu16(font, offset + 2);
+		format = getu8 (font, offset + 4);
+		flags  = getu8 (font, offset + 5);
+		/* The subtable length includes its 6 byte header. */
+		if (length < 6)
+			return -1;
+		if (format == 0 && (flags & HORIZONTAL_KERNING) && !(flags & MINIMUM_KERNING)) {
+			if (!is_safe_offset(font, offset + 6, 8))
+				return -1;
+			numPairs = getu16(font, offset + 6);
+			if (!is_safe_offset(font, offset + 14, numPairs * 6))
+				return -1;
+			total += numPairs;
+		}
+		offset += length;
+	}
+	if (!total)
+		return 0;
+
+	/* At most half full, so probe sequences stay short. */
+	for (cap = 16, font->kernShift = 28; cap < 2 * total; cap *= 2, --font->kernShift);
+	if (!(font->kernPairs = reallocarray(NULL, cap, sizeof *font->kernPairs)))
 		return -1;
-	outl->capPoints = (uint_least16_t) cap;
-	outl->points    = mem;
+	for (i = 0; i < cap; ++i) {
+		font->kernPairs[i] = (KernPair) { KERN_EMPTY, 0, 0 };
+	}
+	font->kernMask = cap - 1;
+
+	for (offset = base, t = 0; t < numTables; ++t) {
+		length = getu16(font, offset + 2);
+		format = getu8 (font, offset + 4);
+		flags  = getu8 (font, offset + 5);
+		if (format == 0 && (flags & HORIZONTAL_KERNING) && !(flags & MINIMUM_KERNING)) {
+			numPairs = getu16(font, offset + 6);
+			for (i = 0; i < numPairs; ++i) {
+				key   = getu32(font, offset + 14 + 6 * i);
+				value = geti16(font, offset + 14 + 6 * i + 4);
+				if (kern_insert(font, key, (flags & CROSS_STREAM_KERNING) ? 0 : value,
+					(flags & CROSS_STREAM_KERNING) ? value : 0) < 0)
+					return -1;
+			}
+		}
+		offset += length;
+	}
 	return 0;
 }
 
+/* Adds to the pair's shifts, creating it if needed. */
 static int
-grow_curves(Outline *outl)
+kern_insert(SFT_Font *font, uint_fast32_t key, int xShift, int yShift)
 {
-	void *mem;
-	uint_fast16_t cap;
-	assert(outl->capCurves);
-	if (outl->capCurves > UINT16_MAX / 2)
-		return -1;
-	cap = (uint_fast16_t) (2U * outl->capCurves);
-	if (!(mem = reallocarray(outl->curves, cap, sizeof *outl->curves)))
-		return -1;
-	outl->capCurves = (uint_least16_t) cap;
-	outl->curves    = mem;
+	KernPair *pair;
+	uint_fast32_t slot;
+	if (key == KERN_EMPTY)
+		return 0;
+	for (slot = kern_hash(key, font->kernShift);; slot = (slot + 1) & font->kernMask) {
+		pair = &font->kernPairs[slot];
+		if (pair->key == KERN_EMPTY) {
+			pair->key = (uint_least32_t) key;
+			break;
+		}
+		if (pair->key == key)
+			break;
+	}
+	pair->xShift = (int_least16_t) (pair->xShift + xShift);
+	pair->yShift = (int_least16_t) (pair->yShift + yShift);
 	return 0;
 }
 
-static int
-grow_lines(Outline *outl)
+static void
+kern_lookup(const SFT *sft, SFT_Glyph leftGlyph, SFT_Glyph rightGlyph, SFT_Kerning *kerning)
 {
-	void *mem;
-	uint_fast16_t cap;
-	assert(outl->capLines);
+	const SFT_Font *font = sft->font;
+	const KernPair *pair;
+	uint_fast32_t key, slot;
+
+	kerning->xShift = 0.0;
+	kerning->yShift = 0.0;
+	if (!font->kernPairs || leftGlyph > 0xFFFF || rightGlyph > 0xFFFF)
+		return;
+	key = (uint_fast32_t) leftGlyph << 16 | rightGlyph;
+	for (slot = kern_hash(key, font->kernShift);; slot = (slot + 1) & font->kernMask) {
+		pair = &font->kernPairs[slot];
+		if (pair->key == key) {
+			kerning->xShift = (double) pair->xShift / font->unitsPerEm * sft->xScale;
+			kerning->yShift = (double) pair->yShift / font->unitsPerEm * sft->yScale;
+			return;
+		}
+		if (pair->key == KERN_EMPTY)
+			return;
+	}
+}
+
+static inline Point
+outline_point(const Outline *outl, uint_fast16_t i)
+{
+	return (Point) { outl->xs[i], outl->ys[i] };
+}
+
+/* Stores the midpoint of the points a and b as point dst. */
+static void
+midpoint(Outline *outl, uint_fast16_t dst, uint_fast16_t a, uint_fast16_t b)
+{
+	outl->xs[dst] = REAL(0.5) * (outl->xs[a] + outl->xs[b]);
+	outl->ys[dst] = REAL(0.5) * (outl->ys[a] + outl->ys[b]);
+}
+
+/* The vector kernels do what the scalar loops of transform_points() and clip_points() do, in the
+ * same order of operations, so the points come out bit identical. They return the number of
+ * points they handled, the scalar loops take the rest. */
+#if SCHRIFT_SSE2
+static unsigned int
+transform_points_sse2(unsigned int numPts, Real *xs, Real *ys, const Real m[6])
+{
+	const Real128 a = R128_SET1(m[0]), b = R128_SET1(m[1]), c = R128_SET1(m[2]);
+	const Real128 d = R128_SET1(m[3]), e = R128_SET1(m[4]), f = R128_SET1(m[5]);
+	Real128 x, y;
+	unsigned int i;
+	for (i = 0; i + R128_LANES <= numPts; i += R128_LANES) {
+		x = R128_LOAD(xs + i);
+		y = R128_LOAD(ys + i);
+		R128_STORE(xs + i, R128_ADD(R128_ADD(R128_MUL(x, a), R128_MUL(y, c)), e));
+		R128_STORE(ys + i, R128_ADD(R128_ADD(R128_MUL(x, b), R128_MUL(y, d)), f));
+	}
+	return i;
+}
+
+/* max(0, v) returns v on a tie, so -0 stays -0 like with the scalar compare. */
+static unsigned int
+clip_points_sse2(unsigned int numPts, Real *xs, Real *ys, Real xMax, Real yMax)
+{
+	const Real128 zero = R128_SET1(0), xm = R128_SET1(xMax), ym = R128_SET1(yMax);
+	unsigned int i;
+	for (i = 0; i + R128_LANES <= numPts; i += R128_LANES) {
+		R128_STORE(xs + i, R128_MIN(R128_MAX(zero, R128_LOAD(xs + i)), xm));
+		R128_STORE(ys + i, R128_MIN(R128_MAX(zero, R128_LOAD(ys + i)), ym));
+	}
+	return i;
+}
+#endif
+
+#if SCHRIFT_AVX2
+TARGET_AVX2 static unsigned int
+transform_points_avx2(unsigned int numPts, Real *xs, Real *ys, const Real m[6])
+{
+	const Real256 a = R256_SET1(m[0]), b = R256_SET1(m[1]), c = R256_SET1(m[2]);
+	const Real256 d = R256_SET1(m[3]), e = R256_SET1(m[4]), f = R256_SET1(m[5]);
+	Real256 x, y;
+	unsigned int i;
+	for (i = 0; i + R256_LANES <= numPts; i += R256_LANES) {
+		x = R256_LOAD(xs + i);
+		y = R256_LOAD(ys + i);
+		R256_STORE(xs + i, R256_ADD(R256_ADD(R256_MUL(x, a), R256_MUL(y, c)), e));
+		R256_STORE(ys + i, R256_ADD(R256_ADD(R256_MUL(x, b), R256_MUL(y, d)), f));
+	}
+	return i;
+}
+
+TARGET_AVX2 static unsigned int
+clip_points_avx2(unsigned int numPts, Real *xs, Real *ys, Real xMax, Real yMax)
+{
+	const Real256 zero = R256_SET1(0), xm = R256_SET1(xMax), ym = R256_SET1(yMax);
+	unsigned int i;
+	for (i = 0; i + R256_LANES <= numPts; i += R256_LANES) {
+		R256_STORE(xs + i, R256_MIN(R256_MAX(zero, R256_LOAD(xs + i)), xm));
+		R256_STORE(ys + i, R256_MIN(R256_MAX(zero, R256_LOAD(ys + i)), ym));
+	}
+	return i;
+}
+#endif
+
+/* Applies an affine linear transformation matrix to a set of points. */
+static void
+transform_points(unsigned int numPts, Real *xs, Real *ys, double trf[6])
+{
+	const Real m[6] = {
+		(Real) trf[0], (Real) trf[1], (Real) trf[2],
+		(Real) trf[3], (Real) trf[4], (Real) trf[5]
+	};
+	Real x, y;
+	unsigned int i = 0;
+#if SCHRIFT_AVX2
+	if (has_avx2()) {
+		i = transform_points_avx2(numPts, xs, ys, m);
+	} else
+#endif
+	{
+#if SCHRIFT_SSE2
+		i = transform_points_sse2(numPts, xs, ys, m);
+#endif
+	}
+	for (; i < numPts; ++i) {
+		x = xs[i];
+		y = ys[i];
+		xs[i] = x * m[0] + y * m[2] + m[4];
+		ys[i] = x * m[1] + y * m[3] + m[5];
+	}
+}
+
+static void
+clip_points(unsigned int numPts, Real *xs, Real *ys, int width, int height)
+{
+	const Real xMax = REAL_BELOW(width), yMax = REAL_BELOW(height);
+	unsigned int i = 0;
+#if SCHRIFT_AVX2
+	if (has_avx2()) {
+		i = clip_points_avx2(numPts, xs, ys, xMax, yMax);
+	} else
+#endif
+	{
+#if SCHRIFT_SSE2
+		i = clip_points_sse2(numPts, xs, ys, xMax, yMax);
+#endif
+	}
+	for (; i < numPts; ++i) {
+		if (xs[i] < 0)
+			xs[i] = 0;
+		if (xs[i] > xMax)
+			xs[i] = xMax;
+		if (ys[i] < 0)
+			ys[i] = 0;
+		if (ys[i] > yMax)
+			ys[i] = yMax;
+	}
+}
+
+static int
+init_outline(Outline *outl)
+{
+	/* TODO Smaller initial allocations */
+	outl->numPoints = 0;
+	outl->capPoints = 64;
+	if (!(outl->xs = malloc(outl->capPoints * sizeof *outl->xs)))
+		return -1;
+	if (!(outl->ys = malloc(outl->capPoints * sizeof *outl->ys)))
+		return -1;
+	outl->numCurves = 0;
+	outl->capCurves = 64;
+	if (!(outl->curves = malloc(outl->capCurves * sizeof *outl->curves)))
+		return -1;
+	outl->numLines = 0;
+	outl->capLines = 64;
+	if (!(outl->lines = malloc(outl->capLines * sizeof *outl->lines)))
+		return -1;
+	return 0;
+}
+
+static void
+free_outline(Outline *outl)
+{
+	free(outl->xs);
+	free(outl->ys);
+	free(outl->curves);
+	free(outl->lines);
+}
+
+static int
+grow_points(Outline *outl)
+{
+	void *mem;
+	uint_fast16_t cap;
+	assert(outl->capPoints);
+	/* Since we use uint_fast16_t for capacities, we have to be extra careful not to trigger integer overflow. */
+	if (outl->capPoints > UINT16_MAX / 2)
+		return -1;
+	cap = (uint_fast16_t) (2U * outl->capPoints);
+	if (!(mem = reallocarray(outl->xs, cap, sizeof *outl->xs)))
+		return -1;
+	outl->xs = mem;
+	if (!(mem = reallocarray(outl->ys, cap, sizeof *outl->ys)))
+		return -1;
+	outl->ys = mem;
+	outl->capPoints = (uint_least16_t) cap;
+	return 0;
+}
+
+static int
+grow_curves(Outline *outl)
+{
+	void *mem;
+	uint_fast16_t cap;
+	assert(outl->capCurves);
+	if (outl->capCurves > UINT16_MAX / 2)
+		return -1;
+	cap = (uint_fast16_t) (2U * outl->capCurves);
+	if (!(mem = reallocarray(outl->curves, cap, sizeof *outl->curves)))
+		return -1;
+	outl->capCurves = (uint_least16_t) cap;
+	outl->curves    = mem;
+	return 0;
+}
+
+static int
+grow_lines(Outline *outl)
+{
+	void *mem;
+	uint_fast16_t cap;
+	assert(outl->capLines);
 	if (outl->capLines > UINT16_MAX / 2)
 		return -1;
 	cap = (uint_fast16_t) (2U * outl->capLines);
@@ -683,6 +1395,14 @@ is_safe_offset(SFT_Font *font, uint_fast32_t offset, uint_fast32_t margin)
 	return 1;
 }
 
+/* Bounds check of hmtx, loca and glyf data, free for fonts validated at load.
+ * Callers make sure the glyph id is below numGlyphs first. */
+static inline int
+is_safe_glyph_data(SFT_Font *font, uint_fast32_t offset, uint_fast32_t margin)
+{
+	return font->trusted || is_safe_offset(font, offset, margin);
+}
+
 /* Like bsearch(), but returns the next highest element if key could not be found. */
 static void *
 csearch(const void *key, const void *base,
@@ -735,9 +1455,7 @@ static inline uint_least16_t
 getu16(SFT_Font *font, uint_fast32_t offset)
 {
 	assert(offset + 2 <= font->size);
-	const uint8_t *base = font->memory + offset;
-	uint_least16_t b1 = base[0], b0 = base[1]; 
-	return (uint_least16_t) (b1 << 8 | b0);
+	return be_load16(font->memory + offset);
 }
 
 static inline int16_t
@@ -750,13 +1468,11 @@ static inline uint32_t
 getu32(SFT_Font *font, uint_fast32_t offset)
 {
 	assert(offset + 4 <= font->size);
-	const uint8_t *base = font->memory + offset;
-	uint_least32_t b3 = base[0], b2 = base[1], b1 = base[2], b0 = base[3]; 
-	return (uint_least32_t) (b3 << 24 | b2 << 16 | b1 << 8 | b0);
+	return be_load32(font->memory + offset);
 }
 
 static int
-gettable(SFT_Font *font, char tag[4], uint_fast32_t *offset)
+find_table(SFT_Font *font, const char tag[4], uint_fast32_t *offset, uint_fast32_t *length)
 {
 	void *match;
 	unsigned int numTables;
@@ -767,9 +1483,17 @@ gettable(SFT_Font *font, char tag[4], uint_fast32_t *offset)
 	if (!(match = bsearch(tag, font->memory + 12, numTables, 16, cmpu32)))
 		return -1;
 	*offset = getu32(font, (uint_fast32_t) ((uint8_t *) match - font->memory + 8));
+	*length = getu32(font, (uint_fast32_t) ((uint8_t *) match - font->memory + 12));
 	return 0;
 }
 
+static inline int
+gettable(SFT_Font *font, int table, uint_fast32_t *offset)
+{
+	*offset = font->tables[table];
+	return *offset ? 0 : -1;
+}
+
 static int
 cmap_fmt4(SFT_Font *font, uint_fast32_t table, SFT_UChar charCode, SFT_Glyph *glyph)
 {
@@ -847,7 +1571,7 @@ static int
 cmap_fmt12_13(SFT_Font *font, uint_fast32_t table, SFT_UChar charCode, SFT_Glyph *glyph, int which)
 {
 	uint32_t len, numEntries;
-	uint_fast32_t i;
+	uint_fast32_t i, lo, hi;
 
 	*glyph = 0;
 
@@ -865,43 +1589,58 @@ cmap_fmt12_13(SFT_Font *font, uint_fast32_t table, SFT_UChar charCode, SFT_Glyph
 		return -1;
 
 	numEntries = getu32(font, table + 12);
+	if ((len - 16) / 12 < numEntries)
+		return -1;
 
-	for (i = 0; i < numEntries; ++i) {
+	/* Groups are sorted by start code, binary search for the last one starting at or before charCode. */
+	lo = 0;
+	hi = numEntries;
+	while (lo < hi) {
+		i = lo + (hi - lo) / 2;
+		if (getu32(font, table + (i * 12) + 16) <= charCode)
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	if (lo > 0) {
 		uint32_t firstCode, lastCode, glyphOffset;
+		i = lo - 1;
 		firstCode = getu32(font, table + (i * 12) + 16);
 		lastCode = getu32(font, table + (i * 12) + 16 + 4);
-		if (charCode < firstCode || charCode > lastCode)
-			continue;
-		glyphOffset = getu32(font, table + (i * 12) + 16 + 8);
-		if (which == 12)
-			*glyph = (charCode-firstCode) + glyphOffset;
-		else
-			*glyph = glyphOffset;
-		return 0;
+		if (charCode <= lastCode) {
+			glyphOffset = getu32(font, table + (i * 12) + 16 + 8);
+			if (which == 12)
+				*glyph = (charCode-firstCode) + glyphOffset;
+			else
+				*glyph = glyphOffset;
+			return 0;
+		}
 	}
 
 	return 0;
 }
 
-/* Maps Unicode code points to glyph indices. */
+static const uint_least16_t cmapZeroPage[CMAP_PAGE_SIZE];
+
+/* Picks the cmap subtable once, full repertoire maps before BMP ones. */
 static int
-glyph_id(SFT_Font *font, SFT_UChar charCode, SFT_Glyph *glyph)
+select_cmap(SFT_Font *font)
 {
 	uint_fast32_t cmap, entry, table;
 	unsigned int idx, numEntries;
-	int type, format;
-	
-	*glyph = 0;
+	int type;
 
-	if (gettable(font, "cmap", &cmap) < 0)
-		return -1;
+	font->cmapFormat = -1;
+
+	if (gettable(font, TableCmap, &cmap) < 0)
+		return 0;
 
 	if (!is_safe_offset(font, cmap, 4))
-		return -1;
+		return 0;
 	numEntries = getu16(font, cmap + 2);
 
 	if (!is_safe_offset(font, cmap, 4 + numEntries * 8))
-		return -1;
+		return 0;
 
 	/* First look for a 'full repertoire'/non-BMP map. */
 	for (idx = 0; idx < numEntries; ++idx) {
@@ -911,15 +1650,12 @@ glyph_id(SFT_Font *font, SFT_UChar charCode, SFT_Glyph *glyph)
 		if (type == 0004 || type == 0312) {
 			table = cmap + getu32(font, entry + 4);
 			if (!is_safe_offset(font, table, 8))
-				return -1;
-			/* Dispatch based on cmap format. */
-			format = getu16(font, table);
-			switch (format) {
-			case 12:
-				return cmap_fmt12_13(font, table, charCode, glyph, 12);
-			default:
-				return -1;
+				return 0;
+			if (getu16(font, table) == 12) {
+				font->cmapTable  = table;
+				font->cmapFormat = 12;
 			}
+			return 0;
 		}
 	}
 
@@ -931,32 +1667,113 @@ glyph_id(SFT_Font *font, SFT_UChar charCode, SFT_Glyph *glyph)
 		if (type == 0003 || type == 0301) {
 			table = cmap + getu32(font, entry + 4);
 			if (!is_safe_offset(font, table, 6))
-				return -1;
-			/* Dispatch based on cmap format. */
+				return 0;
 			switch (getu16(font, table)) {
 			case 4:
-				return cmap_fmt4(font, table + 6, charCode, glyph);
 			case 6:
-				return cmap_fmt6(font, table + 6, charCode, glyph);
-			default:
+				font->cmapTable  = table + 6;
+				font->cmapFormat = getu16(font, table);
+				break;
+			}
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+/* Resolves the hot BMP pages (Latin, punctuation, box drawing, CJK symbols, unified ideographs
+ * and full width forms) into direct arrays. Pages the font maps nothing in share one zero page. */
+static int
+init_cmap(SFT_Font *font)
+{
+	static const uint8_t hotPages[][2] = {
+		{ 0x00, 0x05 }, { 0x1E, 0x1E }, { 0x20, 0x27 }, { 0x30, 0x30 }, { 0x4E, 0x9F }, { 0xFF, 0xFF }
+	};
+	uint_least16_t *page;
+	SFT_Glyph glyph;
+	unsigned int r, p, c, used;
+
+	select_cmap(font);
+	/* Format 6 is a direct array already. */
+	if (font->cmapFormat != 4 && font->cmapFormat != 12)
+		return 0;
+
+	for (r = 0; r < sizeof hotPages / sizeof hotPages[0]; ++r) {
+		for (p = hotPages[r][0]; p <= hotPages[r][1]; ++p) {
+			if (!(page = malloc(CMAP_PAGE_SIZE * sizeof *page)))
 				return -1;
+			used = 0;
+			for (c = 0; c < CMAP_PAGE_SIZE; ++c) {
+				if (cmap_lookup(font, (p << CMAP_PAGE_SHIFT) | c, &glyph) < 0 || glyph > 0xFFFF)
+					break;
+				page[c] = (uint_least16_t) glyph;
+				used |= glyph != 0;
 			}
+			/* Pages the subtable can not answer cleanly keep the slow path and its errors. */
+			if (c < CMAP_PAGE_SIZE || !used) {
+				free(page);
+				page = c < CMAP_PAGE_SIZE ? NULL : (uint_least16_t *) cmapZeroPage;
+			}
+			font->cmapPages[p] = page;
 		}
 	}
+	return 0;
+}
 
-	return -1;
+static void
+free_cmap(SFT_Font *font)
+{
+	unsigned int p;
+	for (p = 0; p < CMAP_NUM_PAGES; ++p) {
+		if (font->cmapPages[p] != cmapZeroPage)
+			free((void *) font->cmapPages[p]);
+		font->cmapPages[p] = NULL;
+	}
+}
+
+/* Looks a code point up in the selected subtable. */
+static int
+cmap_lookup(SFT_Font *font, SFT_UChar charCode, SFT_Glyph *glyph)
+{
+	*glyph = 0;
+	switch (font->cmapFormat) {
+	case 4:
+		return cmap_fmt4(font, font->cmapTable, charCode, glyph);
+	case 6:
+		return cmap_fmt6(font, font->cmapTable, charCode, glyph);
+	case 12:
+		return cmap_fmt12_13(font, font->cmapTable, charCode, glyph, 12);
+	default:
+		return -1;
+	}
+}
+
+/* Maps Unicode code points to glyph indices. */
+static int
+glyph_id(SFT_Font *font, SFT_UChar charCode, SFT_Glyph *glyph)
+{
+	const uint_least16_t *page;
+	if (charCode <= 0xFFFF && (page = font->cmapPages[charCode >> CMAP_PAGE_SHIFT])) {
+		*glyph = page[charCode & (CMAP_PAGE_SIZE - 1)];
+		return 0;
+	}
+	return cmap_lookup(font, charCode, glyph);
 }
 
 static int
 hor_metrics(SFT_Font *font, SFT_Glyph glyph, int *advanceWidth, int *leftSideBearing)
 {
 	uint_fast32_t hmtx, offset, boundary;
-	if (gettable(font, "hmtx", &hmtx) < 0)
+	if (gettable(font, TableHmtx, &hmtx) < 0)
+		return -1;
+	/* Validation only vouches for the glyphs the font has. */
+	if (font->trusted && glyph >= font->numGlyphs)
 		return -1;
 	if (glyph < font->numLongHmtx) {
 		/* glyph is inside long metrics segment. */
 		offset = hmtx + 4 * glyph;
-		if (!is_safe_offset(font, offset, 4))
+		if (!is_safe_glyph_data(font, offset, 4))
 			return -1;
 		*advanceWidth = getu16(font, offset);
 		*leftSideBearing = geti16(font, offset + 2);
@@ -968,12 +1785,12 @@ hor_metrics(SFT_Font *font, SFT_Glyph glyph, int *advanceWidth, int *leftSideBea
 			return -1;
 		
 		offset = boundary - 4;
-		if (!is_safe_offset(font, offset, 4))
+		if (!is_safe_glyph_data(font, offset, 4))
 			return -1;
 		*advanceWidth = getu16(font, offset);
 		
 		offset = boundary + 2 * (glyph - font->numLongHmtx);
-		if (!is_safe_offset(font, offset, 2))
+		if (!is_safe_glyph_data(font, offset, 2))
 			return -1;
 		*leftSideBearing = geti16(font, offset);
 		return 0;
@@ -983,7 +1800,6 @@ hor_metrics(SFT_Font *font, SFT_Glyph glyph, int *advanceWidth, int *leftSideBea
 static int
 glyph_bbox(const SFT *sft, uint_fast32_t outline, int box[4])
 {
-	double xScale, yScale;
 	/* Read the bounding box from the font file verbatim. */
 	if (!is_safe_offset(sft->font, outline, 10))
 		return -1;
@@ -991,6 +1807,13 @@ glyph_bbox(const SFT *sft, uint_fast32_t outline, int box[4])
 	box[1] = geti16(sft->font, outline + 4);
 	box[2] = geti16(sft->font, outline + 6);
 	box[3] = geti16(sft->font, outline + 8);
+	return scale_bbox(sft, box);
+}
+
+static int
+scale_bbox(const SFT *sft, int box[4])
+{
+	double xScale, yScale;
 	if (box[2] <= box[0] || box[3] <= box[1])
 		return -1;
 	/* Transform the bounding box into SFT coordinate space. */
@@ -1003,6 +1826,88 @@ glyph_bbox(const SFT *sft, uint_fast32_t outline, int box[4])
 	return 0;
 }
 
+/* hor_metrics() of every glyph into the metrics table, -1 unless hmtx is whole.
+ * scratch needs room for 2 * numGlyphs values. */
+static int
+bulk_hor_metrics(SFT_Font *font, uint16_t *scratch)
+{
+	uint_fast32_t hmtx, n = font->numGlyphs, numLong = MIN(font->numLongHmtx, n), i;
+	uint_least16_t lastAdvance;
+	if (gettable(font, TableHmtx, &hmtx) < 0 || !numLong)
+		return -1;
+	if (!is_safe_offset(font, hmtx, 4 * numLong + 2 * (n - numLong)))
+		return -1;
+	be_decode16(scratch, font->memory + hmtx, 2 * numLong);
+	for (i = 0; i < numLong; ++i) {
+		font->mtxAdvance[i] = scratch[2 * i];
+		font->mtxLsb[i]     = (int_least16_t) scratch[2 * i + 1];
+	}
+	/* The short segment repeats the last advance. */
+	lastAdvance = font->mtxAdvance[numLong - 1];
+	be_decode16(scratch, font->memory + hmtx + 4 * numLong, n - numLong);
+	for (; i < n; ++i) {
+		font->mtxAdvance[i] = lastAdvance;
+		font->mtxLsb[i]     = (int_least16_t) scratch[i - numLong];
+	}
+	return 0;
+}
+
+/* outline_offset() of every glyph, -1 unless loca is whole.
+ * scratch and offsets need room for numGlyphs + 1 values. */
+static int
+bulk_outline_offsets(SFT_Font *font, uint16_t *scratch, uint32_t *offsets)
+{
+	uint_fast32_t loca, glyf, n = font->numGlyphs, i;
+	if (gettable(font, TableLoca, &loca) < 0)
+		return -1;
+	if (gettable(font, TableGlyf, &glyf) < 0)
+		return -1;
+	if (font->locaFormat == 0) {
+		if (!is_safe_offset(font, loca, 2 * (n + 1)))
+			return -1;
+		be_decode16(scratch, font->memory + loca, n + 1);
+		for (i = 0; i <= n; ++i)
+			offsets[i] = 2U * (uint32_t) scratch[i];
+	} else {
+		if (!is_safe_offset(font, loca, 4 * (n + 1)))
+			return -1;
+		be_decode32(offsets, font->memory + loca, n + 1);
+	}
+	for (i = 0; i < n; ++i)
+		offsets[i] = offsets[i] == offsets[i + 1] ? 0 : glyf + offsets[i];
+	return 0;
+}
+
+/* sft_gmetrics() from the eager table, same results without touching the font file. */
+static int
+table_gmetrics(const SFT *sft, SFT_Glyph glyph, SFT_GMetrics *metrics)
+{
+	SFT_Font *font = sft->font;
+	double xScale = sft->xScale / font->unitsPerEm;
+	int bbox[4];
+
+	if (font->mtxState[glyph] == GlyphNoHmtx)
+		return -1;
+	metrics->advanceWidth    = font->mtxAdvance[glyph] * xScale;
+	metrics->leftSideBearing = font->mtxLsb[glyph] * xScale + sft->xOffset;
+
+	if (font->mtxState[glyph] == GlyphBroken)
+		return -1;
+	if (font->mtxState[glyph] == GlyphEmpty)
+		return 0;
+	bbox[0] = font->mtxBox[0][glyph];
+	bbox[1] = font->mtxBox[1][glyph];
+	bbox[2] = font->mtxBox[2][glyph];
+	bbox[3] = font->mtxBox[3][glyph];
+	if (scale_bbox(sft, bbox) < 0)
+		return -1;
+	metrics->minWidth  = bbox[2] - bbox[0] + 1;
+	metrics->minHeight = bbox[3] - bbox[1] + 1;
+	metrics->yOffset   = sft->flags & SFT_DOWNWARD_Y ? -bbox[3] : bbox[1];
+
+	return 0;
+}
+
 /* Returns the offset into the font that the glyph's outline is stored at. */
 static int
 outline_offset(SFT_Font *font, SFT_Glyph glyph, uint_fast32_t *offset)
@@ -1010,15 +1915,17 @@ outline_offset(SFT_Font *font, SFT_Glyph glyph, uint_fast32_t *offset)
 	uint_fast32_t loca, glyf;
 	uint_fast32_t base, this, next;
 
-	if (gettable(font, "loca", &loca) < 0)
+	if (gettable(font, TableLoca, &loca) < 0)
+		return -1;
+	if (gettable(font, TableGlyf, &glyf) < 0)
 		return -1;
-	if (gettable(font, "glyf", &glyf) < 0)
+	if (font->trusted && glyph >= font->numGlyphs)
 		return -1;
 
 	if (font->locaFormat == 0) {
 		base = loca + 2 * glyph;
 
-		if (!is_safe_offset(font, base, 4))
+		if (!is_safe_glyph_data(font, base, 4))
 			return -1;
 		
 		this = 2U * (uint_fast32_t) getu16(font, base);
@@ -1026,7 +1933,7 @@ outline_offset(SFT_Font *font, SFT_Glyph glyph, uint_fast32_t *offset)
 	} else {
 		base = loca + 4 * glyph;
 
-		if (!is_safe_offset(font, base, 8))
+		if (!is_safe_glyph_data(font, base, 8))
 			return -1;
 
 		this = getu32(font, base);
@@ -1065,7 +1972,7 @@ simple_flags(SFT_Font *font, uint_fast32_t *offset, uint_fast16_t numPts, uint8_
 
 /* For a 'simple' outline, decodes both X and Y coordinates for each point of the outline. */
 static int
-simple_points(SFT_Font *font, uint_fast32_t offset, uint_fast16_t numPts, uint8_t *flags, Point *points)
+simple_points(SFT_Font *font, uint_fast32_t offset, uint_fast16_t numPts, uint8_t *flags, Real *xs, Real *ys)
 {
 	long accum, value, bit;
 	uint_fast16_t i;
@@ -1084,7 +1991,7 @@ simple_points(SFT_Font *font, uint_fast32_t offset, uint_fast16_t numPts, uint8_
 			accum += geti16(font, offset);
 			offset += 2;
 		}
-		points[i].x = (double) accum;
+		xs[i] = (Real) accum;
 	}
 
 	accum = 0L;
@@ -1101,12 +2008,65 @@ simple_points(SFT_Font *font, uint_fast32_t offset, uint_fast16_t numPts, uint8_
 			accum += geti16(font, offset);
 			offset += 2;
 		}
-		points[i].y = (double) accum;
+		ys[i] = (Real) accum;
 	}
 
 	return 0;
 }
 
+/* simple_flags() for validated glyph records, returns where the coordinates start. */
+static const uint8_t *
+simple_flags_unchecked(const uint8_t *data, uint_fast16_t numPts, uint8_t *flags)
+{
+	uint_fast16_t i;
+	uint8_t value = 0, repeat = 0;
+	for (i = 0; i < numPts; ++i) {
+		if (repeat) {
+			--repeat;
+		} else {
+			value = *data++;
+			if (value & REPEAT_FLAG)
+				repeat = *data++;
+		}
+		flags[i] = value;
+	}
+	return data;
+}
+
+/* simple_points() for validated glyph records. */
+static void
+simple_points_unchecked(const uint8_t *data, uint_fast16_t numPts, const uint8_t *flags, Real *xs, Real *ys)
+{
+	long accum, value, bit;
+	uint_fast16_t i;
+
+	accum = 0L;
+	for (i = 0; i < numPts; ++i) {
+		if (flags[i] & X_CHANGE_IS_SMALL) {
+			value = (long) *data++;
+			bit = !!(flags[i] & X_CHANGE_IS_POSITIVE);
+			accum -= (value ^ -bit) + bit;
+		} else if (!(flags[i] & X_CHANGE_IS_ZERO)) {
+			accum += (int16_t) be_load16(data);
+			data += 2;
+		}
+		xs[i] = (Real) accum;
+	}
+
+	accum = 0L;
+	for (i = 0; i < numPts; ++i) {
+		if (flags[i] & Y_CHANGE_IS_SMALL) {
+			value = (long) *data++;
+			bit = !!(flags[i] & Y_CHANGE_IS_POSITIVE);
+			accum -= (value ^ -bit) + bit;
+		} else if (!(flags[i] & Y_CHANGE_IS_ZERO)) {
+			accum += (int16_t) be_load16(data);
+			data += 2;
+		}
+		ys[i] = (Real) accum;
+	}
+}
+
 static int
 decode_contour(uint8_t *flags, uint_fast16_t basePoint, uint_fast16_t count, Outline *outl)
 {
@@ -1131,9 +2091,7 @@ decode_contour(uint8_t *flags, uint_fast16_t basePoint, uint_fast16_t count, Out
 			return -1;
 
 		looseEnd = outl->numPoints;
-		outl->points[outl->numPoints++] = midpoint(
-			outl->points[basePoint],
-			outl->points[basePoint + count - 1]);
+		midpoint(outl, outl->numPoints++, basePoint, basePoint + count - 1);
 	}
 	beg = looseEnd;
 	gotCtrl = 0;
@@ -1161,7 +2119,7 @@ decode_contour(uint8_t *flags, uint_fast16_t basePoint, uint_fast16_t count, Out
 				center = outl->numPoints;
 				if (outl->numPoints >= outl->capPoints && grow_points(outl) < 0)
 					return -1;
-				outl->points[center] = midpoint(outl->points[ctrl], outl->points[cur]);
+				midpoint(outl, center, ctrl, cur);
 				++outl->numPoints;
 
 				if (outl->numCurves >= outl->capCurves && grow_curves(outl) < 0)
@@ -1199,7 +2157,7 @@ simple_outline(SFT_Font *font, uint_fast32_t offset, unsigned int numContours, O
 
 	uint_fast16_t basePoint = outl->numPoints;
 
-	if (!is_safe_offset(font, offset, numContours * 2 + 2))
+	if (!is_safe_glyph_data(font, offset, numContours * 2 + 2))
 		goto failure;
 	numPts = getu16(font, offset + (numContours - 1) * 2);
 	if (numPts >= UINT16_MAX)
@@ -1233,10 +2191,15 @@ simple_outline(SFT_Font *font, uint_fast32_t offset, unsigned int numContours, O
 	}
 	offset += 2U + getu16(font, offset);
 
-	if (simple_flags(font, &offset, numPts, flags) < 0)
-		goto failure;
-	if (simple_points(font, offset, numPts, flags, outl->points + basePoint) < 0)
-		goto failure;
+	if (font->trusted) {
+		simple_points_unchecked(simple_flags_unchecked(font->memory + offset, numPts, flags),
+			numPts, flags, outl->xs + basePoint, outl->ys + basePoint);
+	} else {
+		if (simple_flags(font, &offset, numPts, flags) < 0)
+			goto failure;
+		if (simple_points(font, offset, numPts, flags, outl->xs + basePoint, outl->ys + basePoint) < 0)
+			goto failure;
+	}
 	outl->numPoints = (uint_least16_t) (outl->numPoints + numPts);
 
 	uint_fast16_t beg = 0;
@@ -1262,12 +2225,13 @@ compound_outline(SFT_Font *font, uint_fast32_t offset, int recDepth, Outline *ou
 	double local[6];
 	uint_fast32_t outline;
 	unsigned int flags, glyph, basePoint;
+	CachedOutline *cached;
 	/* Guard against infinite recursion (compound glyphs that have themselves as component). */
 	if (recDepth >= 4)
 		return -1;
 	do {
 		memset(local, 0, sizeof local);
-		if (!is_safe_offset(font, offset, 4))
+		if (!is_safe_glyph_data(font, offset, 4))
 			return -1;
 		flags = getu16(font, offset);
 		glyph = getu16(font, offset + 2);
@@ -1277,32 +2241,32 @@ compound_outline(SFT_Font *font, uint_fast32_t offset, int recDepth, Outline *ou
 			return -1;
 		/* Read additional X and Y offsets (in FUnits) of this component. */
 		if (flags & OFFSETS_ARE_LARGE) {
-			if (!is_safe_offset(font, offset, 4))
+			if (!is_safe_glyph_data(font, offset, 4))
 				return -1;
 			local[4] = geti16(font, offset);
 			local[5] = geti16(font, offset + 2);
 			offset += 4;
 		} else {
-			if (!is_safe_offset(font, offset, 2))
+			if (!is_safe_glyph_data(font, offset, 2))
 				return -1;
 			local[4] = geti8(font, offset);
 			local[5] = geti8(font, offset + 1);
 			offset += 2;
 		}
 		if (flags & GOT_A_SINGLE_SCALE) {
-			if (!is_safe_offset(font, offset, 2))
+			if (!is_safe_glyph_data(font, offset, 2))
 				return -1;
 			local[0] = geti16(font, offset) / 16384.0;
 			local[3] = local[0];
 			offset += 2;
 		} else if (flags & GOT_AN_X_AND_Y_SCALE) {
-			if (!is_safe_offset(font, offset, 4))
+			if (!is_safe_glyph_data(font, offset, 4))
 				return -1;
 			local[0] = geti16(font, offset + 0) / 16384.0;
 			local[3] = geti16(font, offset + 2) / 16384.0;
 			offset += 4;
 		} else if (flags & GOT_A_SCALE_MATRIX) {
-			if (!is_safe_offset(font, offset, 8))
+			if (!is_safe_glyph_data(font, offset, 8))
 				return -1;
 			local[0] = geti16(font, offset + 0) / 16384.0;
 			local[1] = geti16(font, offset + 2) / 16384.0;
@@ -1317,13 +2281,23 @@ compound_outline(SFT_Font *font, uint_fast32_t offset, int recDepth, Outline *ou
 		 * But stb_truetype scales by the L2 norm. And FreeType2 doesn't scale at all.
 		 * Furthermore, Microsoft's spec doesn't even mention anything like this.
 		 * It's almost as if nobody ever uses this feature anyway. */
+		if (font->outlines) {
+			/* Components are decoded once and shared by every glyph using them. */
+			basePoint = outl->numPoints;
+			if (cached_outline(font, glyph, recDepth + 1, &cached) < 0)
+				return -1;
+			if (append_outline(outl, cached) < 0)
+				return -1;
+			transform_points(outl->numPoints - basePoint, outl->xs + basePoint, outl->ys + basePoint, local);
+			continue;
+		}
 		if (outline_offset(font, glyph, &outline) < 0)
 			return -1;
 		if (outline) {
 			basePoint = outl->numPoints;
 			if (decode_outline(font, outline, recDepth + 1, outl) < 0)
 				return -1;
-			transform_points(outl->numPoints - basePoint, outl->points + basePoint, local);
+			transform_points(outl->numPoints - basePoint, outl->xs + basePoint, outl->ys + basePoint, local);
 		}
 	} while (flags & THERE_ARE_MORE_COMPONENTS);
 
@@ -1334,7 +2308,7 @@ static int
 decode_outline(SFT_Font *font, uint_fast32_t offset, int recDepth, Outline *outl)
 {
 	int numContours;
-	if (!is_safe_offset(font, offset, 10))
+	if (!is_safe_glyph_data(font, offset, 10))
 		return -1;
 	numContours = geti16(font, offset);
 	if (numContours > 0) {
@@ -1348,72 +2322,96 @@ decode_outline(SFT_Font *font, uint_fast32_t offset, int recDepth, Outline *outl
 	}
 }
 
-/* A heuristic to tell whether a given curve can be approximated closely enough by a line. */
+/* Looks up the decoded outline of a glyph, decoding and caching it on first use.
+ * Glyphs without an outline get an empty entry. */
 static int
-is_flat(Outline *outl, Curve curve)
+cached_outline(SFT_Font *font, SFT_Glyph glyph, int recDepth, CachedOutline **cached)
 {
-	const double maxArea2 = 2.0;
-	Point a = outl->points[curve.beg];
-	Point b = outl->points[curve.ctrl];
-	Point c = outl->points[curve.end];
-	Point g = { b.x-a.x, b.y-a.y };
-	Point h = { c.x-a.x, c.y-a.y };
-	double area2 = fabs(g.x*h.y-h.x*g.y);
-	return area2 <= maxArea2;
-}
-
-static int
-tesselate_curve(Curve curve, Outline *outl)
-{
-	/* From my tests I can conclude that this stack barely reaches a top height
-	 * of 4 elements even for the largest font sizes I'm willing to support. And
-	 * as space requirements should only grow logarithmically, I think 10 is
-	 * more than enough. */
-#define STACK_SIZE 10
-	Curve stack[STACK_SIZE];
-	unsigned int top = 0;
-	for (;;) {
-		if (is_flat(outl, curve) || top >= STACK_SIZE) {
-			if (outl->numLines >= outl->capLines && grow_lines(outl) < 0)
-				return -1;
-			outl->lines[outl->numLines++] = (Line) { curve.beg, curve.end };
-			if (top == 0) break;
-			curve = stack[--top];
-		} else {
-			uint_least16_t ctrl0 = outl->numPoints;
-			if (outl->numPoints >= outl->capPoints && grow_points(outl) < 0)
-				return -1;
-			outl->points[ctrl0] = midpoint(outl->points[curve.beg], outl->points[curve.ctrl]);
-			++outl->numPoints;
-
-			uint_least16_t ctrl1 = outl->numPoints;
-			if (outl->numPoints >= outl->capPoints && grow_points(outl) < 0)
-				return -1;
-			outl->points[ctrl1] = midpoint(outl->points[curve.ctrl], outl->points[curve.end]);
-			++outl->numPoints;
-
-			uint_least16_t pivot = outl->numPoints;
-			if (outl->numPoints >= outl->capPoints && grow_points(outl) < 0)
-				return -1;
-			outl->points[pivot] = midpoint(outl->points[ctrl0], outl->points[ctrl1]);
-			++outl->numPoints;
+	CachedOutline *entry;
+	uint_fast32_t outline;
+	Outline outl;
+	size_t size;
 
-			stack[top++] = (Curve) { curve.beg, pivot, ctrl0 };
-			curve = (Curve) { pivot, curve.end, ctrl1 };
-		}
+	if (glyph >= font->numGlyphs)
+		return -1;
+	if (font->outlines[glyph]) {
+		*cached = font->outlines[glyph];
+		return 0;
 	}
+	if (outline_offset(font, glyph, &outline) < 0)
+		return -1;
+	memset(&outl, 0, sizeof outl);
+	if (init_outline(&outl) < 0)
+		goto failure;
+	if (outline && decode_outline(font, outline, recDepth, &outl) < 0)
+		goto failure;
+	size = sizeof *entry
+		+ outl.numPoints * 2 * sizeof *outl.xs
+		+ outl.numCurves * sizeof *outl.curves
+		+ outl.numLines  * sizeof *outl.lines;
+	if (!(entry = malloc(size)))
+		goto failure;
+	/* Points first, they have the strictest alignment of the arrays. */
+	entry->xs        = (Real  *) (entry + 1);
+	entry->ys        = entry->xs + outl.numPoints;
+	entry->curves    = (Curve *) (entry->ys + outl.numPoints);
+	entry->lines     = (Line  *) (entry->curves + outl.numCurves);
+	entry->numPoints = outl.numPoints;
+	entry->numCurves = outl.numCurves;
+	entry->numLines  = outl.numLines;
+	memcpy(entry->xs,     outl.xs,     outl.numPoints * sizeof *outl.xs);
+	memcpy(entry->ys,     outl.ys,     outl.numPoints * sizeof *outl.ys);
+	memcpy(entry->curves, outl.curves, outl.numCurves * sizeof *outl.curves);
+	memcpy(entry->lines,  outl.lines,  outl.numLines  * sizeof *outl.lines);
+	free_outline(&outl);
+	font->outlines[glyph] = entry;
+	*cached = entry;
 	return 0;
-#undef STACK_SIZE
+
+failure:
+	free_outline(&outl);
+	return -1;
 }
 
+/* Appends a cached outline to a working outline, rebasing its point indices. */
 static int
-tesselate_curves(Outline *outl)
+append_outline(Outline *outl, const CachedOutline *cached)
 {
+	uint_fast16_t basePoint = outl->numPoints;
 	unsigned int i;
-	for (i = 0; i < outl->numCurves; ++i) {
-		if (tesselate_curve(outl->curves[i], outl) < 0)
+
+	if (outl->numPoints > UINT16_MAX - cached->numPoints ||
+	    outl->numCurves > UINT16_MAX - cached->numCurves ||
+	    outl->numLines  > UINT16_MAX - cached->numLines)
+		return -1;
+	while (outl->capPoints < outl->numPoints + cached->numPoints) {
+		if (grow_points(outl) < 0)
+			return -1;
+	}
+	while (outl->capCurves < outl->numCurves + cached->numCurves) {
+		if (grow_curves(outl) < 0)
+			return -1;
+	}
+	while (outl->capLines < outl->numLines + cached->numLines) {
+		if (grow_lines(outl) < 0)
 			return -1;
 	}
+	memcpy(outl->xs + basePoint, cached->xs, cached->numPoints * sizeof *cached->xs);
+	memcpy(outl->ys + basePoint, cached->ys, cached->numPoints * sizeof *cached->ys);
+	for (i = 0; i < cached->numCurves; ++i) {
+		outl->curves[outl->numCurves++] = (Curve) {
+			(uint_least16_t) (cached->curves[i].beg  + basePoint),
+			(uint_least16_t) (cached->curves[i].end  + basePoint),
+			(uint_least16_t) (cached->curves[i].ctrl + basePoint)
+		};
+	}
+	for (i = 0; i < cached->numLines; ++i) {
+		outl->lines[outl->numLines++] = (Line) {
+			(uint_least16_t) (cached->lines[i].beg + basePoint),
+			(uint_least16_t) (cached->lines[i].end + basePoint)
+		};
+	}
+	outl->numPoints = (uint_least16_t) (outl->numPoints + cached->numPoints);
 	return 0;
 }
 
@@ -1424,9 +2422,9 @@ draw_line(Raster buf, Point origin, Point goal)
 	Point delta;
 	Point nextCrossing;
 	Point crossingIncr;
-	double halfDeltaX;
-	double prevDistance = 0.0, nextDistance;
-	double xAverage, yDifference;
+	Real halfDeltaX;
+	Real prevDistance = 0, nextDistance;
+	Real xAverage, yDifference;
 	struct { int x, y; } pixel;
 	struct { int x, y; } dir;
 	int step, numSteps = 0;
@@ -1441,12 +2439,12 @@ draw_line(Raster buf, Point origin, Point goal)
 		return;
 	}
 	
-	crossingIncr.x = dir.x ? fabs(1.0 / delta.x) : 1.0;
-	crossingIncr.y = fabs(1.0 / delta.y);
+	crossingIncr.x = dir.x ? REAL_ABS(1 / delta.x) : 1;
+	crossingIncr.y = REAL_ABS(1 / delta.y);
 
 	if (!dir.x) {
 		pixel.x = fast_floor(origin.x);
-		nextCrossing.x = 100.0;
+		nextCrossing.x = 100;
 	} else {
 		if (dir.x > 0) {
 			pixel.x = fast_floor(origin.x);
@@ -1472,7 +2470,7 @@ draw_line(Raster buf, Point origin, Point goal)
 	}
 
 	nextDistance = MIN(nextCrossing.x, nextCrossing.y);
-	halfDeltaX = 0.5 * delta.x;
+	halfDeltaX = REAL(0.5) * delta.x;
 
 	for (step = 0; step < numSteps; ++step) {
 		xAverage = origin.x + (prevDistance + nextDistance) * halfDeltaX;
@@ -1480,25 +2478,25 @@ draw_line(Raster buf, Point origin, Point goal)
 		cptr = &buf.cells[pixel.y * buf.width + pixel.x];
 		cell = *cptr;
 		cell.cover += yDifference;
-		xAverage -= (double) pixel.x;
-		cell.area += (1.0 - xAverage) * yDifference;
+		xAverage -= (Real) pixel.x;
+		cell.area += (1 - xAverage) * yDifference;
 		*cptr = cell;
 		prevDistance = nextDistance;
 		int alongX = nextCrossing.x < nextCrossing.y;
 		pixel.x += alongX ? dir.x : 0;
 		pixel.y += alongX ? 0 : dir.y;
-		nextCrossing.x += alongX ? crossingIncr.x : 0.0;
-		nextCrossing.y += alongX ? 0.0 : crossingIncr.y;
+		nextCrossing.x += alongX ? crossingIncr.x : 0;
+		nextCrossing.y += alongX ? 0 : crossingIncr.y;
 		nextDistance = MIN(nextCrossing.x, nextCrossing.y);
 	}
 
-	xAverage = origin.x + (prevDistance + 1.0) * halfDeltaX;
-	yDifference = (1.0 - prevDistance) * delta.y;
+	xAverage = origin.x + (prevDistance + 1) * halfDeltaX;
+	yDifference = (1 - prevDistance) * delta.y;
 	cptr = &buf.cells[pixel.y * buf.width + pixel.x];
 	cell = *cptr;
 	cell.cover += yDifference;
-	xAverage -= (double) pixel.x;
-	cell.area += (1.0 - xAverage) * yDifference;
+	xAverage -= (Real) pixel.x;
+	cell.area += (1 - xAverage) * yDifference;
 	*cptr = cell;
 }
 
@@ -1508,62 +2506,595 @@ draw_lines(Outline *outl, Raster buf)
 	unsigned int i;
 	for (i = 0; i < outl->numLines; ++i) {
 		Line  line   = outl->lines[i];
-		Point origin = outl->points[line.beg];
-		Point goal   = outl->points[line.end];
+		Point origin = outline_point(outl, line.beg);
+		Point goal   = outline_point(outl, line.end);
 		draw_line(buf, origin, goal);
 	}
 }
 
-/* Integrate the values in the buffer to arrive at the final grayscale image. */
+/* Number of uniform segments a quadratic Bézier in raster space is flattened into. Wang's formula
+ * bounds the distance between the curve and its segments by |p0 - 2 p1 + p2| / (4 n^2), so the
+ * tolerance is in pixels and holds at every size. */
+static unsigned int
+curve_segments(Point p0, Point p1, Point p2)
+{
+	Point dd;
+	Real len;
+	unsigned int n;
+
+	dd.x = p0.x - 2 * p1.x + p2.x;
+	dd.y = p0.y - 2 * p1.y + p2.y;
+	len = (Real) sqrt(dd.x * dd.x + dd.y * dd.y);
+	n = (unsigned int) ceil(sqrt(len / (4 * FLATNESS)));
+	return n < 1 ? 1 : n > MAX_CURVE_SEGMENTS ? MAX_CURVE_SEGMENTS : n;
+}
+
+/* Stores the curve_segments() + 1 points of a flattened curve in pts, stepped by forward differencing.
+ * Returns the number of segments. */
+static unsigned int
+flatten_curve(Point p0, Point p1, Point p2, int width, int height, Point *pts)
+{
+	Point d1, d2, cur;
+	Real xMax, yMax, h;
+	unsigned int n, i;
+
+	n = curve_segments(p0, p1, p2);
+	h = REAL(1.0) / (Real) n;
+	d1.x = 2 * h * (p1.x - p0.x) + h * h * (p0.x - 2 * p1.x + p2.x);
+	d1.y = 2 * h * (p1.y - p0.y) + h * h * (p0.y - 2 * p1.y + p2.y);
+	d2.x = 2 * h * h * (p0.x - 2 * p1.x + p2.x);
+	d2.y = 2 * h * h * (p0.y - 2 * p1.y + p2.y);
+	/* The curve stays inside the clipped control polygon, rounding may not. */
+	xMax = REAL_BELOW(width);
+	yMax = REAL_BELOW(height);
+
+	pts[0] = cur = p0;
+	for (i = 1; i < n; ++i) {
+		cur.x += d1.x;
+		cur.y += d1.y;
+		d1.x += d2.x;
+		d1.y += d2.y;
+		pts[i].x = cur.x < 0 ? 0 : cur.x > xMax ? xMax : cur.x;
+		pts[i].y = cur.y < 0 ? 0 : cur.y > yMax ? yMax : cur.y;
+		cur = pts[i];
+	}
+	pts[n] = p2;
+	return n;
+}
+
+/* Flattens a quadratic Bézier straight into the buffer. */
 static void
-post_process(Raster buf, uint8_t *image)
+draw_curve(Raster buf, Point p0, Point p1, Point p2)
+{
+	Point pts[MAX_CURVE_SEGMENTS + 1];
+	unsigned int n, i;
+
+	n = flatten_curve(p0, p1, p2, buf.width, buf.height, pts);
+	for (i = 0; i < n; ++i)
+		draw_line(buf, pts[i], pts[i + 1]);
+}
+
+static void
+draw_curves(Outline *outl, Raster buf)
+{
+	unsigned int i;
+	for (i = 0; i < outl->numCurves; ++i) {
+		Curve curve = outl->curves[i];
+		draw_curve(buf, outline_point(outl, curve.beg), outline_point(outl, curve.ctrl), outline_point(outl, curve.end));
+	}
+}
+
+/* Upper bound of the edges build_edges() makes of an outline. */
+static unsigned int
+count_edges(Outline *outl)
+{
+	unsigned int i, num = outl->numLines;
+	for (i = 0; i < outl->numCurves; ++i) {
+		Curve curve = outl->curves[i];
+		num += curve_segments(outline_point(outl, curve.beg), outline_point(outl, curve.ctrl), outline_point(outl, curve.end));
+	}
+	return num;
+}
+
+static void
+add_edge(Edge *edges, unsigned int *num, Point origin, Point goal)
+{
+	Edge *edge;
+	if (origin.y == goal.y)
+		return;
+	edge = &edges[(*num)++];
+	if (origin.y < goal.y) {
+		edge->top    = origin;
+		edge->bottom = goal;
+		edge->dir    = 1;
+	} else {
+		edge->top    = goal;
+		edge->bottom = origin;
+		edge->dir    = -1;
+	}
+	edge->dxdy = (edge->bottom.x - edge->top.x) / (edge->bottom.y - edge->top.y);
+}
+
+/* Collects the lines and flattened curves of a transformed and clipped outline, horizontal ones dropped. */
+static unsigned int
+build_edges(Outline *outl, int width, int height, Edge *edges)
+{
+	Point pts[MAX_CURVE_SEGMENTS + 1];
+	unsigned int i, j, n, num = 0;
+
+	for (i = 0; i < outl->numLines; ++i) {
+		Line line = outl->lines[i];
+		add_edge(edges, &num, outline_point(outl, line.beg), outline_point(outl, line.end));
+	}
+	for (i = 0; i < outl->numCurves; ++i) {
+		Curve curve = outl->curves[i];
+		n = flatten_curve(outline_point(outl, curve.beg), outline_point(outl, curve.ctrl), outline_point(outl, curve.end),
+			width, height, pts);
+		for (j = 0; j < n; ++j)
+			add_edge(edges, &num, pts[j], pts[j + 1]);
+	}
+	return num;
+}
+
+/* Used as a comparison function for qsort(), orders edges by their top. */
+static int
+cmpedge(const void *a, const void *b)
 {
+	Real ya = ((const Edge *) a)->top.y, yb = ((const Edge *) b)->top.y;
+	return (ya > yb) - (ya < yb);
+}
+
+/* Draws the part of an edge within scanline y into a one cell high raster.
+ * Returns the cells it may have touched. */
+static Span
+draw_edge(Raster row, const Edge *edge, int y)
+{
+	Point beg, end;
+	Real xMax;
+	Span span;
+
+	beg = edge->top;
+	end = edge->bottom;
+	if (beg.y < (Real) y) {
+		beg.y = (Real) y;
+		beg.x = edge->top.x + (beg.y - edge->top.y) * edge->dxdy;
+	}
+	if (end.y > (Real) (y + 1)) {
+		end.y = (Real) (y + 1);
+		end.x = edge->top.x + (end.y - edge->top.y) * edge->dxdy;
+	}
+	xMax = REAL_BELOW(row.width);
+	beg.x = beg.x < 0 ? 0 : beg.x > xMax ? xMax : beg.x;
+	end.x = end.x < 0 ? 0 : end.x > xMax ? xMax : end.x;
+	beg.y -= (Real) y;
+	end.y -= (Real) y;
+
+	if (edge->dir > 0)
+		draw_line(row, beg, end);
+	else
+		draw_line(row, end, beg);
+
+	span.beg = fast_floor(beg.x < end.x ? beg.x : end.x);
+	span.end = fast_floor(beg.x < end.x ? end.x : beg.x);
+	return span;
+}
+
+/* Integrates one scanline. Only the cells under the spans are summed up (and zeroed again for the
+ * next scanline), the runs between them have a constant coverage and are filled. */
+static void
+fill_scanline(Cell *cells, uint8_t *pixels, int width, Span *spans, unsigned int numSpans)
+{
+	Span span;
 	Cell cell;
-	double accum = 0.0, value;
-	unsigned int i, num;
-	num = (unsigned int) buf.width * (unsigned int) buf.height;
+	Real accum = 0, value;
+	unsigned int i, j;
+	int x = 0, end;
+
+	/* Few edges cross a scanline, insertion sort is fine. */
+	for (i = 1; i < numSpans; ++i) {
+		span = spans[i];
+		for (j = i; j > 0 && spans[j - 1].beg > span.beg; --j)
+			spans[j] = spans[j - 1];
+		spans[j] = span;
+	}
+
+	for (i = 0; i < numSpans; ) {
+		end = spans[i].end;
+		for (j = i + 1; j < numSpans && spans[j].beg <= end + 1; ++j)
+			end = spans[j].end > end ? spans[j].end : end;
+
+		value = REAL_ABS(accum);
+		value = MIN(value, REAL(1.0));
+		memset(pixels + x, (int) (value * REAL(255.0) + REAL(0.5)), (size_t) (spans[i].beg - x));
+
+		for (x = spans[i].beg; x <= end; ++x) {
+			cell      = cells[x];
+			value     = REAL_ABS(accum + cell.area);
+			value     = MIN(value, REAL(1.0));
+			value     = value * REAL(255.0) + REAL(0.5);
+			pixels[x] = (uint8_t) value;
+			accum    += cell.cover;
+			cells[x]  = (Cell) { 0, 0 };
+		}
+		i = j;
+	}
+
+	value = REAL_ABS(accum);
+	value = MIN(value, REAL(1.0));
+	memset(pixels + x, (int) (value * REAL(255.0) + REAL(0.5)), (size_t) (width - x));
+}
+
+/* Bytes of scratch raster_scanlines() needs: the edges, one scanline of cells, the active list and its spans. */
+static size_t
+scanline_scratch(unsigned int maxEdges, int width)
+{
+	return (size_t) maxEdges * (sizeof(Edge) + sizeof(unsigned int) + sizeof(Span))
+		+ (size_t) width * sizeof(Cell);
+}
+
+/* Rasterizes a transformed and clipped outline a scanline at a time. The edges are sorted by their
+ * top, each scanline draws the part of its active edges within it into a single row of cells,
+ * which is integrated straight into the image. Memory and the zeroing and integration work grow
+ * with the outline and the image height instead of the image area. */
+static void
+raster_scanlines(Outline *outl, SFT_Image image, void *scratch, unsigned int maxEdges)
+{
+	Edge *edges;
+	Cell *cells;
+	unsigned int *active;
+	Span *spans;
+	Raster row;
+	uint8_t *pixels;
+	unsigned int numEdges, numActive = 0, numSpans, next = 0, i;
+	int y;
+
+	edges  = scratch;
+	cells  = (Cell *) (edges + maxEdges);
+	active = (unsigned int *) (cells + image.width);
+	spans  = (Span *) (active + maxEdges);
+
+	numEdges = build_edges(outl, image.width, image.height, edges);
+	qsort(edges, numEdges, sizeof *edges, cmpedge);
+	memset(cells, 0, (size_t) image.width * sizeof *cells);
+	row.cells  = cells;
+	row.width  = image.width;
+	row.height = 1;
+
+	pixels = image.pixels;
+	for (y = 0; y < image.height; ++y, pixels += image.width) {
+		while (next < numEdges && edges[next].top.y < (Real) (y + 1))
+			active[numActive++] = next++;
+
+		numSpans = 0;
+		for (i = 0; i < numActive; ) {
+			if (edges[active[i]].bottom.y <= (Real) y) {
+				active[i] = active[--numActive];
+				continue;
+			}
+			spans[numSpans++] = draw_edge(row, &edges[active[i]], y);
+			++i;
+		}
+
+		fill_scanline(cells, pixels, image.width, spans, numSpans);
+	}
+}
+
+/* Integrate the values in the buffer to arrive at the final grayscale image.
+ * The vector kernels do the bulk of the buffer, the scalar loop the rest. */
+static void
+post_process_scalar(const Cell *cells, uint8_t *image, unsigned int num, Real accum)
+{
+	Cell cell;
+	Real value;
+	unsigned int i;
 	for (i = 0; i < num; ++i) {
-		cell     = buf.cells[i];
-		value    = fabs(accum + cell.area);
-		value    = MIN(value, 1.0);
-		value    = value * 255.0 + 0.5;
+		cell     = cells[i];
+		value    = REAL_ABS(accum + cell.area);
+		value    = MIN(value, REAL(1.0));
+		value    = value * REAL(255.0) + REAL(0.5);
 		image[i] = (uint8_t) value;
 		accum   += cell.cover;
 	}
 }
 
+#if SCHRIFT_SSE2 && !defined(SCHRIFT_FLOAT)
+/* Two cells per vector. The running sum is carried in the same order as the
+ * scalar loop, so the output is bit identical to it. */
+static inline __m128i
+quantize_sse2(const Cell *cells, __m128d *acc)
+{
+	const __m128d sign = _mm_set1_pd(-0.0), one = _mm_set1_pd(1.0);
+	__m128d x0, x1, area, cover, excl, value;
+	x0    = _mm_loadu_pd(&cells[0].area);
+	x1    = _mm_loadu_pd(&cells[1].area);
+	area  = _mm_unpacklo_pd(x0, x1);
+	cover = _mm_unpackhi_pd(x0, x1);
+	/* (accum, accum + c0) */
+	excl  = _mm_add_pd(*acc, _mm_unpacklo_pd(_mm_setzero_pd(), cover));
+	*acc  = _mm_add_pd(_mm_unpackhi_pd(excl, excl), _mm_unpackhi_pd(cover, cover));
+	value = _mm_andnot_pd(sign, _mm_add_pd(excl, area));
+	value = _mm_min_pd(value, one);
+	value = _mm_add_pd(_mm_mul_pd(value, _mm_set1_pd(255.0)), _mm_set1_pd(0.5));
+	return _mm_cvttpd_epi32(value);
+}
+
+static unsigned int
+post_process_sse2(const Cell *cells, uint8_t *image, unsigned int num, Real *accum)
+{
+	__m128d acc = _mm_set1_pd(*accum);
+	__m128i lo, hi, q;
+	unsigned int i;
+	int packed;
+	for (i = 0; i + 4 <= num; i += 4) {
+		lo = quantize_sse2(cells + i, &acc);
+		hi = quantize_sse2(cells + i + 2, &acc);
+		q  = _mm_unpacklo_epi64(lo, hi);
+		q  = _mm_packs_epi32(q, q);
+		packed = _mm_cvtsi128_si32(_mm_packus_epi16(q, q));
+		memcpy(image + i, &packed, 4);
+	}
+	*accum = _mm_cvtsd_f64(acc);
+	return i;
+}
+#endif
+
+#if SCHRIFT_SSE2 && defined(SCHRIFT_FLOAT)
+/* Four cells per vector, log-step prefix sum of the covers within the vector. */
+static inline __m128i
+quantize_sse2(const Cell *cells, __m128 *acc)
+{
+	__m128 x0, x1, area, cover, excl, value;
+	x0    = _mm_loadu_ps(&cells[0].area);
+	x1    = _mm_loadu_ps(&cells[2].area);
+	area  = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0));
+	cover = _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1));
+	/* (0, c0, c1, c2) -> (0, c0, c0 + c1, c0 + c1 + c2) */
+	excl  = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(cover), 4));
+	excl  = _mm_add_ps(excl, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(excl), 4)));
+	excl  = _mm_add_ps(excl, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(excl), 8)));
+	excl  = _mm_add_ps(*acc, excl);
+	value = _mm_add_ps(excl, cover);
+	*acc  = _mm_shuffle_ps(value, value, _MM_SHUFFLE(3, 3, 3, 3));
+	value = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_add_ps(excl, area));
+	value = _mm_min_ps(value, _mm_set1_ps(1.0f));
+	value = _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+	return _mm_cvttps_epi32(value);
+}
+
+static unsigned int
+post_process_sse2(const Cell *cells, uint8_t *image, unsigned int num, Real *accum)
+{
+	__m128 acc = _mm_set1_ps(*accum);
+	__m128i lo, hi, q;
+	unsigned int i;
+	for (i = 0; i + 8 <= num; i += 8) {
+		lo = quantize_sse2(cells + i, &acc);
+		hi = quantize_sse2(cells + i + 4, &acc);
+		q  = _mm_packs_epi32(lo, hi);
+		_mm_storel_epi64((__m128i *) (image + i), _mm_packus_epi16(q, q));
+	}
+	*accum = _mm_cvtss_f32(acc);
+	return i;
+}
+#endif
+
+#if SCHRIFT_AVX2
 static int
-render_outline(Outline *outl, double transform[6], SFT_Image image)
+has_avx2(void)
+{
+	static int cached = -1;
+	if (cached < 0) {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		cached = 0;
+		if (info[0] >= 7) {
+			__cpuid(info, 1);
+			/* OSXSAVE and AVX, then the OS must save the ymm state */
+			if ((info[2] & 0x18000000) == 0x18000000 && (_xgetbv(0) & 6) == 6) {
+				__cpuidex(info, 7, 0);
+				cached = (info[1] & 0x20) != 0;
+			}
+		}
+#else
+		__builtin_cpu_init();
+		cached = __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+	return cached;
+}
+#endif
+
+#if SCHRIFT_AVX2 && !defined(SCHRIFT_FLOAT)
+/* Four cells per vector, the running sum within a vector is a log-step prefix sum,
+ * which rounds differently from the scalar loop by at most 1 LSB. */
+TARGET_AVX2 static inline __m128i
+quantize_avx2(const Cell *cells, __m256d *acc)
+{
+	const __m256d zero = _mm256_setzero_pd();
+	__m256d x0, x1, area, cover, excl, value;
+	x0    = _mm256_loadu_pd(&cells[0].area);
+	x1    = _mm256_loadu_pd(&cells[2].area);
+	area  = _mm256_permute4x64_pd(_mm256_unpacklo_pd(x0, x1), 0xD8);
+	cover = _mm256_permute4x64_pd(_mm256_unpackhi_pd(x0, x1), 0xD8);
+	/* (0, c0, c1, c2) -> (0, c0, c0 + c1, c0 + c1 + c2) */
+	excl  = _mm256_blend_pd(zero, _mm256_permute4x64_pd(cover, 0x90), 0xE);
+	excl  = _mm256_add_pd(excl, _mm256_blend_pd(zero, _mm256_permute4x64_pd(excl, 0x90), 0xE));
+	excl  = _mm256_add_pd(excl, _mm256_blend_pd(zero, _mm256_permute4x64_pd(excl, 0x40), 0xC));
+	excl  = _mm256_add_pd(*acc, excl);
+	*acc  = _mm256_permute4x64_pd(_mm256_add_pd(excl, cover), 0xFF);
+	value = _mm256_andnot_pd(_mm256_set1_pd(-0.0), _mm256_add_pd(excl, area));
+	value = _mm256_min_pd(value, _mm256_set1_pd(1.0));
+	value = _mm256_add_pd(_mm256_mul_pd(value, _mm256_set1_pd(255.0)), _mm256_set1_pd(0.5));
+	return _mm256_cvttpd_epi32(value);
+}
+
+TARGET_AVX2 static unsigned int
+post_process_avx2(const Cell *cells, uint8_t *image, unsigned int num, Real *accum)
+{
+	__m256d acc = _mm256_set1_pd(*accum);
+	__m128i lo, hi, q;
+	unsigned int i;
+	for (i = 0; i + 8 <= num; i += 8) {
+		lo = quantize_avx2(cells + i, &acc);
+		hi = quantize_avx2(cells + i + 4, &acc);
+		q  = _mm_packs_epi32(lo, hi);
+		_mm_storel_epi64((__m128i *) (image + i), _mm_packus_epi16(q, q));
+	}
+	*accum = _mm256_cvtsd_f64(acc);
+	return i;
+}
+#endif
+
+#if SCHRIFT_AVX2 && defined(SCHRIFT_FLOAT)
+/* Eight cells per vector, the prefix sum runs within each 128-bit lane first,
+ * then the low lane's total is carried into the high lane. */
+TARGET_AVX2 static inline __m256i
+quantize_avx2(const Cell *cells, __m256 *acc)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 x0, x1, area, cover, excl, carry, value;
+	x0    = _mm256_loadu_ps(&cells[0].area);
+	x1    = _mm256_loadu_ps(&cells[4].area);
+	area  = _mm256_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0));
+	cover = _mm256_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1));
+	area  = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(area), 0xD8));
+	cover = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(cover), 0xD8));
+	/* shift the covers up one element across the lanes, then prefix sum */
+	excl  = _mm256_permutevar8x32_ps(cover, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+	excl  = _mm256_blend_ps(excl, zero, 0x01);
+	excl  = _mm256_add_ps(excl, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(excl), 4)));
+	excl  = _mm256_add_ps(excl, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(excl), 8)));
+	carry = _mm256_permute2f128_ps(excl, excl, 0x08);
+	excl  = _mm256_add_ps(excl, _mm256_shuffle_ps(carry, carry, _MM_SHUFFLE(3, 3, 3, 3)));
+	excl  = _mm256_add_ps(*acc, excl);
+	value = _mm256_add_ps(excl, cover);
+	*acc  = _mm256_permutevar8x32_ps(value, _mm256_set1_epi32(7));
+	value = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_add_ps(excl, area));
+	value = _mm256_min_ps(value, _mm256_set1_ps(1.0f));
+	value = _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f));
+	return _mm256_cvttps_epi32(value);
+}
+
+TARGET_AVX2 static unsigned int
+post_process_avx2(const Cell *cells, uint8_t *image, unsigned int num, Real *accum)
+{
+	__m256 acc = _mm256_set1_ps(*accum);
+	__m256i lo, hi, q;
+	unsigned int i;
+	for (i = 0; i + 16 <= num; i += 16) {
+		lo = quantize_avx2(cells + i, &acc);
+		hi = quantize_avx2(cells + i + 8, &acc);
+		/* packs works per lane, the permute puts the words back in order */
+		q  = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+		_mm_storeu_si128((__m128i *) (image + i),
+			_mm_packus_epi16(_mm256_castsi256_si128(q), _mm256_extracti128_si256(q, 1)));
+	}
+	*accum = _mm256_cvtss_f32(acc);
+	return i;
+}
+#endif
+
+static void
+post_process(Raster buf, uint8_t *image)
+{
+	Real accum = 0;
+	unsigned int done = 0, num;
+	num = (unsigned int) buf.width * (unsigned int) buf.height;
+#if SCHRIFT_AVX2
+	if (has_avx2()) {
+		done = post_process_avx2(buf.cells, image, num, &accum);
+	} else
+#endif
+	{
+#if SCHRIFT_SSE2
+		done = post_process_sse2(buf.cells, image, num, &accum);
+#endif
+	}
+	post_process_scalar(buf.cells + done, image + done, num - done, accum);
+}
+
+/* Rasterizes a transformed and clipped outline into a caller provided cell buffer
+ * of image.width * image.height cells. */
+static void
+raster_outline(Outline *outl, SFT_Image image, Cell *cells)
 {
-	Cell *cells = NULL;
 	Raster buf;
 	unsigned int numPixels;
-	
-	numPixels = (unsigned int) image.width * (unsigned int) image.height;
 
-	STACK_ALLOC(cells, Cell, 128 * 128, numPixels);
-	if (!cells) {
-		return -1;
-	}
+	numPixels = (unsigned int) image.width * (unsigned int) image.height;
 	memset(cells, 0, numPixels * sizeof *cells);
 	buf.cells  = cells;
 	buf.width  = image.width;
 	buf.height = image.height;
 
-	transform_points(outl->numPoints, outl->points, transform);
+	draw_lines(outl, buf);
+	draw_curves(outl, buf);
+
+	post_process(buf, image.pixels);
+}
+
+static int
+render_outline(Outline *outl, double transform[6], SFT_Image image)
+{
+	Cell *cells = NULL;
+	void *scratch;
+	unsigned int numPixels, maxEdges;
 
-	clip_points(outl->numPoints, outl->points, image.width, image.height);
+	transform_points(outl->numPoints, outl->xs, outl->ys, transform);
+	clip_points(outl->numPoints, outl->xs, outl->ys, image.width, image.height);
 
-	if (tesselate_curves(outl) < 0) {
-		STACK_FREE(cells);
+	numPixels = (unsigned int) image.width * (unsigned int) image.height;
+	if (numPixels > SCANLINE_THRESHOLD) {
+		maxEdges = count_edges(outl);
+		if (!(scratch = malloc(scanline_scratch(maxEdges, image.width))))
+			return -1;
+		raster_scanlines(outl, image, scratch, maxEdges);
+		free(scratch);
+		return 0;
+	}
+
+	STACK_ALLOC(cells, Cell, SCANLINE_THRESHOLD, numPixels);
+	if (!cells) {
 		return -1;
 	}
+	raster_outline(outl, image, cells);
+	STACK_FREE(cells);
+	return 0;
+}
 
-	draw_lines(outl, buf);
+/* Same as render_outline, but with the arena's buffers, which only ever grow. */
+static int
+render_outline_arena(Outline *outl, double transform[6], SFT_Image image, SFT_Arena *arena)
+{
+	size_t numPixels, size;
+	unsigned int maxEdges;
+	void *mem;
 
-	post_process(buf, image.pixels);
+	transform_points(outl->numPoints, outl->xs, outl->ys, transform);
+	clip_points(outl->numPoints, outl->xs, outl->ys, image.width, image.height);
 
-	STACK_FREE(cells);
+	numPixels = (size_t) image.width * (size_t) image.height;
+	if (numPixels > SCANLINE_THRESHOLD) {
+		maxEdges = count_edges(outl);
+		size = scanline_scratch(maxEdges, image.width);
+		if (size > arena->capScan) {
+			if (!(mem = realloc(arena->scan, size)))
+				return -1;
+			arena->scan    = mem;
+			arena->capScan = size;
+		}
+		raster_scanlines(outl, image, arena->scan, maxEdges);
+		return 0;
+	}
+
+	if (numPixels > arena->capCells) {
+		if (!(mem = reallocarray(arena->cells, numPixels, sizeof *arena->cells)))
+			return -1;
+		arena->cells    = mem;
+		arena->capCells = numPixels;
+	}
+	raster_outline(outl, image, arena->cells);
 	return 0;
 }
 
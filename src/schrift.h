@@ -32,8 +32,10 @@ typedef uint_least32_t      SFT_UChar; /* Guaranteed to be compatible with char3
 typedef uint_fast32_t       SFT_Glyph;
 typedef struct SFT_LMetrics SFT_LMetrics;
 typedef struct SFT_GMetrics SFT_GMetrics;
+typedef struct SFT_CMetrics SFT_CMetrics;
 typedef struct SFT_Kerning  SFT_Kerning;
 typedef struct SFT_Image    SFT_Image;
+typedef struct SFT_Arena    SFT_Arena;
 
 struct SFT
 {
@@ -61,6 +63,15 @@ struct SFT_GMetrics
 	int    minHeight;
 };
 
+/* Terminal cell of a monospace face in whole pixels,
+ * baseline is measured down from the top of the cell. */
+struct SFT_CMetrics
+{
+	int width;
+	int height;
+	int baseline;
+};
+
 struct SFT_Kerning
 {
 	double xShift;
@@ -79,14 +90,35 @@ const char *sft_version(void);
 SFT_Font *sft_loadmem (const void *mem, size_t size);
 SFT_Font *sft_loadfile(const char *filename);
 void      sft_freefont(SFT_Font *font);
+/* Keeps every glyph's decoded outline after its first render, so rendering it again
+ * (e.g. at another size) skips decoding. Costs memory per rendered glyph until
+ * sft_freefont(). A font with the cache enabled must not be rendered from several
+ * threads at once. */
+int       sft_cacheoutlines(SFT_Font *font);
+/* Decodes advance, left side bearing and bounding box of every glyph into a table,
+ * so sft_gmetrics() and sft_cmetrics() no longer read hmtx, loca or glyf. */
+int       sft_cachemetrics(SFT_Font *font);
 
 int sft_lmetrics(const SFT *sft, SFT_LMetrics *metrics);
 int sft_lookup  (const SFT *sft, SFT_UChar codepoint, SFT_Glyph *glyph);
 int sft_gmetrics(const SFT *sft, SFT_Glyph glyph, SFT_GMetrics *metrics);
+/* Needs sft_cachemetrics(), fails for proportional faces. The cell is as wide as the
+ * advance (nearly) every glyph shares and as high as the hhea line spacing. */
+int sft_cmetrics(const SFT *sft, SFT_CMetrics *metrics);
 int sft_kerning (const SFT *sft, SFT_Glyph leftGlyph, SFT_Glyph rightGlyph,
                  SFT_Kerning *kerning);
+/* Kerning of every adjacent pair of a run, kernings[i] is between glyphs[i] and glyphs[i + 1],
+ * so it needs room for count - 1 entries. */
+int sft_kerning_run(const SFT *sft, const SFT_Glyph *glyphs, int count, SFT_Kerning *kernings);
 int sft_render  (const SFT *sft, SFT_Glyph glyph, SFT_Image image);
 
+/* A render arena keeps the outline and raster buffers alive between renders,
+ * so rendering many glyphs does not allocate once the buffers have grown.
+ * An arena must only be used by one thread at a time. */
+SFT_Arena *sft_arena_new   (void);
+void       sft_arena_free  (SFT_Arena *arena);
+int        sft_render_arena(const SFT *sft, SFT_Glyph glyph, SFT_Image image, SFT_Arena *arena);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,753 @@
+#include <stdlib.h>
+#include <string.h>
+#include "vt2000.h"
+#include "screen.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// damage spans are kept in 16 bits
+#define SCREEN_MAX_EDGE 0xFFFF
+
+struct VTScreen {
+    int cols;
+    int rows;
+    // rows * cols, row_map[row] is the slot of a screen row
+    VTCell *cells;
+    uint16_t *row_map;
+    // scroll scratch, rows entries
+    uint16_t *row_tmp;
+    // a bit per row, and the damaged columns [begin, end) of the dirty ones
+    uint64_t *dirty;
+    uint16_t *damage_begin;
+    uint16_t *damage_end;
+    uint8_t *tabs;
+    VTCell pen;
+    int col;
+    int row;
+    // the last column was written with autowrap on, the next character goes to the next row
+    int wrap_pending;
+    int top;
+    int bottom;
+    int modes;
+    int saved_col;
+    int saved_row;
+    int saved_wrap_pending;
+    int saved_modes;
+    VTCell saved_pen;
+};
+
+// a code point range of the same cell width
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} ScreenWidthRange;
+
+// combining marks and format characters, drawn by nothing
+static const ScreenWidthRange zero_width[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x0610, 0x061A}, {0x064B, 0x065F},
+    {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+    {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0x302A, 0x302D},
+    {0x3099, 0x309A}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0xE0100, 0xE01EF},
+};
+
+// East Asian wide and fullwidth characters, emoji presentation blocks
+static const ScreenWidthRange double_width[] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x2614, 0x2615},
+    {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+    {0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x1F300, 0x1F64F}, {0x1F900, 0x1F9FF}, {0x20000, 0x2FFFD},
+    {0x30000, 0x3FFFD},
+};
+
+static int in_ranges(const ScreenWidthRange *ranges, int count, uint32_t cp)
+{
+    int lo = 0, hi = count - 1;
+    if (cp < ranges[0].first || cp > ranges[hi].last) {
+        return 0;
+    }
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        if (cp < ranges[mid].first) {
+            hi = mid - 1;
+        } else if (cp > ranges[mid].last) {
+            lo = mid + 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline int char_width(uint32_t cp)
+{
+    if (cp < 0x300) {
+        // C1 controls that arrived as UTF-8
+        return cp >= 0x7F && cp < 0xA0 ? 0 : 1;
+    }
+    if (in_ranges(zero_width, (int) (sizeof(zero_width) / sizeof(zero_width[0])), cp)) {
+        return 0;
+    }
+    if (in_ranges(double_width, (int) (sizeof(double_width) / sizeof(double_width[0])), cp)) {
+        return 2;
+    }
+    return 1;
+}
+
+static inline VTCell *row_cells(const VTScreen *screen, int row)
+{
+    return screen->cells + (size_t) screen->row_map[row] * screen->cols;
+}
+
+static void damage(VTScreen *screen, int row, int begin, int end)
+{
+    uint64_t bit = (uint64_t) 1 << (row & 63);
+    uint64_t *word = &screen->dirty[row >> 6];
+    if (begin >= end) {
+        return;
+    }
+    if (!(*word & bit)) {
+        *word |= bit;
+        screen->damage_begin[row] = (uint16_t) begin;
+        screen->damage_end[row] = (uint16_t) end;
+    } else {
+        if (begin < screen->damage_begin[row]) {
+            screen->damage_begin[row] = (uint16_t) begin;
+        }
+        if (end > screen->damage_end[row]) {
+            screen->damage_end[row] = (uint16_t) end;
+        }
+    }
+}
+
+// whole rows, a full span replaces whatever was recorded
+static void damage_rows(VTScreen *screen, int first, int last)
+{
+    int row;
+    for (row = first; row <= last; ++row) {
+        screen->dirty[row >> 6] |= (uint64_t) 1 << (row & 63);
+        screen->damage_begin[row] = 0;
+        screen->damage_end[row] = (uint16_t) screen->cols;
+    }
+}
+
+// an erased cell: a space in the pen's colors, no attributes
+static inline VTCell blank_cell(const VTScreen *screen)
+{
+    VTCell cell = screen->pen;
+    cell.codepoint = ' ';
+    cell.attrs &= VT_ATTR_DEFAULT_FG | VT_ATTR_DEFAULT_BG;
+    return cell;
+}
+
+static inline void fill_cells(VTCell *dst, VTCell cell, int count)
+{
+    int i;
+    for (i = 0; i < count; ++i) {
+        dst[i] = cell;
+    }
+}
+
+// make sure no double width character straddles the edge left of col, blanking both halves if one does
+static void split_wide(VTScreen *screen, int row, int col)
+{
+    VTCell *cells;
+    if (col <= 0 || col >= screen->cols) {
+        return;
+    }
+    cells = row_cells(screen, row);
+    if (cells[col].attrs & VT_ATTR_WIDE_SPACER) {
+        VTCell blank = blank_cell(screen);
+        cells[col - 1] = blank;
+        cells[col] = blank;
+        damage(screen, row, col - 1, col + 1);
+    }
+}
+
+// blank [begin, end) of a row
+static void erase_cells(VTScreen *screen, int row, int begin, int end)
+{
+    if (begin >= end) {
+        return;
+    }
+    split_wide(screen, row, begin);
+    split_wide(screen, row, end);
+    fill_cells(row_cells(screen, row) + begin, blank_cell(screen), end - begin);
+    damage(screen, row, begin, end);
+}
+
+// rotate the rows [top, bottom] up by count, blank rows enter at the bottom
+static void rows_up(VTScreen *screen, int top, int bottom, int count)
+{
+    int height = bottom - top + 1;
+    int row;
+    if (count > height) {
+        count = height;
+    }
+    if (count <= 0) {
+        return;
+    }
+    memcpy(screen->row_tmp, screen->row_map + top, count * sizeof(uint16_t));
+    memmove(screen->row_map + top, screen->row_map + top + count, (height - count) * sizeof(uint16_t));
+    memcpy(screen->row_map + bottom - count + 1, screen->row_tmp, count * sizeof(uint16_t));
+    for (row = bottom - count + 1; row <= bottom; ++row) {
+        fill_cells(row_cells(screen, row), blank_cell(screen), screen->cols);
+    }
+    damage_rows(screen, top, bottom);
+}
+
+// rotate the rows [top, bottom] down by count, blank rows enter at the top
+static void rows_down(VTScreen *screen, int top, int bottom, int count)
+{
+    int height = bottom - top + 1;
+    int row;
+    if (count > height) {
+        count = height;
+    }
+    if (count <= 0) {
+        return;
+    }
+    memcpy(screen->row_tmp, screen->row_map + bottom - count + 1, count * sizeof(uint16_t));
+    memmove(screen->row_map + top + count, screen->row_map + top, (height - count) * sizeof(uint16_t));
+    memcpy(screen->row_map + top, screen->row_tmp, count * sizeof(uint16_t));
+    for (row = top; row < top + count; ++row) {
+        fill_cells(row_cells(screen, row), blank_cell(screen), screen->cols);
+    }
+    damage_rows(screen, top, bottom);
+}
+
+VTScreen *screen_new(int cols, int rows)
+{
+    VTScreen *screen;
+    int words;
+
+    if (cols <= 0 || rows <= 0 || cols > SCREEN_MAX_EDGE || rows > SCREEN_MAX_EDGE) {
+        return NULL;
+    }
+    screen = (VTScreen *) VT_malloc(sizeof(VTScreen));
+    if (!screen) {
+        return NULL;
+    }
+    memset(screen, 0, sizeof(VTScreen));
+    screen->cols = cols;
+    screen->rows = rows;
+    words = (rows + 63) / 64;
+    screen->cells = (VTCell *) VT_malloc((size_t) cols * rows * sizeof(VTCell));
+    screen->row_map = (uint16_t *) VT_malloc(rows * sizeof(uint16_t));
+    screen->row_tmp = (uint16_t *) VT_malloc(rows * sizeof(uint16_t));
+    screen->dirty = (uint64_t *) VT_malloc(words * sizeof(uint64_t));
+    screen->damage_begin = (uint16_t *) VT_malloc(rows * sizeof(uint16_t));
+    screen->damage_end = (uint16_t *) VT_malloc(rows * sizeof(uint16_t));
+    screen->tabs = (uint8_t *) VT_malloc(cols);
+    if (!screen->cells || !screen->row_map || !screen->row_tmp || !screen->dirty
+        || !screen->damage_begin || !screen->damage_end || !screen->tabs) {
+        screen_free(screen);
+        return NULL;
+    }
+    screen_reset(screen);
+    return screen;
+}
+
+void screen_free(VTScreen *screen)
+{
+    if (!screen) {
+        return;
+    }
+    VT_free(screen->cells);
+    VT_free(screen->row_map);
+    VT_free(screen->row_tmp);
+    VT_free(screen->dirty);
+    VT_free(screen->damage_begin);
+    VT_free(screen->damage_end);
+    VT_free(screen->tabs);
+    VT_free(screen);
+}
+
+void screen_reset(VTScreen *screen)
+{
+    int row, col;
+
+    screen->pen.codepoint = ' ';
+    screen->pen.fg = 7;
+    screen->pen.bg = 0;
+    screen->pen.attrs = VT_ATTR_DEFAULT_FG | VT_ATTR_DEFAULT_BG;
+    for (row = 0; row < screen->rows; ++row) {
+        screen->row_map[row] = (uint16_t) row;
+    }
+    for (row = 0; row < screen->rows; ++row) {
+        fill_cells(row_cells(screen, row), screen->pen, screen->cols);
+    }
+    for (col = 0; col < screen->cols; ++col) {
+        screen->tabs[col] = (uint8_t) (col % 8 == 0);
+    }
+    screen->col = 0;
+    screen->row = 0;
+    screen->wrap_pending = 0;
+    screen->top = 0;
+    screen->bottom = screen->rows - 1;
+    screen->modes = VT_MODE_AUTOWRAP | VT_MODE_CURSOR_VISIBLE;
+    screen->saved_col = 0;
+    screen->saved_row = 0;
+    screen->saved_wrap_pending = 0;
+    screen->saved_modes = screen->modes;
+    screen->saved_pen = screen->pen;
+    screen_damage_all(screen);
+}
+
+int screen_cols(const VTScreen *screen)
+{
+    return screen->cols;
+}
+
+int screen_rows(const VTScreen *screen)
+{
+    return screen->rows;
+}
+
+const VTCell *screen_row(const VTScreen *screen, int row)
+{
+    return row_cells(screen, row);
+}
+
+int screen_next_dirty(const VTScreen *screen, int row)
+{
+    int word;
+    uint64_t bits;
+
+    if (row < 0) {
+        row = 0;
+    }
+    if (row >= screen->rows) {
+        return -1;
+    }
+    word = row >> 6;
+    bits = screen->dirty[word] & (~(uint64_t) 0 << (row & 63));
+    for (;;) {
+        if (bits) {
+            int next = word * 64;
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward64(&index, bits);
+            next += (int) index;
+#else
+            next += __builtin_ctzll(bits);
+#endif
+            return next < screen->rows ? next : -1;
+        }
+        if (++word >= (screen->rows + 63) / 64) {
+            return -1;
+        }
+        bits = screen->dirty[word];
+    }
+}
+
+int screen_row_damage(const VTScreen *screen, int row, int *begin, int *end)
+{
+    if (!(screen->dirty[row >> 6] >> (row & 63) & 1)) {
+        return 0;
+    }
+    *begin = screen->damage_begin[row];
+    *end = screen->damage_end[row];
+    return 1;
+}
+
+void screen_damage(VTScreen *screen, int row, int begin, int end)
+{
+    if (row < 0 || row >= screen->rows) {
+        return;
+    }
+    damage(screen, row, begin < 0 ? 0 : begin, end > screen->cols ? screen->cols : end);
+}
+
+void screen_damage_all(VTScreen *screen)
+{
+    damage_rows(screen, 0, screen->rows - 1);
+}
+
+void screen_clear_damage(VTScreen *screen)
+{
+    memset(screen->dirty, 0, ((screen->rows + 63) / 64) * sizeof(uint64_t));
+}
+
+void screen_cursor(const VTScreen *screen, int *col, int *row)
+{
+    *col = screen->col;
+    *row = screen->row;
+}
+
+int screen_modes(const VTScreen *screen)
+{
+    return screen->modes;
+}
+
+void screen_set_mode(VTScreen *screen, int mode, int enable)
+{
+    if (enable) {
+        screen->modes |= mode;
+    } else {
+        screen->modes &= ~mode;
+    }
+    if (mode & VT_MODE_AUTOWRAP) {
+        screen->wrap_pending = 0;
+    }
+    if (mode & VT_MODE_ORIGIN) {
+        screen_move_to(screen, 0, 0);
+    }
+}
+
+VTCell *screen_pen(VTScreen *screen)
+{
+    return &screen->pen;
+}
+
+// move right after writing count cells, at the last column the cursor stays and a wrap is pending
+static inline void advance(VTScreen *screen, int count)
+{
+    screen->col += count;
+    if (screen->col >= screen->cols) {
+        screen->col = screen->cols - 1;
+        screen->wrap_pending = (screen->modes & VT_MODE_AUTOWRAP) != 0;
+    }
+}
+
+void screen_write(VTScreen *screen, const uint32_t *codepoints, int count)
+{
+    int i = 0;
+
+    while (i < count) {
+        int width = char_width(codepoints[i]);
+        VTCell *cells;
+        VTCell cell;
+        int col;
+
+        if (width == 0) {
+            ++i;
+            continue;
+        }
+        if (screen->wrap_pending) {
+            screen->wrap_pending = 0;
+            screen->col = 0;
+            screen_index(screen);
+        }
+        cell = screen->pen;
+        cell.attrs &= ~(VT_ATTR_WIDE | VT_ATTR_WIDE_SPACER);
+
+        if (width == 1) {
+            int room = screen->cols - screen->col;
+            int n = 1, end;
+            if (screen->modes & VT_MODE_INSERT) {
+                // make room for the narrow characters that fit
+                int fit = 1;
+                while (fit < room && i + fit < count && char_width(codepoints[i + fit]) == 1) {
+                    ++fit;
+                }
+                screen_insert_chars(screen, fit);
+                room = fit;
+            }
+            col = screen->col;
+            split_wide(screen, screen->row, col);
+            cells = row_cells(screen, screen->row) + col;
+            cell.codepoint = codepoints[i];
+            cells[0] = cell;
+            // take narrow characters as long as they fit, checking and storing in one pass
+            while (n < room && i + n < count) {
+                uint32_t cp = codepoints[i + n];
+                if ((cp < 0x20 || cp >= 0x7F) && char_width(cp) != 1) {
+                    break;
+                }
+                cell.codepoint = cp;
+                cells[n++] = cell;
+            }
+            end = col + n;
+            // the right half of a double width character that was overwritten
+            if (end < screen->cols && (cells[n].attrs & VT_ATTR_WIDE_SPACER)) {
+                cells[n] = blank_cell(screen);
+                ++end;
+            }
+            damage(screen, screen->row, col, end);
+            advance(screen, n);
+            i += n;
+            continue;
+        }
+
+        if (screen->cols < 2) {
+            ++i;
+            continue;
+        }
+        if (screen->col == screen->cols - 1) {
+            if (screen->modes & VT_MODE_AUTOWRAP) {
+                screen->col = 0;
+                screen_index(screen);
+            } else {
+                screen->col = screen->cols - 2;
+            }
+        }
+        if (screen->modes & VT_MODE_INSERT) {
+            screen_insert_chars(screen, 2);
+        }
+        col = screen->col;
+        split_wide(screen, screen->row, col);
+        split_wide(screen, screen->row, col + 2);
+        cells = row_cells(screen, screen->row) + col;
+        cell.codepoint = codepoints[i];
+        cells[0] = cell;
+        cells[0].attrs |= VT_ATTR_WIDE;
+        cell.codepoint = 0;
+        cells[1] = cell;
+        cells[1].attrs |= VT_ATTR_WIDE_SPACER;
+        damage(screen, screen->row, col, col + 2);
+        advance(screen, 2);
+        ++i;
+    }
+}
+
+void screen_move_to(VTScreen *screen, int col, int row)
+{
+    int top = 0, bottom = screen->rows - 1;
+    if (screen->modes & VT_MODE_ORIGIN) {
+        top = screen->top;
+        bottom = screen->bottom;
+        row += top;
+    }
+    screen->row = row < top ? top : row > bottom ? bottom : row;
+    screen->col = col < 0 ? 0 : col >= screen->cols ? screen->cols - 1 : col;
+    screen->wrap_pending = 0;
+}
+
+void screen_move_by(VTScreen *screen, int cols, int rows)
+{
+    int top = 0, bottom = screen->rows - 1;
+    int row = screen->row + rows;
+    int col = screen->col + cols;
+    if (screen->row >= screen->top && screen->row <= screen->bottom) {
+        top = screen->top;
+        bottom = screen->bottom;
+    }
+    screen->row = row < top ? top : row > bottom ? bottom : row;
+    screen->col = col < 0 ? 0 : col >= screen->cols ? screen->cols - 1 : col;
+    screen->wrap_pending = 0;
+}
+
+void screen_carriage_return(VTScreen *screen)
+{
+    screen->col = 0;
+    screen->wrap_pending = 0;
+}
+
+void screen_backspace(VTScreen *screen)
+{
+    if (screen->col > 0) {
+        screen->col--;
+    }
+    screen->wrap_pending = 0;
+}
+
+void screen_index(VTScreen *screen)
+{
+    screen->wrap_pending = 0;
+    if (screen->row == screen->bottom) {
+        rows_up(screen, screen->top, screen->bottom, 1);
+    } else if (screen->row < screen->rows - 1) {
+        screen->row++;
+    }
+}
+
+void screen_reverse_index(VTScreen *screen)
+{
+    screen->wrap_pending = 0;
+    if (screen->row == screen->top) {
+        rows_down(screen, screen->top, screen->bottom, 1);
+    } else if (screen->row > 0) {
+        screen->row--;
+    }
+}
+
+void screen_tab(VTScreen *screen, int count)
+{
+    int col = screen->col;
+    for (; count > 0; --count) {
+        while (col < screen->cols - 1 && !screen->tabs[++col]) {
+        }
+    }
+    for (; count < 0; ++count) {
+        while (col > 0 && !screen->tabs[--col]) {
+        }
+    }
+    screen->col = col;
+    screen->wrap_pending = 0;
+}
+
+void screen_set_tab(VTScreen *screen)
+{
+    screen->tabs[screen->col] = 1;
+}
+
+void screen_clear_tab(VTScreen *screen, int all)
+{
+    if (all) {
+        memset(screen->tabs, 0, screen->cols);
+    } else {
+        screen->tabs[screen->col] = 0;
+    }
+}
+
+void screen_save_cursor(VTScreen *screen)
+{
+    screen->saved_col = screen->col;
+    screen->saved_row = screen->row;
+    screen->saved_wrap_pending = screen->wrap_pending;
+    screen->saved_modes = screen->modes;
+    screen->saved_pen = screen->pen;
+}
+
+void screen_restore_cursor(VTScreen *screen)
+{
+    int keep = VT_MODE_AUTOWRAP | VT_MODE_ORIGIN;
+    screen->col = screen->saved_col < screen->cols ? screen->saved_col : screen->cols - 1;
+    screen->row = screen->saved_row < screen->rows ? screen->saved_row : screen->rows - 1;
+    screen->wrap_pending = screen->saved_wrap_pending;
+    screen->modes = (screen->modes & ~keep) | (screen->saved_modes & keep);
+    screen->pen = screen->saved_pen;
+}
+
+void screen_set_region(VTScreen *screen, int top, int bottom)
+{
+    if (top < 0) {
+        top = 0;
+    }
+    if (bottom >= screen->rows) {
+        bottom = screen->rows - 1;
+    }
+    if (top >= bottom) {
+        return;
+    }
+    screen->top = top;
+    screen->bottom = bottom;
+    screen_move_to(screen, 0, 0);
+}
+
+void screen_erase_line(VTScreen *screen, int mode)
+{
+    int row = screen->row;
+    switch (mode) {
+        case 0:
+            erase_cells(screen, row, screen->col, screen->cols);
+            break;
+        case 1:
+            erase_cells(screen, row, 0, screen->col + 1);
+            break;
+        case 2:
+            erase_cells(screen, row, 0, screen->cols);
+            break;
+        default:
+            break;
+    }
+}
+
+void screen_erase_display(VTScreen *screen, int mode)
+{
+    int row;
+    switch (mode) {
+        case 0:
+            erase_cells(screen, screen->row, screen->col, screen->cols);
+            for (row = screen->row + 1; row < screen->rows; ++row) {
+                erase_cells(screen, row, 0, screen->cols);
+            }
+            break;
+        case 1:
+            for (row = 0; row < screen->row; ++row) {
+                erase_cells(screen, row, 0, screen->cols);
+            }
+            erase_cells(screen, screen->row, 0, screen->col + 1);
+            break;
+        case 2:
+            for (row = 0; row < screen->rows; ++row) {
+                erase_cells(screen, row, 0, screen->cols);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void screen_erase_chars(VTScreen *screen, int count)
+{
+    int end = count > screen->cols - screen->col ? screen->cols : screen->col + count;
+    erase_cells(screen, screen->row, screen->col, end);
+}
+
+void screen_insert_chars(VTScreen *screen, int count)
+{
+    int row = screen->row, col = screen->col;
+    int cols = screen->cols;
+    VTCell *cells;
+
+    if (count > cols - col) {
+        count = cols - col;
+    }
+    if (count <= 0) {
+        return;
+    }
+    split_wide(screen, row, col);
+    cells = row_cells(screen, row);
+    memmove(cells + col + count, cells + col, (size_t) (cols - col - count) * sizeof(VTCell));
+    fill_cells(cells + col, blank_cell(screen), count);
+    // a double width character pushed half off the row
+    if (cells[cols - 1].attrs & VT_ATTR_WIDE) {
+        cells[cols - 1] = blank_cell(screen);
+    }
+    damage(screen, row, col, cols);
+    screen->wrap_pending = 0;
+}
+
+void screen_delete_chars(VTScreen *screen, int count)
+{
+    int row = screen->row, col = screen->col;
+    int cols = screen->cols;
+    VTCell *cells;
+
+    if (count > cols - col) {
+        count = cols - col;
+    }
+    if (count <= 0) {
+        return;
+    }
+    split_wide(screen, row, col);
+    split_wide(screen, row, col + count);
+    cells = row_cells(screen, row);
+    memmove(cells + col, cells + col + count, (size_t) (cols - col - count) * sizeof(VTCell));
+    fill_cells(cells + cols - count, blank_cell(screen), count);
+    damage(screen, row, col, cols);
+    screen->wrap_pending = 0;
+}
+
+void screen_insert_lines(VTScreen *screen, int count)
+{
+    if (screen->row < screen->top || screen->row > screen->bottom) {
+        return;
+    }
+    rows_down(screen, screen->row, screen->bottom, count);
+    screen->col = 0;
+    screen->wrap_pending = 0;
+}
+
+void screen_delete_lines(VTScreen *screen, int count)
+{
+    if (screen->row < screen->top || screen->row > screen->bottom) {
+        return;
+    }
+    rows_up(screen, screen->row, screen->bottom, count);
+    screen->col = 0;
+    screen->wrap_pending = 0;
+}
+
+void screen_scroll_up(VTScreen *screen, int count)
+{
+    rows_up(screen, screen->top, screen->bottom, count);
+}
+
+void screen_scroll_down(VTScreen *screen, int count)
+{
+    rows_down(screen, screen->top, screen->bottom, count);
+}
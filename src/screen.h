@@ -0,0 +1,131 @@
+/**
+ * terminal screen model
+ * a grid of 8-byte cells, each row contiguous, rows reached through a row map so scrolling moves
+ * row indexes instead of cells, every row carries a dirty bit and the column span changed since
+ * the damage was last cleared
+ * cursor, pen, margins, tab stops and the modes that change how text lands on the grid live here,
+ * escape sequence semantics stay with the caller
+ */
+
+#ifndef VT2000_SCREEN_H
+#define VT2000_SCREEN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// cell attributes
+#define VT_ATTR_BOLD       0x0001
+#define VT_ATTR_DIM        0x0002
+#define VT_ATTR_ITALIC     0x0004
+#define VT_ATTR_UNDERLINE  0x0008
+#define VT_ATTR_BLINK      0x0010
+#define VT_ATTR_REVERSE    0x0020
+#define VT_ATTR_INVISIBLE  0x0040
+#define VT_ATTR_STRIKE     0x0080
+// fg / bg is the default color, not a palette index
+#define VT_ATTR_DEFAULT_FG 0x0100
+#define VT_ATTR_DEFAULT_BG 0x0200
+// first column of a double width character, the next cell is its VT_ATTR_WIDE_SPACER
+#define VT_ATTR_WIDE       0x0400
+#define VT_ATTR_WIDE_SPACER 0x0800
+
+// screen modes
+#define VT_MODE_AUTOWRAP       0x01
+#define VT_MODE_ORIGIN         0x02
+#define VT_MODE_INSERT         0x04
+#define VT_MODE_CURSOR_VISIBLE 0x08
+
+    typedef struct VTScreen VTScreen;
+    typedef struct VTCell VTCell;
+
+    /**
+     * a character cell, fg and bg index the 256 color palette unless the default flags are set
+     * codepoint 0 is the spacer right of a wide character
+     */
+    struct VTCell {
+        uint32_t codepoint;
+        uint8_t fg;
+        uint8_t bg;
+        uint16_t attrs;
+    };
+
+    VTScreen *screen_new(int cols, int rows);
+    void screen_free(VTScreen *screen);
+    // blank screen, default pen and modes, full margins, cursor home, everything damaged
+    void screen_reset(VTScreen *screen);
+    int screen_cols(const VTScreen *screen);
+    int screen_rows(const VTScreen *screen);
+    // cells of a row, valid until the next call that scrolls
+    const VTCell *screen_row(const VTScreen *screen, int row);
+
+    /**
+     * damage since the last screen_clear_damage
+     * screen_next_dirty returns the first dirty row >= row or -1,
+     * screen_row_damage the changed columns [begin, end) of a row, 0 if it is clean
+     */
+    int screen_next_dirty(const VTScreen *screen, int row);
+    int screen_row_damage(const VTScreen *screen, int row, int *begin, int *end);
+    // mark columns [begin, end) of a row changed, e.g. under a cursor drawn on top of the grid
+    void screen_damage(VTScreen *screen, int row, int begin, int end);
+    void screen_damage_all(VTScreen *screen);
+    void screen_clear_damage(VTScreen *screen);
+
+    void screen_cursor(const VTScreen *screen, int *col, int *row);
+    int screen_modes(const VTScreen *screen);
+    void screen_set_mode(VTScreen *screen, int mode, int enable);
+    /**
+     * the template new and erased cells take their colors and attributes from,
+     * codepoint is ignored, change it in place
+     */
+    VTCell *screen_pen(VTScreen *screen);
+
+    /**
+     * write a printable run at the cursor with the pen, wrapping and scrolling as needed
+     * double width characters take two cells, zero width ones are dropped
+     */
+    void screen_write(VTScreen *screen, const uint32_t *codepoints, int count);
+
+    // absolute position, relative to the scroll region in origin mode, clamped
+    void screen_move_to(VTScreen *screen, int col, int row);
+    // relative moves stop at the margins when the cursor is inside the scroll region
+    void screen_move_by(VTScreen *screen, int cols, int rows);
+    void screen_carriage_return(VTScreen *screen);
+    void screen_backspace(VTScreen *screen);
+    // down one row, scrolls the region up at its bottom margin
+    void screen_index(VTScreen *screen);
+    // up one row, scrolls the region down at its top margin
+    void screen_reverse_index(VTScreen *screen);
+    // to the count-th next (count < 0: previous) tab stop
+    void screen_tab(VTScreen *screen, int count);
+    void screen_set_tab(VTScreen *screen);
+    // the stop at the cursor, or all of them
+    void screen_clear_tab(VTScreen *screen, int all);
+    void screen_save_cursor(VTScreen *screen);
+    void screen_restore_cursor(VTScreen *screen);
+    // top and bottom margins, inclusive, homes the cursor. ignored unless top < bottom
+    void screen_set_region(VTScreen *screen, int top, int bottom);
+
+    /**
+     * erase with the pen's background
+     * mode 0 from the cursor to the end, 1 from the start to the cursor, 2 all
+     */
+    void screen_erase_line(VTScreen *screen, int mode);
+    void screen_erase_display(VTScreen *screen, int mode);
+    void screen_erase_chars(VTScreen *screen, int count);
+    // shift the rest of the cursor row right / left, the cursor does not move
+    void screen_insert_chars(VTScreen *screen, int count);
+    void screen_delete_chars(VTScreen *screen, int count);
+    // only inside the scroll region, the rows below the cursor shift down / up
+    void screen_insert_lines(VTScreen *screen, int count);
+    void screen_delete_lines(VTScreen *screen, int count);
+    // scroll the region contents up / down, blank rows come in
+    void screen_scroll_up(VTScreen *screen, int count);
+    void screen_scroll_down(VTScreen *screen, int count);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //VT2000_SCREEN_H
@@ -1,10 +1,574 @@
+#include <stdlib.h>
+#include <string.h>
 #include "vt2000.h"
+#include "vtparse.h"
+#include "screen.h"
+#include "font.h"
+#include "glyphcache.h"
+#include "prewarm.h"
 
+// em size of the font in pixels, and where the baseline sits in a cell
+#define VT_FONT_SIZE (VT_CELL_HEIGHT * 4 / 5)
+#define VT_BASELINE ((VT_CELL_HEIGHT - VT_FONT_SIZE) / 2 + VT_FONT_SIZE * 4 / 5)
+#define VT_GLYPH_CACHE_PAGES 4
+// pre-warmed glyphs moved into the cache per update, keeps a frame from stalling on them
+#define VT_PREWARM_DRAIN 32
+#define VT_DEFAULT_FG 0xffeeeeee
+#define VT_DEFAULT_BG 0xff111111
+
+static VTParser *vt_parser;
+static VTScreen *vt_screen;
+static TTFont *vt_font;
+static GlyphCache *vt_cache;
+static GlyphPrewarm *vt_prewarm;
+static uint32_t vt_palette[256];
+// where the cursor was drawn by the last update, col < 0 when it was not
+static int vt_cursor_col = -1;
+static int vt_cursor_row;
+
+// n-th parameter, def when it is omitted or 0
+static int param_or(const VTParams *params, int n, int def) {
+    if (n >= params->count || params->values[n] == 0) {
+        return def;
+    }
+    return params->values[n];
+}
+
+// nearest entry of the xterm 256 color palette: the 6x6x6 cube or the gray ramp
+static uint8_t palette_index(int r, int g, int b) {
+    static const int levels[6] = {0, 95, 135, 175, 215, 255};
+    int ri = r < 48 ? 0 : r < 115 ? 1 : (r - 35) / 40;
+    int gi = g < 48 ? 0 : g < 115 ? 1 : (g - 35) / 40;
+    int bi = b < 48 ? 0 : b < 115 ? 1 : (b - 35) / 40;
+    int gray = (r + g + b) / 3;
+    int gray_index = gray > 238 ? 23 : gray < 8 ? 0 : (gray - 3) / 10;
+    int gray_level = 8 + 10 * gray_index;
+    int dr = levels[ri] - r, dg = levels[gi] - g, db = levels[bi] - b;
+    int cube_error = dr * dr + dg * dg + db * db;
+    int gray_error = (gray_level - r) * (gray_level - r) + (gray_level - g) * (gray_level - g)
+                     + (gray_level - b) * (gray_level - b);
+    if (gray_error < cube_error) {
+        return (uint8_t) (232 + gray_index);
+    }
+    return (uint8_t) (16 + 36 * ri + 6 * gi + bi);
+}
+
+/**
+ * 38 / 48 extended color starting at parameter n, both the ; and the : forms
+ * returns the parameters consumed, color < 0 when it is malformed
+ */
+static int extended_color(const VTParams *params, int n, int *color) {
+    int colon = params->subparams >> (n + 1) & 1;
+    *color = -1;
+    if (n + 1 >= params->count) {
+        return params->count - n;
+    }
+    if (params->values[n + 1] == 5 && n + 2 < params->count) {
+        *color = params->values[n + 2] & 0xFF;
+        return 3;
+    }
+    if (params->values[n + 1] == 2) {
+        // 38:2:colorspace:r:g:b carries a color space id, 38;2;r;g;b does not
+        int first = n + 2;
+        if (colon && n + 5 < params->count && (params->subparams >> (n + 5) & 1)) {
+            first++;
+        }
+        if (first + 2 < params->count) {
+            *color = palette_index(params->values[first] & 0xFF, params->values[first + 1] & 0xFF,
+                                   params->values[first + 2] & 0xFF);
+            return first + 3 - n;
+        }
+        return params->count - n;
+    }
+    return 2;
+}
+
+static void select_graphic_rendition(VTScreen *screen, const VTParams *params) {
+    VTCell *pen = screen_pen(screen);
+    int n;
+
+    if (params->count == 0) {
+        pen->attrs = VT_ATTR_DEFAULT_FG | VT_ATTR_DEFAULT_BG;
+        return;
+    }
+    for (n = 0; n < params->count; ++n) {
+        int value = params->values[n];
+        int color;
+        switch (value) {
+            case 0:
+                pen->attrs = VT_ATTR_DEFAULT_FG | VT_ATTR_DEFAULT_BG;
+                break;
+            case 1: pen->attrs |= VT_ATTR_BOLD; break;
+            case 2: pen->attrs |= VT_ATTR_DIM; break;
+            case 3: pen->attrs |= VT_ATTR_ITALIC; break;
+            case 4: pen->attrs |= VT_ATTR_UNDERLINE; break;
+            case 5: pen->attrs |= VT_ATTR_BLINK; break;
+            case 7: pen->attrs |= VT_ATTR_REVERSE; break;
+            case 8: pen->attrs |= VT_ATTR_INVISIBLE; break;
+            case 9: pen->attrs |= VT_ATTR_STRIKE; break;
+            case 21:
+            case 22: pen->attrs &= ~(VT_ATTR_BOLD | VT_ATTR_DIM); break;
+            case 23: pen->attrs &= ~VT_ATTR_ITALIC; break;
+            case 24: pen->attrs &= ~VT_ATTR_UNDERLINE; break;
+            case 25: pen->attrs &= ~VT_ATTR_BLINK; break;
+            case 27: pen->attrs &= ~VT_ATTR_REVERSE; break;
+            case 28: pen->attrs &= ~VT_ATTR_INVISIBLE; break;
+            case 29: pen->attrs &= ~VT_ATTR_STRIKE; break;
+            case 38:
+                n += extended_color(params, n, &color) - 1;
+                if (color >= 0) {
+                    pen->fg = (uint8_t) color;
+                    pen->attrs &= ~VT_ATTR_DEFAULT_FG;
+                }
+                break;
+            case 39: pen->attrs |= VT_ATTR_DEFAULT_FG; break;
+            case 48:
+                n += extended_color(params, n, &color) - 1;
+                if (color >= 0) {
+                    pen->bg = (uint8_t) color;
+                    pen->attrs &= ~VT_ATTR_DEFAULT_BG;
+                }
+                break;
+            case 49: pen->attrs |= VT_ATTR_DEFAULT_BG; break;
+            default:
+                if (value >= 30 && value <= 37) {
+                    pen->fg = (uint8_t) (value - 30);
+                    pen->attrs &= ~VT_ATTR_DEFAULT_FG;
+                } else if (value >= 40 && value <= 47) {
+                    pen->bg = (uint8_t) (value - 40);
+                    pen->attrs &= ~VT_ATTR_DEFAULT_BG;
+                } else if (value >= 90 && value <= 97) {
+                    pen->fg = (uint8_t) (value - 90 + 8);
+                    pen->attrs &= ~VT_ATTR_DEFAULT_FG;
+                } else if (value >= 100 && value <= 107) {
+                    pen->bg = (uint8_t) (value - 100 + 8);
+                    pen->attrs &= ~VT_ATTR_DEFAULT_BG;
+                }
+                break;
+        }
+    }
+}
+
+static void set_modes(VTScreen *screen, const VTParams *params, int enable) {
+    int private_mode = params->num_intermediates == 1 && params->intermediates[0] == '?';
+    int n;
+
+    if (params->num_intermediates && !private_mode) {
+        return;
+    }
+    for (n = 0; n < params->count; ++n) {
+        int value = params->values[n];
+        if (!private_mode) {
+            if (value == 4) {
+                screen_set_mode(screen, VT_MODE_INSERT, enable);
+            }
+        } else if (value == 6) {
+            screen_set_mode(screen, VT_MODE_ORIGIN, enable);
+        } else if (value == 7) {
+            screen_set_mode(screen, VT_MODE_AUTOWRAP, enable);
+        } else if (value == 25) {
+            screen_set_mode(screen, VT_MODE_CURSOR_VISIBLE, enable);
+        }
+    }
+}
+
+static void on_print(void *user, const uint32_t *codepoints, int count) {
+    VTScreen *screen = (VTScreen *) user;
+    screen_write(screen, codepoints, count);
+}
+
+static void on_execute(void *user, uint8_t control) {
+    VTScreen *screen = (VTScreen *) user;
+    switch (control) {
+        case '\b':
+            screen_backspace(screen);
+            break;
+        case '\t':
+            screen_tab(screen, 1);
+            break;
+        case '\n':
+        case '\v':
+        case '\f':
+            screen_index(screen);
+            break;
+        case '\r':
+            screen_carriage_return(screen);
+            break;
+        default:
+            break;
+    }
+}
+
+static void on_esc(void *user, const VTParams *params, uint8_t final) {
+    VTScreen *screen = (VTScreen *) user;
+    if (params->num_intermediates) {
+        return;
+    }
+    switch (final) {
+        case '7':
+            screen_save_cursor(screen);
+            break;
+        case '8':
+            screen_restore_cursor(screen);
+            break;
+        case 'D':
+            screen_index(screen);
+            break;
+        case 'E':
+            screen_carriage_return(screen);
+            screen_index(screen);
+            break;
+        case 'H':
+            screen_set_tab(screen);
+            break;
+        case 'M':
+            screen_reverse_index(screen);
+            break;
+        case 'c':
+            screen_reset(screen);
+            break;
+        default:
+            break;
+    }
+}
+
+static void on_csi(void *user, const VTParams *params, uint8_t final) {
+    VTScreen *screen = (VTScreen *) user;
+    int col, row;
+
+    if (final == 'h' || final == 'l') {
+        set_modes(screen, params, final == 'h');
+        return;
+    }
+    // private and intermediate variants of the rest are not supported
+    if (params->num_intermediates) {
+        return;
+    }
+    screen_cursor(screen, &col, &row);
+    switch (final) {
+        case '@':
+            screen_insert_chars(screen, param_or(params, 0, 1));
+            break;
+        case 'A':
+            screen_move_by(screen, 0, -param_or(params, 0, 1));
+            break;
+        case 'B':
+        case 'e':
+            screen_move_by(screen, 0, param_or(params, 0, 1));
+            break;
+        case 'C':
+        case 'a':
+            screen_move_by(screen, param_or(params, 0, 1), 0);
+            break;
+        case 'D':
+            screen_move_by(screen, -param_or(params, 0, 1), 0);
+            break;
+        case 'E':
+            screen_move_by(screen, -col, param_or(params, 0, 1));
+            break;
+        case 'F':
+            screen_move_by(screen, -col, -param_or(params, 0, 1));
+            break;
+        case 'G':
+        case '`':
+            screen_move_by(screen, param_or(params, 0, 1) - 1 - col, 0);
+            break;
+        case 'H':
+        case 'f':
+            screen_move_to(screen, param_or(params, 1, 1) - 1, param_or(params, 0, 1) - 1);
+            break;
+        case 'I':
+            screen_tab(screen, param_or(params, 0, 1));
+            break;
+        case 'J':
+            screen_erase_display(screen, param_or(params, 0, 0));
+            break;
+        case 'K':
+            screen_erase_line(screen, param_or(params, 0, 0));
+            break;
+        case 'L':
+            screen_insert_lines(screen, param_or(params, 0, 1));
+            break;
+        case 'M':
+            screen_delete_lines(screen, param_or(params, 0, 1));
+            break;
+        case 'P':
+            screen_delete_chars(screen, param_or(params, 0, 1));
+            break;
+        case 'S':
+            screen_scroll_up(screen, param_or(params, 0, 1));
+            break;
+        case 'T':
+            screen_scroll_down(screen, param_or(params, 0, 1));
+            break;
+        case 'X':
+            screen_erase_chars(screen, param_or(params, 0, 1));
+            break;
+        case 'Z':
+            screen_tab(screen, -param_or(params, 0, 1));
+            break;
+        case 'd':
+            // absolute row, keeps the column, origin mode applies
+            if (screen_modes(screen) & VT_MODE_ORIGIN) {
+                screen_move_by(screen, 0, param_or(params, 0, 1) - 1 - row);
+            } else {
+                screen_move_to(screen, col, param_or(params, 0, 1) - 1);
+            }
+            break;
+        case 'g':
+            if (param_or(params, 0, 0) == 0) {
+                screen_clear_tab(screen, 0);
+            } else if (params->values[0] == 3) {
+                screen_clear_tab(screen, 1);
+            }
+            break;
+        case 'm':
+            select_graphic_rendition(screen, params);
+            break;
+        case 'r':
+            screen_set_region(screen, param_or(params, 0, 1) - 1, param_or(params, 1, screen_rows(screen)) - 1);
+            break;
+        case 's':
+            screen_save_cursor(screen);
+            break;
+        case 'u':
+            screen_restore_cursor(screen);
+            break;
+        default:
+            break;
+    }
+}
+
+// the xterm 256 color palette: 16 ANSI colors, the 6x6x6 cube and a gray ramp
+static void init_palette(void) {
+    static const uint32_t ansi[16] = {
+        0x000000, 0xcd0000, 0x00cd00, 0xcdcd00, 0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+        0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00, 0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff,
+    };
+    static const uint32_t levels[6] = {0, 95, 135, 175, 215, 255};
+    int i;
+
+    for (i = 0; i < 16; ++i) {
+        vt_palette[i] = 0xff000000 | ansi[i];
+    }
+    for (i = 0; i < 216; ++i) {
+        vt_palette[16 + i] = 0xff000000 | levels[i / 36] << 16 | levels[i / 6 % 6] << 8 | levels[i % 6];
+    }
+    for (i = 0; i < 24; ++i) {
+        uint32_t level = 8 + 10 * i;
+        vt_palette[232 + i] = 0xff000000 | level << 16 | level << 8 | level;
+    }
+}
+
+static void fill_rect(uint32_t *pixels, int stride, int x, int y, int width, int height, uint32_t color) {
+    int i, j;
+    for (j = 0; j < height; ++j) {
+        uint32_t *out = pixels + (size_t) (y + j) * stride + x;
+        for (i = 0; i < width; ++i) {
+            out[i] = color;
+        }
+    }
+}
+
+/**
+ * draw one cell, or both columns of a double width one, the glyph is clipped to the cell
+ * so a cell can be redrawn without its neighbours
+ */
+static void render_cell(uint32_t *pixels, int stride, const VTCell *cell, int x, int y, int width, int cursor) {
+    uint32_t fg = cell->attrs & VT_ATTR_DEFAULT_FG ? VT_DEFAULT_FG : vt_palette[cell->fg];
+    uint32_t bg = cell->attrs & VT_ATTR_DEFAULT_BG ? VT_DEFAULT_BG : vt_palette[cell->bg];
+
+    if (!(cell->attrs & VT_ATTR_REVERSE) != !cursor) {
+        uint32_t swap = fg;
+        fg = bg;
+        bg = swap;
+    }
+    if (cell->attrs & VT_ATTR_DIM) {
+        fg = (fg & 0xff000000) | ((fg & 0x00fefefe) >> 1);
+    }
+    fill_rect(pixels, stride, x, y, width, VT_CELL_HEIGHT, bg);
+    if (cell->attrs & VT_ATTR_INVISIBLE) {
+        return;
+    }
+
+    if (cell->codepoint > ' ' && vt_font) {
+        uint8_t style = (uint8_t) ((cell->attrs & VT_ATTR_BOLD ? GLYPH_STYLE_BOLD : 0)
+                                   | (cell->attrs & VT_ATTR_ITALIC ? GLYPH_STYLE_ITALIC : 0));
+        const GlyphCacheEntry *entry = glyph_cache_get(vt_cache, vt_font, 0, font_lookup(vt_font, cell->codepoint),
+                                                       style);
+        if (entry) {
+            glyph_cache_blit(entry, pixels + (size_t) y * stride + x, stride, width, VT_CELL_HEIGHT,
+                             entry->metrics.bearing_x, VT_BASELINE - entry->metrics.bearing_y, fg);
+        }
+    }
+    if (cell->attrs & VT_ATTR_UNDERLINE) {
+        fill_rect(pixels, stride, x, y + VT_BASELINE + 1, width, 1, fg);
+    }
+    if (cell->attrs & VT_ATTR_STRIKE) {
+        fill_rect(pixels, stride, x, y + VT_BASELINE - VT_FONT_SIZE / 3, width, 1, fg);
+    }
+}
+
+// redraw columns [begin, end) of a row, widened so double width characters are drawn whole
+static void render_span(uint32_t *pixels, int stride, int row, int *begin, int *end) {
+    const VTCell *cells = screen_row(vt_screen, row);
+    int cols = screen_cols(vt_screen);
+    int col;
+
+    if (*begin > 0 && (cells[*begin].attrs & VT_ATTR_WIDE_SPACER)) {
+        --*begin;
+    }
+    if (*end < cols && (cells[*end - 1].attrs & VT_ATTR_WIDE)) {
+        ++*end;
+    }
+    for (col = *begin; col < *end; ++col) {
+        int cursor = row == vt_cursor_row && col == vt_cursor_col;
+        int width = VT_CELL_WIDTH;
+        if ((cells[col].attrs & VT_ATTR_WIDE) && col + 1 < cols) {
+            width *= 2;
+            cursor |= row == vt_cursor_row && col + 1 == vt_cursor_col;
+            render_cell(pixels, stride, &cells[col], col * VT_CELL_WIDTH, row * VT_CELL_HEIGHT, width, cursor);
+            ++col;
+            continue;
+        }
+        render_cell(pixels, stride, &cells[col], col * VT_CELL_WIDTH, row * VT_CELL_HEIGHT, width, cursor);
+    }
+}
+
+// add a damaged rectangle, growing the previous one when it sits right above with the same columns
+static int add_rect(VTRect *rects, int count, int max_rects, int x, int y, int width, int height) {
+    VTRect *last = count > 0 ? &rects[count - 1] : NULL;
+    if (max_rects <= 0) {
+        return 0;
+    }
+    if (last && last->x == x && last->width == width && last->y + last->height == y) {
+        last->height += height;
+        return count;
+    }
+    if (count == max_rects) {
+        int x1 = last->x + last->width > x + width ? last->x + last->width : x + width;
+        int y1 = last->y + last->height > y + height ? last->y + last->height : y + height;
+        last->x = last->x < x ? last->x : x;
+        last->y = last->y < y ? last->y : y;
+        last->width = x1 - last->x;
+        last->height = y1 - last->y;
+        return count;
+    }
+    rects[count].x = x;
+    rects[count].y = y;
+    rects[count].width = width;
+    rects[count].height = height;
+    return count + 1;
+}
 
 int VT_Init(int width, int height) {
+    static const VTParserHandler handler = {on_print, on_execute, on_esc, on_csi, NULL, NULL, NULL, NULL};
+    int cols = width / VT_CELL_WIDTH;
+    int rows = height / VT_CELL_HEIGHT;
+
+    init_palette();
+    if (!vt_screen) {
+        vt_screen = screen_new(cols > 0 ? cols : 1, rows > 0 ? rows : 1);
+    }
+    if (vt_screen && !vt_parser) {
+        vt_parser = vt_parser_new(&handler, vt_screen);
+    }
+    if (!vt_cache) {
+        vt_cache = glyph_cache_new(VT_GLYPH_CACHE_PAGES);
+    }
+    return vt_screen && vt_parser && vt_cache ? 0 : -1;
+}
+
+void VT_Shutdown(void) {
+    if (vt_prewarm) {
+        glyph_prewarm_stop(vt_prewarm);
+        vt_prewarm = NULL;
+    }
+    glyph_cache_free(vt_cache);
+    vt_cache = NULL;
+    if (vt_font) {
+        font_free(vt_font);
+        vt_font = NULL;
+    }
+    vt_parser_free(vt_parser);
+    vt_parser = NULL;
+    screen_free(vt_screen);
+    vt_screen = NULL;
+    vt_cursor_col = -1;
+}
+
+int VT_SetFont(const void *data, size_t size) {
+    TTFont *font = font_load(data, size);
+    if (!font) {
+        return -1;
+    }
+    font_set_size(font, VT_FONT_SIZE);
+    if (vt_prewarm) {
+        glyph_prewarm_stop(vt_prewarm);
+        vt_prewarm = NULL;
+    }
+    if (vt_cache) {
+        glyph_cache_clear(vt_cache);
+    }
+    if (vt_font) {
+        font_free(vt_font);
+    }
+    vt_font = font;
+    // the terminal's likely glyphs are rasterized in the background and picked up by VT_Update
+    vt_prewarm = glyph_prewarm_start(font, 0, VT_FONT_SIZE, NULL, 0);
+    VT_Invalidate();
     return 0;
 }
 
-void VT_Update() {
+int VT_Update(uint32_t *pixels, int stride, VTRect *rects, int max_rects) {
+    int col, row, count = 0;
+
+    if (!vt_screen || !pixels) {
+        return 0;
+    }
+    if (vt_prewarm) {
+        glyph_prewarm_drain(vt_prewarm, vt_cache, VT_PREWARM_DRAIN);
+        if (glyph_prewarm_done(vt_prewarm)) {
+            glyph_prewarm_stop(vt_prewarm);
+            vt_prewarm = NULL;
+        }
+    }
+
+    // the cursor is drawn over the grid, its old and new cells are redrawn when it moves
+    screen_cursor(vt_screen, &col, &row);
+    if (!(screen_modes(vt_screen) & VT_MODE_CURSOR_VISIBLE)) {
+        col = -1;
+    }
+    if (col != vt_cursor_col || row != vt_cursor_row) {
+        if (vt_cursor_col >= 0) {
+            screen_damage(vt_screen, vt_cursor_row, vt_cursor_col, vt_cursor_col + 1);
+        }
+        if (col >= 0) {
+            screen_damage(vt_screen, row, col, col + 1);
+        }
+        vt_cursor_col = col;
+        vt_cursor_row = row;
+    }
+
+    for (row = screen_next_dirty(vt_screen, 0); row >= 0; row = screen_next_dirty(vt_screen, row + 1)) {
+        int begin, end;
+        screen_row_damage(vt_screen, row, &begin, &end);
+        render_span(pixels, stride, row, &begin, &end);
+        count = add_rect(rects, count, max_rects, begin * VT_CELL_WIDTH, row * VT_CELL_HEIGHT,
+                         (end - begin) * VT_CELL_WIDTH, VT_CELL_HEIGHT);
+    }
+    screen_clear_damage(vt_screen);
+    return count;
+}
+
+void VT_Invalidate(void) {
+    if (vt_screen) {
+        screen_damage_all(vt_screen);
+    }
+}
 
+void VT_Write(const void *data, size_t size) {
+    if (vt_parser) {
+        vt_parser_feed(vt_parser, (const uint8_t *) data, size);
+    }
 }
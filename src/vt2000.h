@@ -1,12 +1,42 @@
 #ifndef VT2000_VT2000_H
 #define VT2000_VT2000_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifndef VT_malloc
 #define VT_malloc(x)  (malloc(x))
+#define VT_realloc(x, n) (realloc(x, n))
 #define VT_free(x)    (free(x))
 #endif
 
+// character cell in pixels, VT_Init fits as many as the surface holds
+#define VT_CELL_WIDTH 10
+#define VT_CELL_HEIGHT 20
+
+// a changed area of the framebuffer, in pixels
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+} VTRect;
+
 int VT_Init(int width, int height);
-void VT_Update();
+// stop background work and release everything VT_Init and VT_SetFont set up
+void VT_Shutdown(void);
+// TrueType font for the cells, data is borrowed and must stay valid
+int VT_SetFont(const void *data, size_t size);
+/**
+ * redraw the cells changed since the last update into a 32-bit 0xAARRGGBB framebuffer of
+ * the size given to VT_Init, rows of stride pixels, the rest of the framebuffer is not touched
+ * returns the number of damaged rectangles stored in rects, only those pixels need presenting
+ * when there are more than max_rects the last one covers the rest
+ */
+int VT_Update(uint32_t *pixels, int stride, VTRect *rects, int max_rects);
+// redraw everything on the next update, e.g. for a framebuffer with unknown content
+void VT_Invalidate(void);
+// host output to the terminal, escape sequences and UTF-8 may be split across calls
+void VT_Write(const void *data, size_t size);
 
 #endif //VT2000_VT2000_H
@@ -0,0 +1,557 @@
+/**
+ * VT100 / xterm escape sequence parser
+ * states and transitions follow the DEC ANSI parser diagram (vt100.net/emu/dec_ansi_parser),
+ * minus 8-bit C1 controls which collide with UTF-8, plus ':' sub parameters in CSI
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "vt2000.h"
+#include "vtparse.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VT_PARSE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// code points gathered before print is called, a long run is handed over in pieces of this size
+#define VT_PARSER_RUN 512
+
+enum {
+    VT_STATE_GROUND,
+    VT_STATE_ESCAPE,
+    VT_STATE_ESCAPE_INTERMEDIATE,
+    VT_STATE_CSI_ENTRY,
+    VT_STATE_CSI_PARAM,
+    VT_STATE_CSI_INTERMEDIATE,
+    VT_STATE_CSI_IGNORE,
+    VT_STATE_DCS_ENTRY,
+    VT_STATE_DCS_PARAM,
+    VT_STATE_DCS_INTERMEDIATE,
+    VT_STATE_DCS_PASSTHROUGH,
+    VT_STATE_DCS_IGNORE,
+    VT_STATE_OSC_STRING,
+    VT_STATE_SOS_PM_APC_STRING,
+    VT_STATE_COUNT,
+    // table entry without a state change, no exit or entry actions run
+    VT_STATE_STAY = 0x0F
+};
+
+// actions run on a byte, entry and exit actions of the states are implied by the transition
+enum {
+    VT_ACTION_NONE,
+    VT_ACTION_PRINT,
+    VT_ACTION_EXECUTE,
+    VT_ACTION_COLLECT,
+    VT_ACTION_PARAM,
+    VT_ACTION_ESC_DISPATCH,
+    VT_ACTION_CSI_DISPATCH,
+    VT_ACTION_PUT,
+    VT_ACTION_OSC_PUT
+};
+
+struct VTParser {
+    VTParserHandler handler;
+    void *user;
+    uint8_t state;
+    // too many intermediates, the sequence is dropped at its final byte
+    uint8_t ignore;
+    uint8_t param_started;
+    uint8_t param_index;
+    uint8_t param_overflow;
+    // pending UTF-8 sequence of the ground state
+    uint8_t utf8_need;
+    uint32_t utf8_cp;
+    uint32_t utf8_min;
+    VTParams params;
+    int osc_size;
+    uint8_t osc[VT_PARSER_MAX_OSC];
+    uint32_t run[VT_PARSER_RUN];
+    // action << 4 | next state, indexed by state and input byte
+    uint8_t table[VT_STATE_COUNT][256];
+};
+
+static void table_set(uint8_t *row, int first, int last, int action, int state)
+{
+    int c;
+    for (c = first; c <= last; ++c) {
+        row[c] = (uint8_t) (action << 4 | state);
+    }
+}
+
+// C0 controls except CAN, SUB and ESC, those are handled the same in every state
+static void table_c0(uint8_t *row, int action)
+{
+    table_set(row, 0x00, 0x17, action, VT_STATE_STAY);
+    table_set(row, 0x19, 0x19, action, VT_STATE_STAY);
+    table_set(row, 0x1C, 0x1F, action, VT_STATE_STAY);
+}
+
+static void build_table(VTParser *parser)
+{
+    uint8_t *row;
+    int s;
+
+    for (s = 0; s < VT_STATE_COUNT; ++s) {
+        table_set(parser->table[s], 0x00, 0xFF, VT_ACTION_NONE, VT_STATE_STAY);
+    }
+
+    row = parser->table[VT_STATE_GROUND];
+    table_c0(row, VT_ACTION_EXECUTE);
+    table_set(row, 0x20, 0x7E, VT_ACTION_PRINT, VT_STATE_STAY);
+    table_set(row, 0x80, 0xFF, VT_ACTION_PRINT, VT_STATE_STAY);
+
+    row = parser->table[VT_STATE_ESCAPE];
+    table_c0(row, VT_ACTION_EXECUTE);
+    table_set(row, 0x20, 0x2F, VT_ACTION_COLLECT, VT_STATE_ESCAPE_INTERMEDIATE);
+    table_set(row, 0x30, 0x7E, VT_ACTION_ESC_DISPATCH, VT_STATE_GROUND);
+    table_set(row, 0x50, 0x50, VT_ACTION_NONE, VT_STATE_DCS_ENTRY);
+    table_set(row, 0x58, 0x58, VT_ACTION_NONE, VT_STATE_SOS_PM_APC_STRING);
+    table_set(row, 0x5B, 0x5B, VT_ACTION_NONE, VT_STATE_CSI_ENTRY);
+    table_set(row, 0x5D, 0x5D, VT_ACTION_NONE, VT_STATE_OSC_STRING);
+    table_set(row, 0x5E, 0x5F, VT_ACTION_NONE, VT_STATE_SOS_PM_APC_STRING);
+
+    row = parser->table[VT_STATE_ESCAPE_INTERMEDIATE];
+    table_c0(row, VT_ACTION_EXECUTE);
+    table_set(row, 0x20, 0x2F, VT_ACTION_COLLECT, VT_STATE_STAY);
+    table_set(row, 0x30, 0x7E, VT_ACTION_ESC_DISPATCH, VT_STATE_GROUND);
+
+    row = parser->table[VT_STATE_CSI_ENTRY];
+    table_c0(row, VT_ACTION_EXECUTE);
+    table_set(row, 0x20, 0x2F, VT_ACTION_COLLECT, VT_STATE_CSI_INTERMEDIATE);
+    table_set(row, 0x30, 0x3B, VT_ACTION_PARAM, VT_STATE_CSI_PARAM);
+    table_set(row, 0x3C, 0x3F, VT_ACTION_COLLECT, VT_STATE_CSI_PARAM);
+    table_set(row, 0x40, 0x7E, VT_ACTION_CSI_DISPATCH, VT_STATE_GROUND);
+
+    row = parser->table[VT_STATE_CSI_PARAM];
+    table_c0(row, VT_ACTION_EXECUTE);
+    table_set(row, 0x20, 0x2F, VT_ACTION_COLLECT, VT_STATE_CSI_INTERMEDIATE);
+    table_set(row, 0x30, 0x3B, VT_ACTION_PARAM, VT_STATE_STAY);
+    table_set(row, 0x3C, 0x3F, VT_ACTION_NONE, VT_STATE_CSI_IGNORE);
+    table_set(row, 0x40, 0x7E, VT_ACTION_CSI_DISPATCH, VT_STATE_GROUND);
+
+    row = parser->table[VT_STATE_CSI_INTERMEDIATE];
+    table_c0(row, VT_ACTION_EXECUTE);
+    table_set(row, 0x20, 0x2F, VT_ACTION_COLLECT, VT_STATE_STAY);
+    table_set(row, 0x30, 0x3F, VT_ACTION_NONE, VT_STATE_CSI_IGNORE);
+    table_set(row, 0x40, 0x7E, VT_ACTION_CSI_DISPATCH, VT_STATE_GROUND);
+
+    row = parser->table[VT_STATE_CSI_IGNORE];
+    table_c0(row, VT_ACTION_EXECUTE);
+    table_set(row, 0x40, 0x7E, VT_ACTION_NONE, VT_STATE_GROUND);
+
+    row = parser->table[VT_STATE_DCS_ENTRY];
+    table_set(row, 0x20, 0x2F, VT_ACTION_COLLECT, VT_STATE_DCS_INTERMEDIATE);
+    table_set(row, 0x30, 0x3B, VT_ACTION_PARAM, VT_STATE_DCS_PARAM);
+    table_set(row, 0x3C, 0x3F, VT_ACTION_COLLECT, VT_STATE_DCS_PARAM);
+    table_set(row, 0x40, 0x7E, VT_ACTION_NONE, VT_STATE_DCS_PASSTHROUGH);
+
+    row = parser->table[VT_STATE_DCS_PARAM];
+    table_set(row, 0x20, 0x2F, VT_ACTION_COLLECT, VT_STATE_DCS_INTERMEDIATE);
+    table_set(row, 0x30, 0x3B, VT_ACTION_PARAM, VT_STATE_STAY);
+    table_set(row, 0x3C, 0x3F, VT_ACTION_NONE, VT_STATE_DCS_IGNORE);
+    table_set(row, 0x40, 0x7E, VT_ACTION_NONE, VT_STATE_DCS_PASSTHROUGH);
+
+    row = parser->table[VT_STATE_DCS_INTERMEDIATE];
+    table_set(row, 0x20, 0x2F, VT_ACTION_COLLECT, VT_STATE_STAY);
+    table_set(row, 0x30, 0x3F, VT_ACTION_NONE, VT_STATE_DCS_IGNORE);
+    table_set(row, 0x40, 0x7E, VT_ACTION_NONE, VT_STATE_DCS_PASSTHROUGH);
+
+    row = parser->table[VT_STATE_DCS_PASSTHROUGH];
+    table_c0(row, VT_ACTION_PUT);
+    table_set(row, 0x20, 0x7E, VT_ACTION_PUT, VT_STATE_STAY);
+    table_set(row, 0x80, 0xFF, VT_ACTION_PUT, VT_STATE_STAY);
+
+    row = parser->table[VT_STATE_OSC_STRING];
+    // BEL ends an OSC in xterm as well as ST
+    table_set(row, 0x07, 0x07, VT_ACTION_NONE, VT_STATE_GROUND);
+    table_set(row, 0x20, 0xFF, VT_ACTION_OSC_PUT, VT_STATE_STAY);
+
+    // the anywhere transitions
+    for (s = 0; s < VT_STATE_COUNT; ++s) {
+        row = parser->table[s];
+        table_set(row, 0x18, 0x18, VT_ACTION_EXECUTE, VT_STATE_GROUND);
+        table_set(row, 0x1A, 0x1A, VT_ACTION_EXECUTE, VT_STATE_GROUND);
+        table_set(row, 0x1B, 0x1B, VT_ACTION_NONE, VT_STATE_ESCAPE);
+    }
+}
+
+static inline int lowest_bit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int) index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// length of the leading run without C0 controls and DEL, bytes >= 0x80 are part of the run
+static size_t scan_printable(const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+#ifdef VT_PARSE_SSE2
+    const __m128i c0_last = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+        // min(v, 0x1F) == v is an unsigned v <= 0x1F
+        __m128i control = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, c0_last), v), _mm_cmpeq_epi8(v, del));
+        int mask = _mm_movemask_epi8(control);
+        if (mask) {
+            return i + lowest_bit((unsigned int) mask);
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        if (data[i] < 0x20 || data[i] == 0x7F) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void flush_run(VTParser *parser, int count)
+{
+    if (count > 0 && parser->handler.print) {
+        parser->handler.print(parser->user, parser->run, count);
+    }
+}
+
+// decode one byte into run, at most two code points when it breaks off a pending sequence
+static int utf8_byte(VTParser *parser, uint8_t byte, uint32_t *run, int count)
+{
+    if (parser->utf8_need) {
+        if ((byte & 0xC0) == 0x80) {
+            uint32_t cp = parser->utf8_cp << 6 | (byte & 0x3F);
+            parser->utf8_cp = cp;
+            if (--parser->utf8_need == 0) {
+                // overlong forms, surrogates and out of range values
+                if (cp < parser->utf8_min || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+                    cp = 0xFFFD;
+                }
+                run[count++] = cp;
+            }
+            return count;
+        }
+        parser->utf8_need = 0;
+        run[count++] = 0xFFFD;
+    }
+    if (byte < 0x80) {
+        run[count++] = byte;
+    } else if (byte >= 0xC2 && byte <= 0xDF) {
+        parser->utf8_cp = byte & 0x1F;
+        parser->utf8_min = 0x80;
+        parser->utf8_need = 1;
+    } else if (byte >= 0xE0 && byte <= 0xEF) {
+        parser->utf8_cp = byte & 0x0F;
+        parser->utf8_min = 0x800;
+        parser->utf8_need = 2;
+    } else if (byte >= 0xF0 && byte <= 0xF4) {
+        parser->utf8_cp = byte & 0x07;
+        parser->utf8_min = 0x10000;
+        parser->utf8_need = 3;
+    } else {
+        run[count++] = 0xFFFD;
+    }
+    return count;
+}
+
+// a control byte cut a UTF-8 sequence short
+static void utf8_abort(VTParser *parser)
+{
+    parser->utf8_need = 0;
+    parser->run[0] = 0xFFFD;
+    flush_run(parser, 1);
+}
+
+// decode a run without controls and hand it to print
+static void print_run(VTParser *parser, const uint8_t *data, size_t size)
+{
+    uint32_t *run = parser->run;
+    int count = 0;
+    size_t i = 0;
+
+    while (i < size) {
+        size_t block = size - i < 16 ? size - i : 16;
+        size_t k;
+        // a block adds at most 16 + 1 code points
+        if (count > VT_PARSER_RUN - 17) {
+            flush_run(parser, count);
+            count = 0;
+        }
+#ifdef VT_PARSE_SSE2
+        if (block == 16 && !parser->utf8_need) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+            if (!_mm_movemask_epi8(v)) {
+                // all ASCII, widen bytes to code points
+                const __m128i zero = _mm_setzero_si128();
+                __m128i lo = _mm_unpacklo_epi8(v, zero);
+                __m128i hi = _mm_unpackhi_epi8(v, zero);
+                _mm_storeu_si128((__m128i *) (run + count), _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128((__m128i *) (run + count + 4), _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128((__m128i *) (run + count + 8), _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128((__m128i *) (run + count + 12), _mm_unpackhi_epi16(hi, zero));
+                count += 16;
+                i += 16;
+                continue;
+            }
+        }
+#endif
+        for (k = 0; k < block; ++k) {
+            uint8_t byte = data[i + k];
+            if (byte < 0x80 && !parser->utf8_need) {
+                run[count++] = byte;
+            } else {
+                count = utf8_byte(parser, byte, run, count);
+            }
+        }
+        i += block;
+    }
+    flush_run(parser, count);
+}
+
+static void osc_put(VTParser *parser, const uint8_t *data, size_t size)
+{
+    size_t room = (size_t) (VT_PARSER_MAX_OSC - parser->osc_size);
+    if (size > room) {
+        size = room;
+    }
+    memcpy(parser->osc + parser->osc_size, data, size);
+    parser->osc_size += (int) size;
+}
+
+static void dcs_put(VTParser *parser, const uint8_t *data, size_t size)
+{
+    if (!parser->handler.dcs_put) {
+        return;
+    }
+    while (size > 0) {
+        int n = size > INT_MAX ? INT_MAX : (int) size;
+        parser->handler.dcs_put(parser->user, data, n);
+        data += n;
+        size -= (size_t) n;
+    }
+}
+
+static void clear_sequence(VTParser *parser)
+{
+    parser->ignore = 0;
+    parser->param_started = 0;
+    parser->param_index = 0;
+    parser->param_overflow = 0;
+    parser->params.values[0] = 0;
+    parser->params.subparams = 0;
+    parser->params.count = 0;
+    parser->params.num_intermediates = 0;
+}
+
+static void collect(VTParser *parser, uint8_t byte)
+{
+    if (parser->params.num_intermediates < VT_PARSER_MAX_INTERMEDIATES) {
+        parser->params.intermediates[parser->params.num_intermediates++] = byte;
+    } else {
+        parser->ignore = 1;
+    }
+}
+
+static void param(VTParser *parser, uint8_t byte)
+{
+    VTParams *params = &parser->params;
+    parser->param_started = 1;
+    if (byte == ';' || byte == ':') {
+        if (parser->param_index + 1 < VT_PARSER_MAX_PARAMS) {
+            parser->param_index++;
+            params->values[parser->param_index] = 0;
+            if (byte == ':') {
+                params->subparams |= (uint16_t) (1u << parser->param_index);
+            }
+        } else {
+            parser->param_overflow = 1;
+        }
+    } else if (!parser->param_overflow) {
+        uint32_t value = params->values[parser->param_index] * 10u + (byte - '0');
+        params->values[parser->param_index] = (uint16_t) (value > 0xFFFF ? 0xFFFF : value);
+    }
+}
+
+// the finished parameters of the current sequence, NULL when it is to be ignored
+static const VTParams *sequence_params(VTParser *parser)
+{
+    if (parser->ignore) {
+        return NULL;
+    }
+    parser->params.count = (uint8_t) (parser->param_started ? parser->param_index + 1 : 0);
+    return &parser->params;
+}
+
+static void run_action(VTParser *parser, int action, uint8_t byte)
+{
+    const VTParserHandler *handler = &parser->handler;
+    const VTParams *params;
+
+    switch (action) {
+        case VT_ACTION_PRINT:
+            print_run(parser, &byte, 1);
+            break;
+        case VT_ACTION_EXECUTE:
+            if (handler->execute) {
+                handler->execute(parser->user, byte);
+            }
+            break;
+        case VT_ACTION_COLLECT:
+            collect(parser, byte);
+            break;
+        case VT_ACTION_PARAM:
+            param(parser, byte);
+            break;
+        case VT_ACTION_ESC_DISPATCH:
+            params = sequence_params(parser);
+            if (params && handler->esc_dispatch) {
+                handler->esc_dispatch(parser->user, params, byte);
+            }
+            break;
+        case VT_ACTION_CSI_DISPATCH:
+            params = sequence_params(parser);
+            if (params && handler->csi_dispatch) {
+                handler->csi_dispatch(parser->user, params, byte);
+            }
+            break;
+        case VT_ACTION_PUT:
+            dcs_put(parser, &byte, 1);
+            break;
+        case VT_ACTION_OSC_PUT:
+            osc_put(parser, &byte, 1);
+            break;
+        default:
+            break;
+    }
+}
+
+static void transition(VTParser *parser, int next, int action, uint8_t byte)
+{
+    const VTParserHandler *handler = &parser->handler;
+    const VTParams *params;
+
+    // exit action of the state left
+    if (parser->state == VT_STATE_OSC_STRING) {
+        if (handler->osc_dispatch) {
+            handler->osc_dispatch(parser->user, parser->osc, parser->osc_size);
+        }
+    } else if (parser->state == VT_STATE_DCS_PASSTHROUGH) {
+        if (handler->dcs_unhook) {
+            handler->dcs_unhook(parser->user);
+        }
+    }
+
+    run_action(parser, action, byte);
+
+    // entry action of the state entered
+    switch (next) {
+        case VT_STATE_ESCAPE:
+        case VT_STATE_CSI_ENTRY:
+        case VT_STATE_DCS_ENTRY:
+            clear_sequence(parser);
+            break;
+        case VT_STATE_OSC_STRING:
+            parser->osc_size = 0;
+            break;
+        case VT_STATE_DCS_PASSTHROUGH:
+            params = sequence_params(parser);
+            if (params && handler->dcs_hook) {
+                handler->dcs_hook(parser->user, params, byte);
+            }
+            break;
+        default:
+            break;
+    }
+    parser->state = (uint8_t) next;
+}
+
+VTParser *vt_parser_new(const VTParserHandler *handler, void *user)
+{
+    VTParser *parser = (VTParser *) VT_malloc(sizeof(VTParser));
+    if (!parser) {
+        return NULL;
+    }
+    memset(parser, 0, sizeof(VTParser));
+    if (handler) {
+        parser->handler = *handler;
+    }
+    parser->user = user;
+    build_table(parser);
+    vt_parser_reset(parser);
+    return parser;
+}
+
+void vt_parser_free(VTParser *parser)
+{
+    VT_free(parser);
+}
+
+void vt_parser_reset(VTParser *parser)
+{
+    parser->state = VT_STATE_GROUND;
+    parser->utf8_need = 0;
+    parser->osc_size = 0;
+    clear_sequence(parser);
+}
+
+void vt_parser_feed(VTParser *parser, const uint8_t *data, size_t size)
+{
+    const uint8_t *end = data + size;
+
+    while (data < end) {
+        int state = parser->state;
+        uint8_t entry;
+
+        // the states that take runs of plain bytes consume them whole, the table sees only the rest
+        if (state == VT_STATE_GROUND || state == VT_STATE_OSC_STRING || state == VT_STATE_DCS_PASSTHROUGH
+            || state == VT_STATE_DCS_IGNORE || state == VT_STATE_SOS_PM_APC_STRING) {
+            size_t n = scan_printable(data, (size_t) (end - data));
+            if (n) {
+                if (state == VT_STATE_GROUND) {
+                    print_run(parser, data, n);
+                } else if (state == VT_STATE_OSC_STRING) {
+                    osc_put(parser, data, n);
+                } else if (state == VT_STATE_DCS_PASSTHROUGH) {
+                    dcs_put(parser, data, n);
+                }
+                data += n;
+                if (data == end) {
+                    break;
+                }
+            }
+            if (state == VT_STATE_GROUND && parser->utf8_need) {
+                utf8_abort(parser);
+            }
+        } else if (state == VT_STATE_CSI_ENTRY || state == VT_STATE_CSI_PARAM) {
+            // parameter digits and separators without a table lookup each
+            const uint8_t *start = data;
+            while (data < end && (uint8_t) (*data - 0x30) <= 0x0B) {
+                param(parser, *data++);
+            }
+            if (data != start) {
+                parser->state = VT_STATE_CSI_PARAM;
+                state = VT_STATE_CSI_PARAM;
+                if (data == end) {
+                    break;
+                }
+            }
+        }
+
+        entry = parser->table[state][*data];
+        if ((entry & 0x0F) == VT_STATE_STAY) {
+            run_action(parser, entry >> 4, *data);
+        } else {
+            transition(parser, entry & 0x0F, entry >> 4, *data);
+        }
+        ++data;
+    }
+}
@@ -0,0 +1,69 @@
+/**
+ * VT100 / xterm escape sequence parser
+ * the DEC ANSI parser state machine (ground, escape, CSI, DCS, OSC), transitions come from a byte table,
+ * the ground state scans ahead for the next control byte and hands whole printable runs over as code points
+ * input is UTF-8, C1 controls are only recognized in their 7-bit ESC form
+ */
+
+#ifndef VT2000_VTPARSE_H
+#define VT2000_VTPARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// parameters kept per sequence, further ones are dropped
+#define VT_PARSER_MAX_PARAMS 16
+// intermediate and private marker bytes, a sequence with more is ignored
+#define VT_PARSER_MAX_INTERMEDIATES 2
+// OSC payload bytes kept, the rest is cut off
+#define VT_PARSER_MAX_OSC 512
+
+    typedef struct VTParser VTParser;
+    typedef struct VTParams VTParams;
+    typedef struct VTParserHandler VTParserHandler;
+
+    /**
+     * parameters and intermediates of an ESC, CSI or DCS sequence
+     * omitted parameters are 0, values saturate at 65535
+     * bit i of subparams is set when values[i] followed a ':' (e.g. SGR 38:2::r:g:b)
+     * a private marker (one of <=>?) is the first intermediate
+     */
+    struct VTParams {
+        uint16_t values[VT_PARSER_MAX_PARAMS];
+        uint16_t subparams;
+        uint8_t count;
+        uint8_t num_intermediates;
+        uint8_t intermediates[VT_PARSER_MAX_INTERMEDIATES];
+    };
+
+    /**
+     * callbacks, any of them may be NULL
+     * print gets printable runs already decoded, malformed UTF-8 becomes U+FFFD
+     * a run never spans a control byte or a feed call, buffers are only valid during the call
+     */
+    struct VTParserHandler {
+        void (*print)(void *user, const uint32_t *codepoints, int count);
+        void (*execute)(void *user, uint8_t control);
+        void (*esc_dispatch)(void *user, const VTParams *params, uint8_t final);
+        void (*csi_dispatch)(void *user, const VTParams *params, uint8_t final);
+        void (*osc_dispatch)(void *user, const uint8_t *data, int size);
+        void (*dcs_hook)(void *user, const VTParams *params, uint8_t final);
+        void (*dcs_put)(void *user, const uint8_t *data, int size);
+        void (*dcs_unhook)(void *user);
+    };
+
+    VTParser *vt_parser_new(const VTParserHandler *handler, void *user);
+    void vt_parser_free(VTParser *parser);
+    // back to the ground state, a pending sequence is dropped
+    void vt_parser_reset(VTParser *parser);
+    // sequences and UTF-8 may be split anywhere across calls
+    void vt_parser_feed(VTParser *parser, const uint8_t *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //VT2000_VTPARSE_H
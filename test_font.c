@@ -24,6 +24,8 @@ int main() {
     void * memory;
     size_t size;
     TTFont *font;
+    TTFontBitmap *bitmap;
+    int x, y;
     read_file("fonts/WenQuanYiMicroHeiMono-02.ttf", &memory, &size);
 //    read_file("fonts/Ubuntu-Regular.ttf", &memory, &size);
 //    read_file("fonts/CutiveMono-Regular-1.ttf", &memory, &size);
@@ -31,7 +33,18 @@ int main() {
         printf("font load failed!\n");
     }
 
-    font_render(font, 0x6b63);
+    font_set_size(font, 32);
+    if ((bitmap = font_render(font, 0x6b63))) {
+        printf("advance %d bearing %d,%d size %dx%d\n", bitmap->metrics.advance,
+               bitmap->metrics.bearing_x, bitmap->metrics.bearing_y, bitmap->metrics.width, bitmap->metrics.height);
+        for (y = 0; y < bitmap->metrics.height; ++y) {
+            for (x = 0; x < bitmap->metrics.width; ++x) {
+                putchar(" .:-=+*#%@"[bitmap->pixels[y * bitmap->metrics.width + x] * 9 / 255]);
+            }
+            putchar('\n');
+        }
+        font_free_bitmap(bitmap);
+    }
 
     font_free(font);
     free(memory);
@@ -13,10 +13,15 @@ struct FPSTrace {
     unsigned long lastDrawTick;
 } mFPSTrace;
 
+#define MaxDamageRects 64
+#define FontPath "fonts/WenQuanYiMicroHeiMono-02.ttf"
+
 BITMAPINFO hBitmapInfo;
 VOID *pvBits;
+VOID *pvFont;
 HDC hdc;
-HDC hdcMem;
+// set by WM_PAINT, the next frame presents the whole surface
+volatile LONG repaint = 1;
 
 int AvgFPS() {
     int i;
@@ -28,27 +33,53 @@ int AvgFPS() {
     return avg > 0 ? 1000 / avg : 0;
 }
 
-void DrawBitmap()
+int LoadFont(const char *path)
 {
-    int x, y;
-
-    for (y = 0; y < ScreenHeight; y++) {
-        for (x = 0; x < ScreenWidth; x++) {
-            if (x < ScreenWidth / 2) {
-                ((UINT32 *) pvBits)[x + y * ScreenWidth] = 0xffeeeeee;
-            } else {
-                ((UINT32 *) pvBits)[x + y * ScreenWidth] = 0xff111111;
-            }
-        }
+    FILE *f = fopen(path, "rb");
+    long length;
+    if (!f) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    pvFont = malloc(length);
+    if (!pvFont || fread(pvFont, 1, length, f) != (size_t) length) {
+        fclose(f);
+        return -1;
     }
+    fclose(f);
+    return VT_SetFont(pvFont, length);
+}
 
-    StretchDIBits(hdcMem, 0, 0, ScreenWidth, ScreenHeight, 0, 0, ScreenWidth, ScreenHeight, pvBits, &hBitmapInfo, DIB_RGB_COLORS, SRCCOPY);
+// top-down DIB, source and destination share coordinates
+void Present(int x, int y, int width, int height)
+{
+    StretchDIBits(hdc, x, y, width, height, x, y, width, height, pvBits, &hBitmapInfo, DIB_RGB_COLORS, SRCCOPY);
+}
 
-    char FPSInfo[50];
-    sprintf(FPSInfo, "FPS: %d", AvgFPS());
-    TextOutA(hdcMem, 0, 0, FPSInfo, strlen(FPSInfo));
+void DrawBitmap()
+{
+    VTRect rects[MaxDamageRects];
+    int count, i;
+
+    // only the cells that changed are redrawn, and only their pixels go to the window
+    count = VT_Update((uint32_t *) pvBits, ScreenWidth, rects, MaxDamageRects);
+    if (InterlockedExchange(&repaint, 0)) {
+        Present(0, 0, ScreenWidth, ScreenHeight);
+        count = 1;
+    } else {
+        for (i = 0; i < count; ++i) {
+            Present(rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+        }
+    }
 
-    BitBlt(hdc,0, 0, ScreenWidth, ScreenHeight, hdcMem, 0, 0, SRCCOPY);
+    // an idle frame touches nothing, not even the overlay
+    if (count > 0) {
+        char FPSInfo[50];
+        sprintf(FPSInfo, "FPS: %d", AvgFPS());
+        TextOutA(hdc, 0, 0, FPSInfo, strlen(FPSInfo));
+    }
 
     // write lag
     unsigned long ticks = GetTickCount();
@@ -62,10 +93,11 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         case WM_DESTROY:
             // do cleanup
             free(pvBits);
-            DeleteDC(hdcMem);
             PostQuitMessage(0);
             return 0;
         case WM_PAINT:
+            InterlockedExchange(&repaint, 1);
+            break;
         case WM_TIMER:
         default:
             break;
@@ -87,14 +119,10 @@ _Noreturn DWORD WINAPI ThreadRender(LPVOID pParam)
     mFPSTrace.lastDrawTick = GetTickCount();
     mFPSTrace.lagIndex = 0;
 
-    pvBits = malloc(4 * ScreenWidth * ScreenHeight);
-    hdcMem = CreateCompatibleDC(NULL);
-    HBITMAP hbt = CreateCompatibleBitmap(hdc, ScreenWidth, ScreenHeight);
-    SelectObject(hdcMem, hbt);
+    pvBits = calloc(ScreenWidth * ScreenHeight, 4);
 
     while (1)
     {
-        VT_Update();
         DrawBitmap();
         Sleep(1000/FPSDef);
     }
@@ -127,6 +155,10 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR szCmdLi
                              NULL, NULL, hInstance, NULL);
 
     VT_Init(ScreenWidth, ScreenHeight);
+    if (LoadFont(FontPath) < 0) {
+        printf("font load failed!\n");
+    }
+    VT_Write(title, strlen(title));
 
     hdc = GetDC(hWnd);
     ShowWindow(hWnd, SW_SHOW);